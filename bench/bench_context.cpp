@@ -0,0 +1,85 @@
+/**
+ * @brief 协程上下文切换延迟
+ * @details 分别测量Context::Swap(编译时选择的实现)、ucontext的swapcontext,
+ *          以及协程在单线程调度器中让出并重新调度一次的耗时。
+ *          先make clean再make CONTEXT=ucontext run_bench可以测量ucontext实现下的Context::Swap和调度器
+ */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "context.h"
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+
+using namespace std::chrono;
+
+static const size_t STACK_SIZE = 64 * 1024;
+
+static fisher::Context s_main, s_co;
+
+static void ContextEntry() {
+    while(true) {
+        fisher::Context::Swap(s_co, s_main);
+    }
+}
+
+static ucontext_t s_umain, s_uco;
+
+static void UcontextEntry() {
+    while(true) {
+        swapcontext(&s_uco, &s_umain);
+    }
+}
+
+static double NsPerSwitch(steady_clock::time_point start, long n) {
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count() / (2.0 * n);
+}
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 2000000;
+    FISHER_LOG_ROOT()->setLevel(fisher::LogLevel::ERROR);
+    FISHER_LOG_NAME("system")->setLevel(fisher::LogLevel::ERROR);
+
+    void* stack = malloc(STACK_SIZE);
+    s_co.make(stack, STACK_SIZE, ContextEntry);
+    auto start = steady_clock::now();
+    for(long i = 0; i < n; ++i) {
+        fisher::Context::Swap(s_main, s_co);
+    }
+    printf("Context::Swap(%s)   %8.1f ns/switch\n", fisher::Context::Backend(), NsPerSwitch(start, n));
+
+    void* ustack = malloc(STACK_SIZE);
+    getcontext(&s_uco);
+    s_uco.uc_link = nullptr;
+    s_uco.uc_stack.ss_sp = ustack;
+    s_uco.uc_stack.ss_size = STACK_SIZE;
+    makecontext(&s_uco, UcontextEntry, 0);
+    start = steady_clock::now();
+    for(long i = 0; i < n; ++i) {
+        swapcontext(&s_umain, &s_uco);
+    }
+    printf("swapcontext            %8.1f ns/switch\n", NsPerSwitch(start, n));
+
+    // 每次往返包含两次切换和一次入队出队,对应hook中IO就绪后恢复协程的路径
+    double ns = 0;
+    {
+        fisher::Scheduler scheduler(1, "bench");
+        scheduler.start();
+        scheduler.schedule([n, &ns]() {
+            fisher::Scheduler* self = fisher::Scheduler::GetThis();
+            auto start = steady_clock::now();
+            for(long i = 0; i < n; ++i) {
+                self->schedule(fisher::Fiber::GetThis());
+                fisher::Fiber::GetThis()->yeild();
+            }
+            ns = NsPerSwitch(start, n);
+        });
+        scheduler.stop();
+    }
+    printf("Scheduler yield/resume %8.1f ns/switch\n", ns);
+    free(stack);
+    free(ustack);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @brief IOManager的epoll与io_uring后端对比
+ * @details 用socketpair上的hook读写做乒乓,每个方向一次read和一次write。
+ *          single 一对socket往返N次;
+ *          multi  P对socket同时往返,每对N/P次。
+ *          参数: [往返次数] [工作线程数] [socket对数]
+ */
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "fdmanager.h"
+#include "iomanager.h"
+#include "log.h"
+
+using namespace std::chrono;
+
+/**
+ * @brief 返回每次往返的平均耗时(微秒)
+ */
+static double PingPong(int options, int threads, int pairs, long n, bool& uring) {
+    long per = n / pairs;
+    auto start = steady_clock::now();
+    {
+        fisher::IOManager iom(threads, "bench", options);
+        // 只有工作线程能判断是否启用了io_uring
+        iom.schedule([&uring]() {
+            uring = fisher::IOManager::GetThis()->hasUring();
+        });
+        for(int p = 0; p < pairs; ++p) {
+            int sv[2];
+            if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+                perror("socketpair");
+                exit(1);
+            }
+            // socketpair没有被hook,手动登记为socket
+            fisher::FdMgr::getInstance().get(sv[0], true);
+            fisher::FdMgr::getInstance().get(sv[1], true);
+            iom.schedule([sv, per]() {
+                char c;
+                for(long i = 0; i < per; ++i) {
+                    read(sv[1], &c, 1);
+                    write(sv[1], &c, 1);
+                }
+                close(sv[1]);
+            });
+            iom.schedule([sv, per]() {
+                char c = 'x';
+                for(long i = 0; i < per; ++i) {
+                    write(sv[0], &c, 1);
+                    read(sv[0], &c, 1);
+                }
+                close(sv[0]);
+            });
+        }
+        iom.stop();
+    }
+    return duration_cast<microseconds>(steady_clock::now() - start).count() / (double)(per * pairs);
+}
+
+int main(int argc, char** argv) {
+    FISHER_LOG_ROOT()->setLevel(fisher::LogLevel::ERROR);
+    FISHER_LOG_NAME("system")->setLevel(fisher::LogLevel::ERROR);
+    long n = argc > 1 ? atol(argv[1]) : 50000;
+    int threads = argc > 2 ? atoi(argv[2]) : 1;
+    int pairs = argc > 3 ? atoi(argv[3]) : 64;
+
+    struct Backend {
+        const char* name;
+        int options;
+    } backends[] = {
+        {"epoll", fisher::IOManager::DEFAULT},
+        {"epoll+persistent", fisher::IOManager::PERSISTENT},
+        {"io_uring", fisher::IOManager::URING},
+    };
+    printf("%-18s %16s %16s\n", "backend", "single us/rtt", "multi us/rtt");
+    for(auto& b : backends) {
+        bool uring = false;
+        double single = PingPong(b.options, threads, 1, n, uring);
+        double multi = PingPong(b.options, threads, pairs, n, uring);
+        printf("%-18s %16.2f %16.2f%s\n", b.name, single, multi
+                ,(b.options & fisher::IOManager::URING) && !uring ? "  (io_uring不可用,退回epoll)" : "");
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+/**
+ * @brief hook的recv延迟
+ * @details ready    数据已就绪时write_f加recv的耗时,与未hook的recv_f对比,差值是每次调用查找fd记录等的开销;
+ *          pingpong socketpair上两个协程用recv/write往返,recv每次都要挂起等待;
+ *          timeout  同pingpong,但设置了SO_RCVTIMEO,每次挂起都要添加和取消超时定时器。
+ *          参数: [次数]
+ */
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "fdmanager.h"
+#include "hook.h"
+#include "iomanager.h"
+#include "log.h"
+
+using namespace std::chrono;
+
+struct Result {
+    double ready_ns = 0;
+    double raw_ns = 0;
+    double pingpong_us = 0;
+    double timeout_us = 0;
+};
+
+static void SocketPair(int sv[2]) {
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+        perror("socketpair");
+        exit(1);
+    }
+    // socketpair没有被hook,手动登记为socket
+    fisher::FdMgr::getInstance().get(sv[0], true);
+    fisher::FdMgr::getInstance().get(sv[1], true);
+}
+
+/**
+ * @brief 返回每次往返的平均耗时(微秒)
+ */
+static double PingPong(fisher::IOManager& iom, long n, bool timeout) {
+    int sv[2];
+    SocketPair(sv);
+    if(timeout) {
+        timeval tv = {10, 0};
+        setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sv[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    iom.schedule([sv, n]() {
+        char c;
+        for(long i = 0; i < n; ++i) {
+            if(recv(sv[1], &c, 1, 0) != 1) {
+                perror("recv");
+                exit(1);
+            }
+            write(sv[1], &c, 1);
+        }
+    });
+    auto start = steady_clock::now();
+    char c = 'x';
+    for(long i = 0; i < n; ++i) {
+        write(sv[0], &c, 1);
+        if(recv(sv[0], &c, 1, 0) != 1) {
+            perror("recv");
+            exit(1);
+        }
+    }
+    double us = duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0 / n;
+    close(sv[0]);
+    close(sv[1]);
+    return us;
+}
+
+static Result Run(int options, long n) {
+    Result r;
+    fisher::IOManager iom(1, "bench", options);
+    iom.schedule([&r, &iom, n]() {
+        int sv[2];
+        SocketPair(sv);
+        char c = 'x';
+        auto start = steady_clock::now();
+        for(long i = 0; i < n; ++i) {
+            write_f(sv[0], &c, 1);
+            recv(sv[1], &c, 1, 0);
+        }
+        r.ready_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / (double)n;
+        start = steady_clock::now();
+        for(long i = 0; i < n; ++i) {
+            write_f(sv[0], &c, 1);
+            recv_f(sv[1], &c, 1, 0);
+        }
+        r.raw_ns = duration_cast<nanoseconds>(steady_clock::now() - start).count() / (double)n;
+        close(sv[0]);
+        close(sv[1]);
+
+        r.pingpong_us = PingPong(iom, n, false);
+        r.timeout_us = PingPong(iom, n, true);
+    });
+    iom.stop();
+    return r;
+}
+
+int main(int argc, char** argv) {
+    FISHER_LOG_ROOT()->setLevel(fisher::LogLevel::ERROR);
+    FISHER_LOG_NAME("system")->setLevel(fisher::LogLevel::ERROR);
+    long n = argc > 1 ? atol(argv[1]) : 100000;
+
+    struct Option {
+        const char* name;
+        int options;
+    } opts[] = {
+        {"default", fisher::IOManager::DEFAULT},
+        {"sharded", fisher::IOManager::SHARDED},
+        {"persistent", fisher::IOManager::PERSISTENT},
+        {"io_uring", fisher::IOManager::URING},
+    };
+    printf("%-12s %16s %16s %16s %16s\n", "options", "ready ns/recv", "recv_f ns/recv"
+            ,"pingpong us/rtt", "timeout us/rtt");
+    for(auto& o : opts) {
+        Result r = Run(o.options, n);
+        printf("%-12s %16.1f %16.1f %16.2f %16.2f\n", o.name, r.ready_ns, r.raw_ns
+                ,r.pingpong_us, r.timeout_us);
+    }
+    return 0;
+}
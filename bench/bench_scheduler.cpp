@@ -0,0 +1,82 @@
+/**
+ * @brief 调度器随线程数的扩展性
+ * @details 对每个线程数分别测量两种提交方式的吞吐:
+ *          inject 外部线程调用schedule,经过全局回调注入队列,由工作线程的runner执行,
+ *                 未完成的任务最多MAX_INFLIGHT个,避免注入队列无限增长;
+ *          spawn  每个工作线程中的协程提交任务,进入本地队列,空闲线程窃取。
+ *          参数: [任务数量] [线程数列表...],默认1到64线程
+ */
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "log.h"
+#include "scheduler.h"
+
+using namespace std::chrono;
+
+static const long MAX_INFLIGHT = 8192;
+
+static std::atomic<long> s_done {0};
+
+static void Task() {
+    s_done.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 返回每秒完成的任务数(百万)
+ */
+static double Inject(int threads, long n) {
+    s_done = 0;
+    fisher::Scheduler scheduler(threads, "bench");
+    scheduler.start();
+    auto start = steady_clock::now();
+    for(long i = 0; i < n; ++i) {
+        while(i - s_done.load(std::memory_order_relaxed) >= MAX_INFLIGHT) {
+            std::this_thread::yield();
+        }
+        scheduler.schedule(&Task);
+    }
+    scheduler.stop();
+    return n / (double)duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+static double Spawn(int threads, long n) {
+    s_done = 0;
+    fisher::Scheduler scheduler(threads, "bench");
+    scheduler.start();
+    auto start = steady_clock::now();
+    long per = n / threads;
+    for(int t = 0; t < threads; ++t) {
+        scheduler.schedule([per]() {
+            fisher::Scheduler* self = fisher::Scheduler::GetThis();
+            for(long i = 0; i < per; ++i) {
+                self->schedule(&Task);
+            }
+        }, t + 1);
+    }
+    scheduler.stop();
+    return per * threads / (double)duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    FISHER_LOG_ROOT()->setLevel(fisher::LogLevel::ERROR);
+    FISHER_LOG_NAME("system")->setLevel(fisher::LogLevel::ERROR);
+    long n = argc > 1 ? atol(argv[1]) : 200000;
+    std::vector<int> threads;
+    for(int i = 2; i < argc; ++i) {
+        threads.push_back(atoi(argv[i]));
+    }
+    if(threads.empty()) {
+        threads = {1, 2, 4, 8, 16, 32, 64};
+    }
+    printf("%8s %14s %14s\n", "threads", "inject Mops/s", "spawn Mops/s");
+    for(int t : threads) {
+        double inject = Inject(t, n);
+        double spawn = Spawn(t, n);
+        printf("%8d %14.2f %14.2f\n", t, inject, spawn);
+    }
+    return 0;
+}
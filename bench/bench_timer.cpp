@@ -0,0 +1,133 @@
+/**
+ * @brief 超时定时器频繁添加/取消的开销
+ * @details 模拟带超时的hook IO:先保持L个存活的定时器,再反复添加一个随机超时的定时器并立即取消
+ *          (IO在超时前完成)。对比三种实现:
+ *          set          原来的实现,std::set<shared_ptr>按到期时间排序,由shared_mutex保护;
+ *          wheel        时间轮,addConditionTimer/cancel,与set的用法相同;
+ *          wheel handle 时间轮,栈上的TimerHandle,即现在do_io使用的方式。
+ *          set的实现在本文件中编译,和库使用相同的编译选项,用make OPT=-O2比较优化后的结果。
+ *          参数: [添加/取消次数] [存活定时器数量]
+ */
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "clock.h"
+#include "timer.h"
+
+using namespace std::chrono;
+
+/**
+ * @brief 原来基于std::set的定时器,只保留添加和取消
+ */
+class SetTimers {
+public:
+    struct Timer {
+        uint64_t next = 0;
+        std::function<void()> cb;
+    };
+    typedef std::shared_ptr<Timer> TimerRef;
+
+    TimerRef add(uint64_t ms, std::function<void()> cb) {
+        TimerRef timer(new Timer);
+        timer->next = fisher::Clock::NowMS(fisher::Clock::MONOTONIC) + ms;
+        timer->cb = std::move(cb);
+        std::unique_lock lock(mutex_);
+        timers_.insert(timer);
+        return timer;
+    }
+
+    bool cancel(const TimerRef& timer) {
+        std::unique_lock lock(mutex_);
+        auto it = timers_.find(timer);
+        if(it == timers_.end()) {
+            return false;
+        }
+        timers_.erase(it);
+        return true;
+    }
+private:
+    struct Comparator {
+        bool operator()(const TimerRef& lhs, const TimerRef& rhs) const {
+            if(lhs->next != rhs->next) {
+                return lhs->next < rhs->next;
+            }
+            return lhs.get() < rhs.get();
+        }
+    };
+
+    std::shared_mutex mutex_;
+    std::set<TimerRef, Comparator> timers_;
+};
+
+class WheelTimers : public fisher::TimerManager {
+protected:
+    void onTimerInsertedAtFront(size_t wheel) override {}
+};
+
+static void OnTimeout(void* arg) {
+}
+
+static double NsPerOp(steady_clock::time_point start, long n) {
+    return duration_cast<nanoseconds>(steady_clock::now() - start).count() / (double)n;
+}
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 1000000;
+    long live = argc > 2 ? atol(argv[2]) : 10000;
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint64_t> live_ms(1000, 30000);
+    std::uniform_int_distribution<uint64_t> io_ms(100, 5000);
+    // do_io中的条件定时器以timer_info作为条件
+    std::shared_ptr<int> cond = std::make_shared<int>(0);
+    std::weak_ptr<void> weak_cond(cond);
+    auto cb = []() {};
+
+    SetTimers set;
+    std::vector<SetTimers::TimerRef> set_live;
+    for(long i = 0; i < live; ++i) {
+        set_live.push_back(set.add(live_ms(rng), cb));
+    }
+    auto start = steady_clock::now();
+    for(long i = 0; i < n; ++i) {
+        SetTimers::TimerRef timer = set.add(io_ms(rng), [weak_cond, cb]() {
+            if(auto observe = weak_cond.lock()) {
+                cb();
+            }
+        });
+        set.cancel(timer);
+    }
+    double set_ns = NsPerOp(start, n);
+
+    WheelTimers wheel;
+    std::vector<fisher::Timer::TimerRef> wheel_live;
+    for(long i = 0; i < live; ++i) {
+        wheel_live.push_back(wheel.addTimer(live_ms(rng), cb));
+    }
+    start = steady_clock::now();
+    for(long i = 0; i < n; ++i) {
+        fisher::Timer::TimerRef timer = wheel.addConditionTimer(io_ms(rng), cb, weak_cond);
+        timer->cancel();
+    }
+    double wheel_ns = NsPerOp(start, n);
+
+    start = steady_clock::now();
+    for(long i = 0; i < n; ++i) {
+        fisher::TimerHandle handle(&OnTimeout, nullptr);
+        wheel.addTimer(handle, io_ms(rng));
+        handle.cancel();
+    }
+    double handle_ns = NsPerOp(start, n);
+
+    printf("live=%ld ops=%ld (add+cancel)\n", live, n);
+    printf("%-14s %8.1f ns/op\n", "set", set_ns);
+    printf("%-14s %8.1f ns/op\n", "wheel", wheel_ns);
+    printf("%-14s %8.1f ns/op\n", "wheel handle", handle_ns);
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "channel.h"
+#include <algorithm>
+#include "fiber.h"
+
+namespace fisher {
+
+ChannelWaiter* ChannelBase::PopWaiter(WaitQueue& queue) {
+    while(FiberWaiter* w = queue.pop()) {
+        ChannelWaiter* cw = static_cast<ChannelWaiter*>(w);
+        if(cw->claim()) {
+            return cw;
+        }
+    }
+    return nullptr;
+}
+
+bool ChannelBase::park(WaitQueue& queue, void* value) {
+    ChannelWaiter waiter;
+    waiter.value = value;
+    Fiber* self = waiter.prepare();
+    queue.push(&waiter);
+    guard_.unlock();
+    self->yeild();
+    return waiter.ok;
+}
+
+void ChannelBase::parkRing(std::atomic<ChannelWaiter*>& slot
+                           ,const std::atomic<uint64_t>& peer, uint64_t seen) {
+    ChannelWaiter waiter;
+    Fiber* self = waiter.prepare();
+    slot.store(&waiter, std::memory_order_relaxed);
+    // 与WakeRing中的屏障配对:要么对端看到waiter,要么这里看到对端的推进
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(peer.load(std::memory_order_relaxed) != seen
+            || closed_.load(std::memory_order_relaxed)) {
+        if(slot.exchange(nullptr, std::memory_order_acq_rel) == &waiter) {
+            return;
+        }
+        // 对端已经取走waiter,唤醒马上就会到来
+    }
+    self->yeild();
+}
+
+void ChannelBase::WakeRing(std::atomic<ChannelWaiter*>& slot) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(slot.load(std::memory_order_relaxed)) {
+        ChannelWaiter* w = slot.exchange(nullptr, std::memory_order_acq_rel);
+        if(w) {
+            w->wake();
+        }
+    }
+}
+
+void ChannelBase::close() {
+    if(mode_ == SPSC) {
+        closed_.store(true, std::memory_order_release);
+        WakeRing(sendWaiter_);
+        WakeRing(recvWaiter_);
+        return;
+    }
+    WaitQueue wake;
+    guard_.lock();
+    closed_.store(true, std::memory_order_release);
+    while(ChannelWaiter* w = PopWaiter(sendq_)) {
+        w->ok = false;
+        wake.push(w);
+    }
+    // 有接收方挂起说明缓冲区为空
+    while(ChannelWaiter* w = PopWaiter(recvq_)) {
+        w->ok = false;
+        wake.push(w);
+    }
+    guard_.unlock();
+    FiberWaiter* w = wake.popAll();
+    while(w) {
+        FiberWaiter* next = w->next;
+        w->wake();
+        w = next;
+    }
+}
+
+void Select::addCase(ChannelBase* chan, void* value, bool* ok, TryOp op, bool send) {
+    assert(chan->mode_ == ChannelBase::MPMC);
+    cases_.push_back(Case{chan, value, ok, op, send});
+    auto it = std::lower_bound(chans_.begin(), chans_.end(), chan);
+    if(it == chans_.end() || *it != chan) {
+        chans_.insert(it, chan);
+    }
+}
+
+void Select::lockAll() {
+    for(auto i : chans_) {
+        i->guard_.lock();
+    }
+}
+
+void Select::unlockAll() {
+    for(auto it = chans_.rbegin(); it != chans_.rend(); ++it) {
+        (*it)->guard_.unlock();
+    }
+}
+
+int Select::select(bool block) {
+    if(cases_.empty()) {
+        return -1;
+    }
+    static thread_local size_t t_start = 0;
+    size_t n = cases_.size();
+    size_t start = t_start++ % n;
+
+    lockAll();
+    for(size_t k = 0; k < n; ++k) {
+        size_t i = (start + k) % n;
+        Case& c = cases_[i];
+        bool ok = false;
+        ChannelWaiter* wake = nullptr;
+        if(c.op(c.chan, c.value, ok, wake)) {
+            unlockAll();
+            if(wake) {
+                wake->wake();
+            }
+            if(c.ok) {
+                *c.ok = ok;
+            }
+            return i;
+        }
+    }
+    if(!block) {
+        unlockAll();
+        return -1;
+    }
+
+    // 在每个通道上挂一个节点,第一个认领成功的通道完成操作并唤醒
+    std::atomic<int> selected(-1);
+    // 常见的少量操作用栈上的数组,更多时复用成员缓冲区,挂起等待不分配内存
+    ChannelWaiter local[INLINE_CASES];
+    ChannelWaiter* waiters = local;
+    if(n > INLINE_CASES) {
+        waiters_.resize(n);
+        waiters = waiters_.data();
+    }
+    Fiber* self = nullptr;
+    for(size_t i = 0; i < n; ++i) {
+        Case& c = cases_[i];
+        ChannelWaiter& w = waiters[i];
+        w = ChannelWaiter();
+        w.value = c.value;
+        w.selected = &selected;
+        w.index = i;
+        self = w.prepare();
+        (c.send ? c.chan->sendq_ : c.chan->recvq_).push(&w);
+    }
+    unlockAll();
+    self->yeild();
+
+    // 摘下其余的节点,同时等待完成操作的通道释放锁
+    lockAll();
+    for(size_t i = 0; i < n; ++i) {
+        Case& c = cases_[i];
+        (c.send ? c.chan->sendq_ : c.chan->recvq_).remove(&waiters[i]);
+        // 复用的节点不能继续持有当前协程
+        waiters[i].fiber.reset();
+    }
+    unlockAll();
+
+    int i = selected.load(std::memory_order_acquire);
+    assert(i >= 0);
+    if(cases_[i].ok) {
+        *cases_[i].ok = waiters[i].ok;
+    }
+    return i;
+}
+
+}
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <new>
+#include <vector>
+#include <assert.h>
+#include <stdint.h>
+#include "mutex.h"
+
+namespace fisher {
+
+class Select;
+
+/**
+ * @brief 挂起在通道上的协程,位于该协程的栈上
+ */
+struct ChannelWaiter : public FiberWaiter {
+    /// 发送时指向待发送的值,接收时指向接收的位置
+    void* value = nullptr;
+    /// 操作是否成功,通道关闭时为false
+    bool ok = false;
+    /// 所属Select的结果,普通的发送和接收为nullptr
+    std::atomic<int>* selected = nullptr;
+    /// 在Select中的下标
+    int index = -1;
+
+    /**
+     * @brief 认领该节点
+     * @return 所属的Select已经由其他通道完成时返回false,节点应丢弃
+     */
+    bool claim() {
+        if(!selected) {
+            return true;
+        }
+        int expected = -1;
+        return selected->compare_exchange_strong(expected, index
+                    ,std::memory_order_acq_rel);
+    }
+};
+
+/**
+ * @brief 通道中与元素类型无关的部分
+ */
+class ChannelBase {
+friend class Select;
+public:
+    /**
+     * @brief 通道模式
+     */
+    enum Mode {
+        /// 多生产者多消费者,由自旋锁保护,支持Select
+        MPMC = 0,
+        /// 单生产者单消费者,无锁环形缓冲区,不支持Select
+        SPSC = 1,
+    };
+
+    ChannelBase(const ChannelBase&) = delete;
+    ChannelBase& operator=(const ChannelBase&) = delete;
+
+    /**
+     * @brief 关闭通道
+     * @details 挂起的发送方返回false;接收方取完剩余的元素后返回false
+     */
+    void close();
+
+    /**
+     * @brief 是否已关闭
+     */
+    bool isClosed() const { return closed_.load(std::memory_order_acquire);}
+
+    /**
+     * @brief 返回容量
+     */
+    size_t capacity() const { return capacity_;}
+
+    /**
+     * @brief 返回模式
+     */
+    Mode getMode() const { return mode_;}
+protected:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量
+     * @param[in] mode 模式
+     */
+    ChannelBase(size_t capacity, Mode mode)
+        :capacity_(capacity)
+        ,mode_(mode) {}
+
+    ~ChannelBase() {
+        assert(sendq_.empty() && recvq_.empty());
+    }
+
+    /**
+     * @brief 取出队列中第一个可以认领的节点,需持有guard_
+     */
+    static ChannelWaiter* PopWaiter(WaitQueue& queue);
+
+    /**
+     * @brief 把当前协程挂到queue上,释放guard_后挂起
+     * @param[in] value 发送或接收的值
+     * @return 操作是否成功
+     */
+    bool park(WaitQueue& queue, void* value);
+
+    /**
+     * @brief SPSC模式下挂起当前协程,直到peer不等于seen或通道关闭
+     * @param[in] slot 当前一端的等待者
+     * @param[in] peer 对端推进的下标
+     * @param[in] seen 检查时看到的peer
+     */
+    void parkRing(std::atomic<ChannelWaiter*>& slot
+                  ,const std::atomic<uint64_t>& peer, uint64_t seen);
+
+    /**
+     * @brief SPSC模式下唤醒挂起的对端
+     */
+    static void WakeRing(std::atomic<ChannelWaiter*>& slot);
+protected:
+    /// 容量
+    size_t capacity_;
+    /// 模式
+    Mode mode_;
+    /// 是否已关闭
+    std::atomic<bool> closed_ = {false};
+
+    /// MPMC: 保护缓冲区和等待队列
+    SpinLock guard_;
+    /// MPMC: 挂起的发送方
+    WaitQueue sendq_;
+    /// MPMC: 挂起的接收方
+    WaitQueue recvq_;
+
+    /// SPSC: 接收方的读下标
+    alignas(64) std::atomic<uint64_t> head_ = {0};
+    /// SPSC: 挂起的发送方
+    std::atomic<ChannelWaiter*> sendWaiter_ = {nullptr};
+    /// SPSC: 发送方的写下标
+    alignas(64) std::atomic<uint64_t> tail_ = {0};
+    /// SPSC: 挂起的接收方
+    std::atomic<ChannelWaiter*> recvWaiter_ = {nullptr};
+};
+
+/**
+ * @brief 有界通道,用于协程之间传递数据
+ * @details 发送和接收在通道满或空时只挂起当前协程。容量为0时发送方和接收方直接交接。
+ *          MPMC模式下任意协程都可以收发;SPSC模式下只能有一个发送协程和一个接收协程,
+ *          两端都不加锁,适合流水线中固定的相邻两级。SPSC由调用方在构造时显式选择,
+ *          通道不会根据实际的收发方自动切换,违反单生产者单消费者的约定是未定义行为。
+ *          只能在调度器的协程中阻塞收发
+ */
+template<class T>
+class Channel : public ChannelBase {
+friend class Select;
+public:
+    /// 通道的智能指针类型
+    using ChannelRef = std::shared_ptr<Channel>;
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量,SPSC模式下至少为1
+     * @param[in] mode 模式
+     */
+    explicit Channel(size_t capacity, Mode mode = MPMC)
+        :ChannelBase(capacity, mode) {
+        if(mode == SPSC) {
+            assert(capacity > 0);
+            size_t cap = 1;
+            while(cap < capacity) {
+                cap <<= 1;
+            }
+            mask_ = cap - 1;
+            ring_.reset(new Slot[cap]);
+        }
+    }
+
+    /**
+     * @brief 析构函数,不能还有挂起的协程
+     */
+    ~Channel() {
+        if(mode_ == SPSC) {
+            uint64_t tail = tail_.load(std::memory_order_acquire);
+            for(uint64_t i = head_.load(std::memory_order_relaxed); i != tail; ++i) {
+                ring_[i & mask_].get()->~T();
+            }
+        }
+    }
+
+    /**
+     * @brief 发送,通道满时挂起当前协程
+     * @return 通道已关闭返回false
+     */
+    bool send(T value) {
+        return mode_ == SPSC ? ringSend(value, true) : lockedOp(true, value, true);
+    }
+
+    /**
+     * @brief 尝试发送,不挂起
+     * @param[in] value 成功时被移走
+     * @return 通道已满或已关闭返回false
+     */
+    bool trySend(T& value) {
+        return mode_ == SPSC ? ringSend(value, false) : lockedOp(true, value, false);
+    }
+
+    /**
+     * @brief 接收,通道空时挂起当前协程
+     * @return 通道已关闭且没有剩余元素返回false
+     */
+    bool recv(T& value) {
+        return mode_ == SPSC ? ringRecv(value, true) : lockedOp(false, value, true);
+    }
+
+    /**
+     * @brief 尝试接收,不挂起
+     * @return 通道为空返回false
+     */
+    bool tryRecv(T& value) {
+        return mode_ == SPSC ? ringRecv(value, false) : lockedOp(false, value, false);
+    }
+
+    /**
+     * @brief 缓冲区中元素的数量
+     */
+    size_t size() {
+        if(mode_ == SPSC) {
+            return tail_.load(std::memory_order_acquire)
+                - head_.load(std::memory_order_acquire);
+        }
+        std::unique_lock lock(guard_);
+        return buffer_.size();
+    }
+private:
+    /**
+     * @brief 环形缓冲区的槽位
+     */
+    struct Slot {
+        alignas(T) unsigned char data[sizeof(T)];
+        T* get() { return reinterpret_cast<T*>(data);}
+    };
+
+    /**
+     * @brief 尝试发送,需持有guard_
+     * @param[out] ok 操作是否成功
+     * @param[out] wake 需要在释放guard_后唤醒的等待者
+     * @return 需要等待返回false
+     */
+    bool trySendLocked(T& value, bool& ok, ChannelWaiter*& wake) {
+        if(closed_.load(std::memory_order_relaxed)) {
+            ok = false;
+            return true;
+        }
+        if(ChannelWaiter* w = PopWaiter(recvq_)) {
+            *static_cast<T*>(w->value) = std::move(value);
+            w->ok = true;
+            wake = w;
+        } else if(buffer_.size() < capacity_) {
+            buffer_.push_back(std::move(value));
+        } else {
+            return false;
+        }
+        ok = true;
+        return true;
+    }
+
+    /**
+     * @brief 尝试接收,需持有guard_
+     * @param[out] ok 操作是否成功
+     * @param[out] wake 需要在释放guard_后唤醒的等待者
+     * @return 需要等待返回false
+     */
+    bool tryRecvLocked(T& value, bool& ok, ChannelWaiter*& wake) {
+        if(!buffer_.empty()) {
+            value = std::move(buffer_.front());
+            buffer_.pop_front();
+            // 腾出的位置交给挂起的发送方
+            if(ChannelWaiter* w = PopWaiter(sendq_)) {
+                buffer_.push_back(std::move(*static_cast<T*>(w->value)));
+                w->ok = true;
+                wake = w;
+            }
+        } else if(ChannelWaiter* w = PopWaiter(sendq_)) {
+            value = std::move(*static_cast<T*>(w->value));
+            w->ok = true;
+            wake = w;
+        } else if(closed_.load(std::memory_order_relaxed)) {
+            ok = false;
+            return true;
+        } else {
+            return false;
+        }
+        ok = true;
+        return true;
+    }
+
+    static bool TrySendOp(ChannelBase* ch, void* value, bool& ok, ChannelWaiter*& wake) {
+        return static_cast<Channel*>(ch)->trySendLocked(*static_cast<T*>(value), ok, wake);
+    }
+
+    static bool TryRecvOp(ChannelBase* ch, void* value, bool& ok, ChannelWaiter*& wake) {
+        return static_cast<Channel*>(ch)->tryRecvLocked(*static_cast<T*>(value), ok, wake);
+    }
+
+    /**
+     * @brief MPMC模式的收发
+     * @param[in] is_send 是否为发送
+     * @param[in] block 是否挂起等待
+     */
+    bool lockedOp(bool is_send, T& value, bool block) {
+        bool ok = false;
+        ChannelWaiter* wake = nullptr;
+        guard_.lock();
+        bool done = is_send ? trySendLocked(value, ok, wake)
+                            : tryRecvLocked(value, ok, wake);
+        if(done || !block) {
+            guard_.unlock();
+            if(wake) {
+                wake->wake();
+            }
+            return done && ok;
+        }
+        return park(is_send ? sendq_ : recvq_, &value);
+    }
+
+    /**
+     * @brief SPSC模式的发送
+     */
+    bool ringSend(T& value, bool block) {
+        while(true) {
+            if(closed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            uint64_t tail = tail_.load(std::memory_order_relaxed);
+            uint64_t head = head_.load(std::memory_order_acquire);
+            if(tail - head < capacity_) {
+                new (ring_[tail & mask_].get()) T(std::move(value));
+                tail_.store(tail + 1, std::memory_order_release);
+                WakeRing(recvWaiter_);
+                return true;
+            }
+            if(!block) {
+                return false;
+            }
+            parkRing(sendWaiter_, head_, head);
+        }
+    }
+
+    /**
+     * @brief SPSC模式的接收
+     */
+    bool ringRecv(T& value, bool block) {
+        while(true) {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            uint64_t tail = tail_.load(std::memory_order_acquire);
+            if(head != tail) {
+                T* item = ring_[head & mask_].get();
+                value = std::move(*item);
+                item->~T();
+                head_.store(head + 1, std::memory_order_release);
+                WakeRing(sendWaiter_);
+                return true;
+            }
+            if(closed_.load(std::memory_order_acquire)) {
+                // 关闭之前发送的元素要先取完
+                if(tail_.load(std::memory_order_acquire) != head) {
+                    continue;
+                }
+                return false;
+            }
+            if(!block) {
+                return false;
+            }
+            parkRing(recvWaiter_, tail_, tail);
+        }
+    }
+private:
+    /// MPMC: 缓冲区
+    std::deque<T> buffer_;
+    /// SPSC: 环形缓冲区,大小为2的幂
+    std::unique_ptr<Slot[]> ring_;
+    /// SPSC: 环形缓冲区大小减一
+    uint64_t mask_ = 0;
+};
+
+/**
+ * @brief 同时等待多个通道操作,完成其中一个
+ * @details 只支持MPMC模式的通道。多个操作同时就绪时轮流选择,避免总是偏向前面的操作。
+ *          挂起等待时不超过4个操作不分配内存,可以在循环中复用同一个Select。
+ *          用法:
+ *          Select sel;
+ *          sel.recv(in, v).send(out, w);
+ *          int i = sel.wait();
+ */
+class Select {
+public:
+    /**
+     * @brief 添加发送操作
+     * @param[in] value 发送成功时被移走
+     * @param[out] ok 操作完成时是否成功
+     */
+    template<class T>
+    Select& send(Channel<T>& ch, T& value, bool* ok = nullptr) {
+        addCase(&ch, &value, ok, &Channel<T>::TrySendOp, true);
+        return *this;
+    }
+
+    /**
+     * @brief 添加接收操作
+     * @param[out] value 接收的值
+     * @param[out] ok 操作完成时是否成功
+     */
+    template<class T>
+    Select& recv(Channel<T>& ch, T& value, bool* ok = nullptr) {
+        addCase(&ch, &value, ok, &Channel<T>::TryRecvOp, false);
+        return *this;
+    }
+
+    /**
+     * @brief 挂起当前协程,直到一个操作完成
+     * @return 完成的操作的下标(按添加顺序),没有操作返回-1
+     */
+    int wait() { return select(true);}
+
+    /**
+     * @brief 完成一个已经就绪的操作,不挂起
+     * @return 完成的操作的下标,都未就绪返回-1
+     */
+    int tryWait() { return select(false);}
+private:
+    /// 持有guard_时尝试执行操作
+    using TryOp = bool(*)(ChannelBase*, void*, bool&, ChannelWaiter*&);
+    /// 挂起时不超过该数量的操作使用栈上的节点
+    static const size_t INLINE_CASES = 4;
+
+    /**
+     * @brief 一个发送或接收操作
+     */
+    struct Case {
+        ChannelBase* chan;
+        void* value;
+        bool* ok;
+        TryOp op;
+        bool send;
+    };
+
+    void addCase(ChannelBase* chan, void* value, bool* ok, TryOp op, bool send);
+    int select(bool block);
+    void lockAll();
+    void unlockAll();
+private:
+    /// 所有操作
+    std::vector<Case> cases_;
+    /// 涉及的通道,按地址排序去重,按此顺序加锁
+    std::vector<ChannelBase*> chans_;
+    /// 操作多于INLINE_CASES个时挂起用的节点,多次wait之间复用
+    std::vector<ChannelWaiter> waiters_;
+};
+
+}
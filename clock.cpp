@@ -0,0 +1,35 @@
+#include "clock.h"
+#include <time.h>
+
+namespace fisher {
+
+/// 当前线程缓存的时间,下标为Clock::Source
+static thread_local uint64_t t_cached[2] = {0, 0};
+/// 当前线程是否调用过Update
+static thread_local bool t_updated = false;
+
+static uint64_t ReadMS(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+uint64_t Clock::NowMS(Source source) {
+    return ReadMS(source == MONOTONIC ? CLOCK_MONOTONIC : CLOCK_REALTIME);
+}
+
+uint64_t Clock::CachedMS(Source source) {
+    if(!t_updated) {
+        return NowMS(source);
+    }
+    return t_cached[source];
+}
+
+uint64_t Clock::Update() {
+    t_cached[MONOTONIC] = ReadMS(CLOCK_MONOTONIC);
+    t_cached[WALL] = ReadMS(CLOCK_REALTIME);
+    t_updated = true;
+    return t_cached[MONOTONIC];
+}
+
+}
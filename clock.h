@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace fisher {
+
+/**
+ * @brief 时钟
+ * @details 区分两种时间来源:
+ *          MONOTONIC 单调时钟,不受系统时间调整影响,用于定时器和超时;
+ *          WALL      墙上时钟(Unix时间),用于日志时间戳和协议中的日期。
+ *          CachedMS返回当前线程缓存的值,读取没有系统调用。
+ *          IOManager每轮事件循环调用Update刷新缓存,在两次刷新之间时间不前进,
+ *          协程长时间不让出时缓存的时间会落后,因此定时器和超时的截止时间必须用NowMS计算,
+ *          缓存用于推进时间轮,以及日志时间戳、协议日期等允许滞后的墙上时间;
+ *          从未调用过Update的线程直接读取同一个系统时钟
+ */
+class Clock {
+public:
+    /**
+     * @brief 时间来源
+     */
+    enum Source {
+        /// 单调时钟
+        MONOTONIC = 0,
+        /// 墙上时钟
+        WALL      = 1,
+    };
+
+    /**
+     * @brief 读取系统时钟
+     * @param[in] source 时间来源
+     * @return 毫秒
+     */
+    static uint64_t NowMS(Source source);
+
+    /**
+     * @brief 返回当前线程缓存的时间
+     * @param[in] source 时间来源
+     * @return 毫秒
+     */
+    static uint64_t CachedMS(Source source);
+
+    /**
+     * @brief 读取系统时钟刷新当前线程的缓存
+     * @return 单调时钟(毫秒)
+     */
+    static uint64_t Update();
+};
+
+}
@@ -0,0 +1,95 @@
+#include "context.h"
+#include <cassert>
+#include <stdint.h>
+
+#ifndef FISHER_USE_UCONTEXT
+extern "C" void fisher_swap_context(void** from_sp, void* to_sp);
+
+// void fisher_swap_context(void** from_sp, void* to_sp)
+// 保存rbp, rbx, r12-r15以及MXCSR/x87控制字到当前栈,
+// 栈指针写入*from_sp,然后切换到to_sp并按相反顺序恢复
+__asm__(
+    ".text\n"
+    ".globl fisher_swap_context\n"
+    ".type fisher_swap_context,@function\n"
+    ".align 16\n"
+    "fisher_swap_context:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r15\n"
+    "    pushq %r14\n"
+    "    pushq %r13\n"
+    "    pushq %r12\n"
+    "    leaq -8(%rsp), %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    leaq 8(%rsp), %rsp\n"
+    "    popq %r12\n"
+    "    popq %r13\n"
+    "    popq %r14\n"
+    "    popq %r15\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size fisher_swap_context,.-fisher_swap_context\n"
+);
+#endif
+
+namespace fisher {
+
+#ifdef FISHER_USE_UCONTEXT
+
+void Context::make(void* stack, size_t size, EntryFunc fn) {
+    if(getcontext(&ctx_)) {
+        assert(false);
+    }
+    ctx_.uc_link = nullptr;
+    ctx_.uc_stack.ss_sp = stack;
+    ctx_.uc_stack.ss_size = size;
+    makecontext(&ctx_, fn, 0);
+}
+
+void Context::Swap(Context& from, Context& to) {
+    if(swapcontext(&from.ctx_, &to.ctx_)) {
+        assert(false);
+    }
+}
+
+const char* Context::Backend() {
+    return "ucontext";
+}
+
+#else
+
+void Context::make(void* stack, size_t size, EntryFunc fn) {
+    // 栈顶按16字节对齐,构造出与fisher_swap_context切出时相同的布局:
+    // [mxcsr|fpu cw][r12][r13][r14][r15][rbx][rbp][fn][0]
+    // ret进入fn时 rsp % 16 == 8, 与正常call后的状态一致
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+    uint64_t* sp = (uint64_t*)top;
+    *--sp = 0;
+    *--sp = (uint64_t)fn;
+    for(int i = 0; i < 6; ++i) {
+        *--sp = 0;
+    }
+    --sp;
+    ((uint32_t*)sp)[0] = 0x1F80;
+    ((uint32_t*)sp)[1] = 0x037F;
+    sp_ = sp;
+}
+
+void Context::Swap(Context& from, Context& to) {
+    fisher_swap_context(&from.sp_, to.sp_);
+}
+
+const char* Context::Backend() {
+    return "x86_64 asm";
+}
+
+#endif
+
+}
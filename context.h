@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+
+#if !defined(__x86_64__) && !defined(FISHER_USE_UCONTEXT)
+#define FISHER_USE_UCONTEXT
+#endif
+
+#ifdef FISHER_USE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+namespace fisher {
+
+/**
+ * @brief 协程上下文
+ * @details 默认使用x86-64汇编实现的切换,只保存callee-saved寄存器和栈指针,
+ *          不涉及信号掩码,切换过程没有系统调用。
+ *          定义FISHER_USE_UCONTEXT或非x86-64平台时退回ucontext实现
+ */
+class Context {
+public:
+    using EntryFunc = void (*)();
+
+    /**
+     * @brief 在指定的栈上构造上下文
+     * @param[in] stack 栈起始地址
+     * @param[in] size 栈大小
+     * @param[in] fn 首次切换进来时执行的函数,不能返回
+     */
+    void make(void* stack, size_t size, EntryFunc fn);
+
+    /**
+     * @brief 保存当前上下文到from,并切换到to
+     */
+    static void Swap(Context& from, Context& to);
+
+    /**
+     * @brief 返回当前使用的实现名称
+     */
+    static const char* Backend();
+private:
+#ifdef FISHER_USE_UCONTEXT
+    ucontext_t ctx_;
+#else
+    /// 切出时保存的栈指针,寄存器都保存在栈上
+    void* sp_ = nullptr;
+#endif
+};
+
+}
@@ -0,0 +1,93 @@
+#include "diskio.h"
+#include <errno.h>
+#include "scheduler.h"
+
+namespace fisher {
+
+DiskIOPool::DiskIOPool(size_t max_threads)
+    :max_threads_(max_threads ? max_threads : 1) {
+}
+
+DiskIOPool::~DiskIOPool() {
+    {
+        std::unique_lock lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for(auto& i : threads_) {
+        i.join();
+    }
+}
+
+ssize_t DiskIOPool::submit(Request& req) {
+    if(!Scheduler::GetThis()) {
+        return req.call(req.arg);
+    }
+    Fiber* self = req.waiter.prepare();
+    {
+        std::unique_lock lock(mutex_);
+        if(tail_) {
+            tail_->next = &req;
+        } else {
+            head_ = &req;
+        }
+        tail_ = &req;
+        ++stats_.submitted;
+        if(++stats_.queued > stats_.max_queued) {
+            stats_.max_queued = stats_.queued;
+        }
+        if(n_idle_) {
+            cond_.notify_one();
+        } else if(threads_.size() < max_threads_) {
+            threads_.emplace_back(&DiskIOPool::main, this);
+        }
+    }
+    self->yeild();
+    errno = req.error;
+    return req.result;
+}
+
+void DiskIOPool::main() {
+    std::unique_lock lock(mutex_);
+    while(true) {
+        while(!head_ && !stop_) {
+            ++n_idle_;
+            cond_.wait(lock);
+            --n_idle_;
+        }
+        if(!head_) {
+            break;
+        }
+        Request* req = head_;
+        head_ = req->next;
+        if(!head_) {
+            tail_ = nullptr;
+        }
+        --stats_.queued;
+        ++stats_.running;
+        lock.unlock();
+
+        req->result = req->call(req->arg);
+        req->error = errno;
+        // 唤醒后请求所在的协程栈随时可能失效,之后不能再访问req
+        req->waiter.wake();
+
+        lock.lock();
+        --stats_.running;
+        ++stats_.completed;
+    }
+}
+
+void DiskIOPool::setMaxThreads(size_t v) {
+    std::unique_lock lock(mutex_);
+    max_threads_ = v ? v : 1;
+}
+
+DiskIOPool::Stats DiskIOPool::getStats() {
+    std::unique_lock lock(mutex_);
+    Stats stats = stats_;
+    stats.threads = threads_.size();
+    return stats;
+}
+
+}
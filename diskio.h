@@ -0,0 +1,130 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "mutex.h"
+#include "singleton.h"
+
+namespace fisher {
+
+/**
+ * @brief 执行阻塞文件IO的线程池
+ * @details 普通文件的read/write等没有就绪通知,直接调用会阻塞调度线程和其上的所有协程。
+ *          hook把这些调用交给线程池执行,调用的协程挂起直到完成。
+ *          线程按需创建,数量不超过上限,请求按提交顺序执行
+ */
+class DiskIOPool {
+public:
+    /**
+     * @brief 线程池统计信息
+     */
+    struct Stats {
+        /// 提交的请求数量
+        uint64_t submitted = 0;
+        /// 完成的请求数量
+        uint64_t completed = 0;
+        /// 当前排队等待线程的请求数量
+        uint64_t queued = 0;
+        /// 排队数量的峰值
+        uint64_t max_queued = 0;
+        /// 正在执行的请求数量
+        uint64_t running = 0;
+        /// 已创建的线程数量
+        uint64_t threads = 0;
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] max_threads 最多创建的线程数量,即同时执行的请求数量上限
+     */
+    explicit DiskIOPool(size_t max_threads = 4);
+
+    /**
+     * @brief 析构函数,执行完排队的请求后结束所有线程
+     */
+    ~DiskIOPool();
+
+    DiskIOPool(const DiskIOPool&) = delete;
+    DiskIOPool& operator=(const DiskIOPool&) = delete;
+
+    /**
+     * @brief 在线程池中执行fn,挂起当前协程直到完成
+     * @details 不在协程调度器中时直接在当前线程执行。fn中设置的errno会带回当前线程
+     * @param[in] fn 返回值可转换为ssize_t的阻塞调用,执行完之前一直有效,不需要拷贝
+     */
+    template<class F>
+    ssize_t run(F&& fn) {
+        using Fn = typename std::remove_reference<F>::type;
+        Request req;
+        req.call = [](void* arg) -> ssize_t { return (*(Fn*)arg)();};
+        req.arg = (void*)&fn;
+        return submit(req);
+    }
+
+    /**
+     * @brief 设置最多创建的线程数量,已创建的线程不会减少
+     */
+    void setMaxThreads(size_t v);
+
+    /**
+     * @brief 返回统计信息
+     */
+    Stats getStats();
+private:
+    /**
+     * @brief 一次阻塞调用,位于提交请求的协程栈上
+     */
+    struct Request {
+        /// 执行调用
+        ssize_t (*call)(void* arg) = nullptr;
+        /// 调用的参数
+        void* arg = nullptr;
+        /// 调用的返回值
+        ssize_t result = 0;
+        /// 调用后的errno
+        int error = 0;
+        /// 等待完成的协程
+        FiberWaiter waiter;
+        /// 队列中的下一个请求
+        Request* next = nullptr;
+    };
+
+    /**
+     * @brief 提交请求,挂起当前协程直到完成
+     */
+    ssize_t submit(Request& req);
+
+    /**
+     * @brief 线程主函数
+     */
+    void main();
+private:
+    /// 保护以下成员
+    std::mutex mutex_;
+    /// 通知线程有新的请求
+    std::condition_variable cond_;
+    /// 请求队列
+    Request* head_ = nullptr;
+    Request* tail_ = nullptr;
+    /// 线程
+    std::vector<std::thread> threads_;
+    /// 最多创建的线程数量
+    size_t max_threads_;
+    /// 等待请求的线程数量
+    size_t n_idle_ = 0;
+    /// 是否正在析构
+    bool stop_ = false;
+    /// 统计信息
+    Stats stats_;
+};
+
+/// 磁盘IO线程池单例
+typedef Singleton<DiskIOPool> DiskIOMgr;
+
+}
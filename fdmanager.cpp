@@ -10,95 +10,99 @@ namespace fisher {
 FdCtx::FdCtx(int fd)
     :isInit_(false)
     ,isSocket_(false)
-    ,nonblock_(false)
+    ,isFile_(false)
+    ,sysNonblock_(false)
+    ,userNonblock_(false)
     ,isClosed_(false)
     ,fd_(fd)
-    ,recvTimeout_(-1)
-    ,sendTimeout_(-1) {
-    init();
+    ,recvTimeout_(UINT32_MAX)
+    ,sendTimeout_(UINT32_MAX) {
 }
 
 FdCtx::~FdCtx() {
 }
 
 bool FdCtx::init() {
-    if(isInit_) {
-        return true;
-    }
-    recvTimeout_ = -1;
-    sendTimeout_ = -1;
+    recvTimeout_ = UINT32_MAX;
+    sendTimeout_ = UINT32_MAX;
 
     struct stat fd_stat;
     // no such fd
     if(-1 == fstat(fd_, &fd_stat)) {
         isInit_ = false;
         isSocket_ = false;
+        isFile_ = false;
     } else {
         isInit_ = true;
         isSocket_ = S_ISSOCK(fd_stat.st_mode);
+        isFile_ = S_ISREG(fd_stat.st_mode);
     }
 
     if(isSocket_) {
-        int flags = fcntl(fd_, F_GETFL, 0);
-        if(!(flags & O_NONBLOCK)) {
-            fcntl(fd_, F_SETFL, flags | O_NONBLOCK);
+        // 句柄在接管前已经是非阻塞的(如SOCK_NONBLOCK),用户期望的也是非阻塞语义
+        int flags = fcntl_f(fd_, F_GETFL, 0);
+        userNonblock_ = flags != -1 && (flags & O_NONBLOCK);
+        if(flags != -1 && !(flags & O_NONBLOCK)) {
+            fcntl_f(fd_, F_SETFL, flags | O_NONBLOCK);
         }
-        nonblock_ = true;
+        sysNonblock_ = true;
     } else {
-        nonblock_ = false;
+        sysNonblock_ = false;
+        userNonblock_ = false;
     }
 
     isClosed_ = false;
+    active_.store(true, std::memory_order_release);
     return isInit_;
 }
 
 void FdCtx::setTimeout(int type, uint64_t v) {
+    uint32_t ms = v >= UINT32_MAX ? UINT32_MAX : v;
     if(type == SO_RCVTIMEO) {
-        recvTimeout_ = v;
+        recvTimeout_ = ms;
     } else {
-        sendTimeout_ = v;
+        sendTimeout_ = ms;
     }
 }
 
 uint64_t FdCtx::getTimeout(int type) {
-    if(type == SO_RCVTIMEO) {
-        return recvTimeout_;
-    } else {
-        return sendTimeout_;
-    }
+    uint32_t ms = type == SO_RCVTIMEO ? recvTimeout_ : sendTimeout_;
+    return ms == UINT32_MAX ? (uint64_t)-1 : ms;
 }
 
 FdManager::FdManager() {
-    datas_.resize(64);
 }
 
-FdCtx::FdCtxRef FdManager::get(int fd, bool auto_create) {
-    if(fd == -1) {
-        return nullptr;
-    }
-    {
-        std::shared_lock lock(mutex_);
-        if((int)datas_.size() > fd && datas_[fd]) {
-            return datas_[fd];
-        }
+FdCtx* FdManager::get(int fd, bool auto_create) {
+    FdCtx* ctx = datas_.get(fd);
+    if(ctx && ctx->isActive()) {
+        return ctx;
     }
     if(auto_create == false) {
         return nullptr;
     }
+    ctx = datas_.getOrCreate(fd);
+    if(!ctx) {
+        return nullptr;
+    }
     std::unique_lock lock(mutex_);
-    if(fd >= (int)datas_.size()) {
-        datas_.resize(fd * 1.5);
+    if(!ctx->isActive()) {
+        ctx->init();
     }
-    datas_[fd] = std::make_shared<FdCtx>(fd);
-    return datas_[fd];
+    return ctx;
+}
+
+FdCtx* FdManager::getRecord(int fd, bool auto_create) {
+    return auto_create ? datas_.getOrCreate(fd) : datas_.get(fd);
 }
 
 void FdManager::del(int fd) {
-    std::unique_lock lock(mutex_);
-    if((int)datas_.size() <= fd) {
+    FdCtx* ctx = datas_.get(fd);
+    if(!ctx) {
         return;
     }
-    datas_[fd].reset();
+    std::unique_lock lock(mutex_);
+    ctx->active_.store(false, std::memory_order_release);
 }
 
-}
\ No newline at end of file
+}
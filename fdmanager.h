@@ -1,22 +1,31 @@
 #pragma once
 
-#include <memory>
-#include <vector>
-#include <shared_mutex>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include "fdtable.h"
+#include "mutex.h"
 #include "singleton.h"
 
 namespace fisher {
 
+struct IoWaiter;
+struct UringWait;
+
 /**
  * @brief 文件句柄上下文类
- * @details 管理文件句柄类型(是否socket)
- *          是否阻塞,是否关闭,读/写超时时间
+ * @details 每个句柄一条记录,正好占一个缓存行。前半部分由hook和FdManager管理:
+ *          文件句柄类型(是否socket、普通文件),系统和用户的非阻塞状态,是否关闭,读/写超时时间;
+ *          后半部分由IOManager在mutex_保护下管理:等待的事件和等待者、epoll注册状态、
+ *          io_uring请求。每个方向的等待者和io_uring请求都是由等待方提供的节点组成的链表,
+ *          这里只保存链表头
  */
-class FdCtx : public std::enable_shared_from_this<FdCtx> {
+class alignas(64) FdCtx {
+friend class FdManager;
+friend class IOManager;
 public:
-    using FdCtxRef = std::shared_ptr<FdCtx>;
     /**
-     * @brief 通过文件句柄构造FdCtx
+     * @brief 通过文件句柄构造FdCtx,由FdManager在get时初始化
      */
     FdCtx(int fd);
     /**
@@ -34,6 +43,11 @@ public:
      */
     bool isSocket() const { return isSocket_;}
 
+    /**
+     * @brief 是否普通文件
+     */
+    bool isFile() const { return isFile_;}
+
     /**
      * @brief 是否已关闭
      */
@@ -41,19 +55,32 @@ public:
 
     /**
      * @brief 设置系统非阻塞
-     * @param[in] v 是否阻塞
+     * @details socket在内核中总是非阻塞的,由hook挂起协程模拟阻塞
+     * @param[in] v 是否非阻塞
      */
-    void setNonblock(bool v) { nonblock_ = v;}
+    void setSysNonblock(bool v) { sysNonblock_ = v;}
 
     /**
      * @brief 获取系统非阻塞
      */
-    bool getNonblock() const { return nonblock_;}
+    bool getSysNonblock() const { return sysNonblock_;}
+
+    /**
+     * @brief 设置用户非阻塞
+     * @details 用户通过fcntl/ioctl看到和设置的状态,为true时hook不挂起协程,直接返回EAGAIN
+     * @param[in] v 是否非阻塞
+     */
+    void setUserNonblock(bool v) { userNonblock_ = v;}
+
+    /**
+     * @brief 获取用户非阻塞
+     */
+    bool getUserNonblock() const { return userNonblock_;}
 
     /**
      * @brief 设置超时时间
      * @param[in] type 类型SO_RCVTIMEO(读超时), SO_SNDTIMEO(写超时)
-     * @param[in] v 时间毫秒
+     * @param[in] v 时间毫秒,超过32位的按不超时处理
      */
     void setTimeout(int type, uint64_t v);
 
@@ -68,23 +95,56 @@ private:
      * @brief 初始化
      */
     bool init();
+
+    /**
+     * @brief 是否对应一个打开的句柄
+     */
+    bool isActive() const { return active_.load(std::memory_order_acquire);}
 private:
+    /// IOManager的锁,保护之后的IO状态
+    SpinLock mutex_;
+    /// 是否对应一个打开的句柄,del之后为false,句柄复用时重新初始化
+    std::atomic<bool> active_ = {false};
     /// 是否初始化
     bool isInit_: 1;
     /// 是否socket
     bool isSocket_: 1;
-    /// 是否hook非阻塞
-    bool nonblock_: 1;
+    /// 是否普通文件
+    bool isFile_: 1;
+    /// 内核中是否非阻塞
+    bool sysNonblock_: 1;
+    /// 用户是否设置了非阻塞
+    bool userNonblock_: 1;
     /// 是否关闭
     bool isClosed_: 1;
+    /// PERSISTENT模式下是否已经注册到epoll
+    bool registered_ = false;
+    /// 当前等待的事件(IOManager::Event)
+    uint8_t events_ = 0;
+    /// PERSISTENT模式下没有等待者时到达的就绪事件
+    uint8_t ready_ = 0;
     /// 文件句柄
     int fd_;
-    /// 读超时时间毫秒
-    uint64_t recvTimeout_;
-    /// 写超时时间毫秒
-    uint64_t sendTimeout_;
+    /// 分片模式下注册所在的工作线程下标,-1表示共享的epoll
+    int shard_ = -1;
+    /// 状态所属的IOManager编号,0表示没有
+    uint32_t owner_ = 0;
+    /// 读超时时间毫秒,UINT32_MAX表示不超时
+    uint32_t recvTimeout_;
+    /// 写超时时间毫秒,UINT32_MAX表示不超时
+    uint32_t sendTimeout_;
+    /// 等待读事件的节点
+    IoWaiter* readers_ = nullptr;
+    /// 等待写事件的节点
+    IoWaiter* writers_ = nullptr;
+    /// 正在进行的io_uring读请求链表
+    UringWait* uringRead_ = nullptr;
+    /// 正在进行的io_uring写请求链表
+    UringWait* uringWrite_ = nullptr;
 };
 
+static_assert(sizeof(FdCtx) == 64, "FdCtx should fit in one cache line");
+
 /**
  * @brief 文件句柄管理类
  */
@@ -97,11 +157,20 @@ public:
 
     /**
      * @brief 获取/创建文件句柄类FdCtx
+     * @details 查找不加锁,返回的指针在FdManager析构前一直有效
      * @param[in] fd 文件句柄
      * @param[in] auto_create 是否自动创建
-     * @return 返回对应文件句柄类FdCtx::ptr
+     * @return 返回对应文件句柄类FdCtx,不存在返回nullptr
+     */
+    FdCtx* get(int fd, bool auto_create = false);
+
+    /**
+     * @brief 返回fd对应的记录,不检查句柄是否打开,供IOManager保存IO状态
+     * @param[in] fd 文件句柄
+     * @param[in] auto_create 记录所在的块不存在时是否分配
+     * @return 句柄越界返回nullptr
      */
-    FdCtx::FdCtxRef get(int fd, bool auto_create = false);
+    FdCtx* getRecord(int fd, bool auto_create = true);
 
     /**
      * @brief 删除文件句柄类
@@ -109,10 +178,10 @@ public:
      */
     void del(int fd);
 private:
-    /// 读写锁
-    std::shared_mutex mutex_;
+    /// 创建和删除时的互斥锁
+    std::mutex mutex_;
     /// 文件句柄集合
-    std::vector<FdCtx::FdCtxRef> datas_;
+    FdTable<FdCtx> datas_;
 };
 
 /// 文件句柄单例
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stddef.h>
+
+namespace fisher {
+
+/**
+ * @brief 按文件句柄索引的两级表
+ * @details 第一级是固定大小的块指针数组,第二级是按需分配的块,每块CHUNK_SIZE个元素。
+ *          块分配之后直到表析构都不会移动或释放,返回的指针一直有效,
+ *          查找只有两次原子读,不加锁也没有引用计数;扩容时只用CAS发布新块,不阻塞查找。
+ *          元素需要提供T(int fd)构造函数,表中的每个句柄始终对应同一个元素,
+ *          句柄关闭后由使用者重置元素的状态
+ */
+template<class T>
+class FdTable {
+public:
+    /// 每块元素数量的位数
+    static const int CHUNK_BITS = 8;
+    /// 每块元素数量
+    static const int CHUNK_SIZE = 1 << CHUNK_BITS;
+    /// 块的数量
+    static const int MAX_CHUNKS = 1 << 14;
+    /// 支持的文件句柄上限(不含)
+    static const int MAX_FD = CHUNK_SIZE * MAX_CHUNKS;
+
+    /**
+     * @brief 构造函数
+     */
+    FdTable()
+        :chunks_(new std::atomic<T*>[MAX_CHUNKS]) {
+        for(int i = 0; i < MAX_CHUNKS; ++i) {
+            chunks_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 析构函数,释放所有元素
+     */
+    ~FdTable() {
+        for(int i = 0; i < MAX_CHUNKS; ++i) {
+            T* chunk = chunks_[i].load(std::memory_order_relaxed);
+            if(chunk) {
+                freeChunk(chunk);
+            }
+        }
+    }
+
+    FdTable(const FdTable&) = delete;
+    FdTable& operator=(const FdTable&) = delete;
+
+    /**
+     * @brief 返回fd对应的元素
+     * @return 句柄越界或所在的块还未分配返回nullptr
+     */
+    T* get(int fd) const {
+        if(fd < 0 || fd >= MAX_FD) {
+            return nullptr;
+        }
+        T* chunk = chunks_[fd >> CHUNK_BITS].load(std::memory_order_acquire);
+        return chunk ? &chunk[fd & (CHUNK_SIZE - 1)] : nullptr;
+    }
+
+    /**
+     * @brief 返回fd对应的元素,所在的块还未分配时分配
+     * @return 句柄越界返回nullptr
+     */
+    T* getOrCreate(int fd) {
+        if(fd < 0 || fd >= MAX_FD) {
+            return nullptr;
+        }
+        std::atomic<T*>& slot = chunks_[fd >> CHUNK_BITS];
+        T* chunk = slot.load(std::memory_order_acquire);
+        if(!chunk) {
+            T* fresh = allocChunk(fd & ~(CHUNK_SIZE - 1));
+            if(slot.compare_exchange_strong(chunk, fresh
+                        ,std::memory_order_acq_rel, std::memory_order_acquire)) {
+                chunk = fresh;
+            } else {
+                // 其他线程先分配了这一块
+                freeChunk(fresh);
+            }
+        }
+        return &chunk[fd & (CHUNK_SIZE - 1)];
+    }
+
+private:
+    /**
+     * @brief 分配一块并构造其中的元素
+     * @param[in] base 块中第一个元素对应的句柄
+     */
+    static T* allocChunk(int base) {
+        T* chunk = static_cast<T*>(::operator new(sizeof(T) * CHUNK_SIZE
+                                   ,std::align_val_t(alignof(T))));
+        for(int i = 0; i < CHUNK_SIZE; ++i) {
+            new (&chunk[i]) T(base + i);
+        }
+        return chunk;
+    }
+
+    /**
+     * @brief 析构块中的元素并释放
+     */
+    static void freeChunk(T* chunk) {
+        for(int i = 0; i < CHUNK_SIZE; ++i) {
+            chunk[i].~T();
+        }
+        ::operator delete(chunk, std::align_val_t(alignof(T)));
+    }
+private:
+    /// 块指针数组,大小固定为MAX_CHUNKS
+    std::unique_ptr<std::atomic<T*>[]> chunks_;
+};
+
+}
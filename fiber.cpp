@@ -6,6 +6,7 @@
 // #include "macro.h"
 #include "log.h"
 #include "scheduler.h"
+#include "stackallocator.h"
 
 namespace fisher {
 
@@ -16,23 +17,10 @@ static std::atomic<uint64_t> s_fiber_count {0};
 
 static thread_local Fiber::FiberRef t_fiber = nullptr; // this fiber
 
-uint32_t g_fiber_stack_size = SIGSTKSZ;
+uint32_t g_fiber_stack_size = 128 * 1024;
 // static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
 //     Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
-class MallocStackAllocator {
-public:
-    static void* Alloc(size_t size) {
-        return malloc(size);
-    }
-
-    static void Dealloc(void* vp, size_t size) {
-        return free(vp);
-    }
-};
-
-using StackAllocator = MallocStackAllocator;
-
 uint64_t Fiber::GetFiberId() {
     if (t_fiber) {
         return t_fiber->getId();
@@ -42,11 +30,6 @@ uint64_t Fiber::GetFiberId() {
 
 Fiber::Fiber() {
     state_ = State::EXEC;
-    if(getcontext(&ctx_)) {
-        // SYLAR_ASSERT2(false, "getcontext");
-        assert(false);
-    }
-
     ++s_fiber_count;
     FISHER_LOG_DEBUG(g_logger) << "Fiber::Fiber main";
 }
@@ -54,16 +37,12 @@ Fiber::Fiber() {
 Fiber::Fiber(std::function<void()> cb, size_t stacksize)
     :fid_(++s_fiber_id), cb_(cb) {
     ++s_fiber_count;
-    stacksize_ = stacksize ? stacksize : g_fiber_stack_size;
+    stacksize_ = StackAllocator::RoundUp(stacksize ? stacksize : g_fiber_stack_size);
     stack_ = StackAllocator::Alloc(stacksize_);
-    if(getcontext(&ctx_)) {
-        // SYLAR_ASSERT2(false, "getcontext");
-        assert(false);
+    if(!stack_) {
+        throw std::bad_alloc();
     }
-    ctx_.uc_link = nullptr;
-    ctx_.uc_stack.ss_sp = stack_;
-    ctx_.uc_stack.ss_size = stacksize_;
-    makecontext(&ctx_, &Fiber::MainFunc, 0);
+    ctx_.make(stack_, stacksize_, &Fiber::MainFunc);
     FISHER_LOG_DEBUG(g_logger) << "Fiber::Fiber id=" << fid_;
 }
 
@@ -83,17 +62,9 @@ Fiber::~Fiber() {
 void Fiber::reset(std::function<void()> cb) {
     assert(stack_);
     assert(state_ == TERM || state_ == EXCEPT || state_ == INIT);
-    cb_ = cb;
-    if(getcontext(&ctx_)) {
-        assert(false);
-        // SYLAR_ASSERT2(false, "getcontext");
-    }
-
-    ctx_.uc_link = nullptr;
-    ctx_.uc_stack.ss_sp = stack_;
-    ctx_.uc_stack.ss_size = stacksize_;
-
-    makecontext(&ctx_, &Fiber::MainFunc, 0);
+    cb_ = std::move(cb);
+    exception_ = nullptr;
+    ctx_.make(stack_, stacksize_, &Fiber::MainFunc);
     state_ = INIT;
 }
 
@@ -102,19 +73,13 @@ void Fiber::reset(std::function<void()> cb) {
 void Fiber::call() {
     SetThis(this->shared_from_this());
     state_ = EXEC;
-    if(swapcontext(&Scheduler::GetMainFiber()->ctx_, &ctx_)) {
-        // SYLAR_ASSERT2(false, "swapcontext");
-        std::cout << "call fiber failed" << std::endl;
-    }
+    Context::Swap(Scheduler::GetMainFiber()->ctx_, ctx_);
 }
 
 //切换到后台执行
 void Fiber::yeild() {
     SetThis(Scheduler::GetMainFiber());
-    if(swapcontext(&ctx_, &Scheduler::GetMainFiber()->ctx_)) {
-        // SYLAR_ASSERT2(false, "swapcontext");
-        std::cout << "yeild failed" << std::endl;
-    }
+    Context::Swap(ctx_, Scheduler::GetMainFiber()->ctx_);
 }
 
 void Fiber::SetThis(FiberRef f) { 
@@ -131,19 +96,58 @@ uint64_t Fiber::TotalFibers() {
 }
 
 void Fiber::MainFunc() {
+    // 协程执行期间可能迁移到其他线程,之后使用cur而不再读取线程局部的t_fiber
+    Fiber* cur = t_fiber.get();
+    State state = TERM;
     try {
-        t_fiber->cb_();
-        t_fiber->cb_ = nullptr;
-        t_fiber->state_ = TERM;
+        cur->cb_();
     } catch (std::exception& ex) {
-        t_fiber->state_ = EXCEPT;
+        state = EXCEPT;
+        cur->exception_ = std::current_exception();
         FISHER_LOG_ERROR(g_logger) << "Fiber Except: " << ex.what()
-            << " fiber_id=" << t_fiber->getId()
+            << " fiber_id=" << cur->getId()
             << std::endl;
             //<< fisher::BacktraceToString();
+    } catch (...) {
+        state = EXCEPT;
+        cur->exception_ = std::current_exception();
+        FISHER_LOG_ERROR(g_logger) << "Fiber Except: unknown exception"
+            << " fiber_id=" << cur->getId()
+            << std::endl;
     }
-    t_fiber->yeild();
+    cur->cb_ = nullptr;
+    cur->finish(state);
+    cur->yeild();
     assert(false);
 }
 
+void Fiber::finish(State state) {
+    joinLock_.lock();
+    state_ = state;
+    FiberWaiter* w = joiners_.popAll();
+    joinLock_.unlock();
+    while(w) {
+        FiberWaiter* next = w->next;
+        w->wake();
+        w = next;
+    }
+}
+
+void Fiber::join() {
+    assert(this != t_fiber.get());
+    joinLock_.lock();
+    if(state_ != TERM && state_ != EXCEPT) {
+        FiberWaiter waiter;
+        Fiber* self = waiter.prepare();
+        joiners_.push(&waiter);
+        joinLock_.unlock();
+        self->yeild();
+    } else {
+        joinLock_.unlock();
+    }
+    if(exception_) {
+        std::rethrow_exception(exception_);
+    }
+}
+
 }
\ No newline at end of file
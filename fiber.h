@@ -1,8 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
 #include <functional>
-#include <ucontext.h>
+#include <exception>
+#include "context.h"
+#include "mutex.h"
 
 namespace fisher {
 
@@ -13,6 +16,7 @@ class Scheduler;
  */
 class Fiber : public std::enable_shared_from_this<Fiber> {
 friend class Scheduler;
+friend class FiberPool;
 public:
     using FiberRef = std::shared_ptr<Fiber>;
 
@@ -74,9 +78,11 @@ public:
     void yeild();
 
     /**
-     * @brief 将当前线程切换到执行状态
-     * @pre 执行的为当前线程的主协程
+     * @brief 等待协程结束
+     * @details 挂起当前协程直到该协程结束,协程因异常结束时重新抛出该异常。
+     *          只能在调度器的协程中调用,不能等待自身
      */
+    void join();
 
     /**
      * @brief 返回协程id
@@ -87,6 +93,17 @@ public:
      * @brief 返回协程状态
      */
     State getState() const { return state_;}
+
+    /**
+     * @brief 返回协程结束时抛出的异常,正常结束返回nullptr
+     */
+    std::exception_ptr getException() const { return exception_;}
+private:
+    /**
+     * @brief 设置结束状态并唤醒等待的协程
+     * @param[in] state TERM或EXCEPT
+     */
+    void finish(State state);
 public:
 
     /**
@@ -115,10 +132,22 @@ public:
 private:
     uint64_t fid_ = 0;
     uint32_t stacksize_ = 0;
-    State state_ = INIT;
-    ucontext_t ctx_;
+    /// 是否由FiberPool创建,结束后可以回收复用
+    bool pooled_ = false;
+    /// 执行中被唤醒时指定的恢复线程,切出后由执行它的线程按此调度
+    int wakeThread_ = -1;
+    std::atomic<State> state_ {INIT};
+    Context ctx_;
     void* stack_ = nullptr;
     std::function<void()> cb_;
+    /// 在调度队列中或等待IO事件时持有自身的引用,队列和fd上下文里只存裸指针
+    FiberRef self_;
+    /// 协程结束时抛出的异常
+    std::exception_ptr exception_;
+    /// 保护joiners_和结束状态的设置
+    SpinLock joinLock_;
+    /// 等待协程结束的协程
+    WaitQueue joiners_;
 };
 
 }
@@ -0,0 +1,127 @@
+#include "fiberpool.h"
+#include <atomic>
+#include <vector>
+#include "clock.h"
+
+namespace fisher {
+
+static std::atomic<uint64_t> s_created {0};
+static std::atomic<uint64_t> s_reused {0};
+static std::atomic<uint64_t> s_recycled {0};
+static std::atomic<uint64_t> s_released {0};
+static std::atomic<uint64_t> s_cached {0};
+static std::atomic<size_t> s_max_cached {256};
+static std::atomic<uint64_t> s_idle_timeout {1000};
+
+/**
+ * @brief 线程本地的协程缓存
+ */
+struct FiberCache {
+    ~FiberCache() {
+        s_released += fibers.size();
+        s_cached -= fibers.size();
+    }
+
+    /// 结束的协程,后进先出,最近使用的栈更可能还在缓存中
+    std::vector<Fiber::FiberRef> fibers;
+    /// 最近一次取出或放回的时间(毫秒)
+    uint64_t last_used = 0;
+};
+
+static thread_local FiberCache* t_cache = nullptr;
+static thread_local bool t_cache_destroyed = false;
+
+/**
+ * @brief 线程退出时销毁协程缓存
+ */
+struct FiberCacheHolder {
+    ~FiberCacheHolder() {
+        delete t_cache;
+        t_cache = nullptr;
+        t_cache_destroyed = true;
+    }
+};
+
+static FiberCache* GetCache() {
+    if(t_cache) {
+        return t_cache;
+    }
+    if(t_cache_destroyed) {
+        return nullptr;
+    }
+    static thread_local FiberCacheHolder s_holder;
+    t_cache = new FiberCache;
+    return t_cache;
+}
+
+Fiber::FiberRef FiberPool::Acquire(std::function<void()> cb) {
+    FiberCache* cache = GetCache();
+    if(cache && !cache->fibers.empty()) {
+        Fiber::FiberRef fiber = std::move(cache->fibers.back());
+        cache->fibers.pop_back();
+        cache->last_used = Clock::CachedMS(Clock::MONOTONIC);
+        --s_cached;
+        ++s_reused;
+        fiber->reset(std::move(cb));
+        return fiber;
+    }
+    ++s_created;
+    Fiber::FiberRef fiber = std::make_shared<Fiber>(std::move(cb));
+    fiber->pooled_ = true;
+    return fiber;
+}
+
+void FiberPool::Recycle(Fiber::FiberRef&& fiber) {
+    Fiber::FiberRef f = std::move(fiber);
+    // 弱引用无法检查,weak_from_this().expired()在f存活时恒为false,见头文件说明
+    if(!f->pooled_ || f.use_count() != 1
+            || (f->getState() != Fiber::TERM && f->getState() != Fiber::EXCEPT)) {
+        return;
+    }
+    FiberCache* cache = GetCache();
+    if(!cache || cache->fibers.size() >= s_max_cached) {
+        ++s_released;
+        return;
+    }
+    cache->fibers.push_back(std::move(f));
+    cache->last_used = Clock::CachedMS(Clock::MONOTONIC);
+    ++s_cached;
+    ++s_recycled;
+}
+
+void FiberPool::Shrink() {
+    FiberCache* cache = t_cache;
+    if(!cache || cache->fibers.empty()) {
+        return;
+    }
+    uint64_t now = Clock::CachedMS(Clock::MONOTONIC);
+    if(now - cache->last_used < s_idle_timeout) {
+        return;
+    }
+    // 保留最近放回的一半,下一次收缩重新计时
+    size_t n = (cache->fibers.size() + 1) / 2;
+    cache->fibers.erase(cache->fibers.begin(), cache->fibers.begin() + n);
+    cache->last_used = now;
+    s_cached -= n;
+    s_released += n;
+}
+
+void FiberPool::SetMaxCached(size_t v) {
+    s_max_cached = v;
+}
+
+void FiberPool::SetIdleTimeout(uint64_t ms) {
+    s_idle_timeout = ms;
+}
+
+FiberPool::Stats FiberPool::GetStats() {
+    Stats stats;
+    stats.created = s_created;
+    stats.reused = s_reused;
+    stats.recycled = s_recycled;
+    stats.released = s_released;
+    stats.cached = s_cached;
+    return stats;
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include "fiber.h"
+
+namespace fisher {
+
+/**
+ * @brief 协程对象池
+ * @details 调度器执行完的协程(连同栈和shared_ptr控制块)缓存在线程本地的空闲链表中,
+ *          调度回调函数时通过Fiber::reset复用,稳定状态下提交回调不需要分配内存。
+ *          只回收由Acquire创建且不再被其他地方引用的协程;
+ *          线程空闲超过一段时间后每次进入idle释放一半缓存
+ */
+class FiberPool {
+public:
+    /**
+     * @brief 对象池统计信息
+     */
+    struct Stats {
+        /// 缓存为空,新建协程的次数
+        uint64_t created = 0;
+        /// 复用缓存中协程的次数
+        uint64_t reused = 0;
+        /// 协程结束后放回缓存的次数
+        uint64_t recycled = 0;
+        /// 缓存已满、空闲收缩或线程退出时释放的协程数量
+        uint64_t released = 0;
+        /// 当前所有线程缓存的协程数量
+        uint64_t cached = 0;
+    };
+
+    /**
+     * @brief 取得执行cb的协程,优先复用当前线程缓存的协程
+     */
+    static Fiber::FiberRef Acquire(std::function<void()> cb);
+
+    /**
+     * @brief 回收结束的协程
+     * @details 协程不是由Acquire创建、还未结束或还有其他引用时直接释放引用。
+     *          只能通过use_count判断强引用,弱引用无法检查:weak_from_this在协程存活期间
+     *          总是未过期,标准库也不提供弱引用计数。因此不要长期持有协程的weak_ptr,
+     *          协程结束并回收后lock得到的是复用后执行其他回调的协程
+     */
+    static void Recycle(Fiber::FiberRef&& fiber);
+
+    /**
+     * @brief 线程空闲时调用,长时间未使用时释放一半缓存
+     */
+    static void Shrink();
+
+    /**
+     * @brief 设置每个线程最多缓存的协程数量
+     */
+    static void SetMaxCached(size_t v);
+
+    /**
+     * @brief 设置开始收缩缓存的空闲时间(毫秒)
+     */
+    static void SetIdleTimeout(uint64_t ms);
+
+    /**
+     * @brief 返回对象池统计信息
+     */
+    static Stats GetStats();
+};
+
+}
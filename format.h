@@ -68,14 +68,25 @@ public:
     }
 
     void format(std::ostream& os, LogEvent::LogEventRef event) override {
-        struct tm tm;
+        // 时间戳精度是秒,同一秒内复用上一次格式化的结果
+        static thread_local Cache t_cache;
         time_t time = event->getTime();
-        localtime_r(&time, &tm);
-        char buf[64];
-        strftime(buf, sizeof(buf), format_.c_str(), &tm);
-        os << buf;
+        if(t_cache.item != this || t_cache.time != time) {
+            struct tm tm;
+            localtime_r(&time, &tm);
+            strftime(t_cache.buf, sizeof(t_cache.buf), format_.c_str(), &tm);
+            t_cache.item = this;
+            t_cache.time = time;
+        }
+        os << t_cache.buf;
     }
 private:
+    /// 每个线程最近一次格式化的结果
+    struct Cache {
+        const DateTimeFormatItem* item = nullptr;
+        time_t time = 0;
+        char buf[64] = {};
+    };
     std::string format_;
 };
 
@@ -0,0 +1,40 @@
+#include "future.h"
+#include "fiber.h"
+
+namespace fisher {
+
+void FutureStateBase::wait() {
+    if(isReady()) {
+        return;
+    }
+    guard_.lock();
+    if(ready_.load(std::memory_order_relaxed)) {
+        guard_.unlock();
+        return;
+    }
+    FiberWaiter waiter;
+    Fiber* self = waiter.prepare();
+    waiters_.push(&waiter);
+    guard_.unlock();
+    self->yeild();
+}
+
+void FutureStateBase::setException(std::exception_ptr e) {
+    guard_.lock();
+    assert(!ready_.load(std::memory_order_relaxed));
+    exception_ = e;
+    complete();
+}
+
+void FutureStateBase::complete() {
+    ready_.store(true, std::memory_order_release);
+    FiberWaiter* w = waiters_.popAll();
+    guard_.unlock();
+    while(w) {
+        FiberWaiter* next = w->next;
+        w->wake();
+        w = next;
+    }
+}
+
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <assert.h>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include "mutex.h"
+#include "scheduler.h"
+
+namespace fisher {
+
+/**
+ * @brief Future和Promise共享的状态中与值类型无关的部分
+ */
+class FutureStateBase {
+public:
+    /**
+     * @brief 是否已经设置值或异常
+     */
+    bool isReady() const { return ready_.load(std::memory_order_acquire);}
+
+    /**
+     * @brief 挂起当前协程直到设置值或异常
+     */
+    void wait();
+
+    /**
+     * @brief 设置异常
+     */
+    void setException(std::exception_ptr e);
+
+    /**
+     * @brief 返回设置的异常
+     */
+    std::exception_ptr getException() const { return exception_;}
+protected:
+    /**
+     * @brief 标记完成并唤醒等待的协程
+     * @pre 持有guard_,返回时已释放
+     */
+    void complete();
+protected:
+    /// 保护结果和等待队列
+    SpinLock guard_;
+    /// 是否已经设置值或异常
+    std::atomic<bool> ready_ = {false};
+    /// 设置的异常
+    std::exception_ptr exception_;
+    /// 等待结果的协程
+    WaitQueue waiters_;
+};
+
+/**
+ * @brief Future和Promise共享的状态
+ */
+template<class T>
+class FutureState : public FutureStateBase {
+public:
+    /**
+     * @brief 设置值
+     */
+    template<class... Args>
+    void setValue(Args&&... args) {
+        guard_.lock();
+        assert(!ready_.load(std::memory_order_relaxed));
+        value_.emplace(std::forward<Args>(args)...);
+        complete();
+    }
+
+    /**
+     * @brief 取走值
+     */
+    T take() { return std::move(*value_);}
+private:
+    std::optional<T> value_;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+public:
+    void setValue() {
+        guard_.lock();
+        assert(!ready_.load(std::memory_order_relaxed));
+        complete();
+    }
+
+    void take() {}
+};
+
+/**
+ * @brief 异步结果
+ * @details 等待时只挂起当前协程。get只能调用一次,之后Future不再有效。
+ *          只能在调度器的协程中等待
+ */
+template<class T>
+class Future {
+template<class U> friend class Promise;
+public:
+    Future() = default;
+
+    /**
+     * @brief 是否关联了结果
+     */
+    bool valid() const { return !!state_;}
+
+    /**
+     * @brief 结果是否已经就绪
+     */
+    bool isReady() const { return state_ && state_->isReady();}
+
+    /**
+     * @brief 挂起当前协程直到结果就绪
+     */
+    void wait() {
+        assert(state_);
+        state_->wait();
+    }
+
+    /**
+     * @brief 等待并取走结果,Promise设置了异常时重新抛出
+     */
+    T get() {
+        wait();
+        std::shared_ptr<FutureState<T> > state = std::move(state_);
+        if(state->getException()) {
+            std::rethrow_exception(state->getException());
+        }
+        return state->take();
+    }
+private:
+    explicit Future(std::shared_ptr<FutureState<T> > state)
+        :state_(std::move(state)) {}
+private:
+    std::shared_ptr<FutureState<T> > state_;
+};
+
+/**
+ * @brief 设置异步结果的一端
+ * @details 值和异常只能设置一次。析构时还未设置结果,Future会得到broken_promise异常
+ */
+template<class T>
+class Promise {
+public:
+    Promise()
+        :state_(std::make_shared<FutureState<T> >()) {}
+
+    ~Promise() {
+        if(state_ && !state_->isReady()) {
+            state_->setException(std::make_exception_ptr(
+                        std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+    Promise(Promise&&) = default;
+    Promise& operator=(Promise&&) = default;
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    /**
+     * @brief 返回关联的Future
+     */
+    Future<T> getFuture() { return Future<T>(state_);}
+
+    /**
+     * @brief 设置值并唤醒等待的协程
+     */
+    template<class... Args>
+    void setValue(Args&&... args) {
+        state_->setValue(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief 设置异常并唤醒等待的协程
+     */
+    void setException(std::exception_ptr e) {
+        state_->setException(e);
+    }
+private:
+    std::shared_ptr<FutureState<T> > state_;
+};
+
+/**
+ * @brief 在调度器中执行cb,返回其结果
+ * @details cb作为回调调度,与TaskGroup的任务一样不一定有自己的协程
+ * @param[in] scheduler 调度器
+ * @param[in] cb 执行的函数,需要可以拷贝
+ * @param[in] thread 指定执行的线程,-1为不指定
+ */
+template<class F, class R = std::invoke_result_t<F> >
+Future<R> Async(Scheduler* scheduler, F cb, int thread = -1) {
+    auto promise = std::make_shared<Promise<R> >();
+    Future<R> future = promise->getFuture();
+    scheduler->schedule(std::function<void()>([promise, cb]() mutable {
+        try {
+            if constexpr(std::is_void_v<R>) {
+                cb();
+                promise->setValue();
+            } else {
+                promise->setValue(cb());
+            }
+        } catch (...) {
+            promise->setException(std::current_exception());
+        }
+    }), thread);
+    return future;
+}
+
+}
@@ -1,10 +1,19 @@
 #include "hook.h"
+#include <algorithm>
+#include <vector>
 #include <dlfcn.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <string.h>
 
 #include "log.h"
 #include "fiber.h"
 #include "iomanager.h"
 #include "fdmanager.h"
+#include "util.h"
+#include "uring.h"
+#include "clock.h"
+#include "diskio.h"
 // #include "macro.h"
 
 static fisher::Logger::LoggerRef g_logger = FISHER_LOG_NAME("system");
@@ -18,20 +27,31 @@ static thread_local bool t_hook_enable = false;
 
 #define HOOK_FUN(XX) \
     XX(sleep) \
+    XX(usleep) \
+    XX(nanosleep) \
+    XX(clock_nanosleep) \
     XX(socket) \
     XX(connect) \
     XX(accept) \
     XX(read) \
     XX(readv) \
+    XX(pread) \
     XX(recv) \
     XX(recvfrom) \
     XX(recvmsg) \
     XX(write) \
     XX(writev) \
+    XX(pwrite) \
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(open) \
+    XX(fsync) \
     XX(close) \
+    XX(fcntl) \
+    XX(ioctl) \
+    XX(poll) \
+    XX(select) \
     XX(getsockopt) \
     XX(setsockopt)
 
@@ -69,19 +89,151 @@ void set_hook_enable(bool flag) {
     t_hook_enable = flag;
 }
 
+static void OnSleepTimeout(void* arg) {
+    ((FiberWaiter*)arg)->wake();
+}
+
+void sleep_for_us(uint64_t us) {
+    IOManager* iom = IOManager::GetThis();
+    if(!iom) {
+        timespec ts = {(time_t)(us / 1000000), (long)(us % 1000000 * 1000)};
+        while(nanosleep_f(&ts, &ts) == -1 && errno == EINTR);
+        return;
+    }
+    if(!us) {
+        return;
+    }
+    // 定时器和等待者都在协程栈上,唤醒之前协程不会返回
+    FiberWaiter waiter;
+    Fiber* self = waiter.prepare();
+    TimerHandle timer(&OnSleepTimeout, &waiter);
+    iom->addTimer(timer, (us + 999) / 1000);
+    self->yeild();
+}
+
+}
+
+/**
+ * @brief hook的poll/select等待的状态
+ * @details 每个fd的每个事件挂一个等待节点,节点的回调和超时定时器中只有第一个唤醒协程。
+ *          回调在fd的锁内执行,协程返回前逐个摘下节点,摘下时进行中的回调已经结束,
+ *          所以状态可以放在协程栈上
+ */
+struct poll_state {
+    /// 是否已经唤醒
+    std::atomic<bool> fired {false};
+    /// 等待的协程
+    fisher::FiberWaiter waiter;
+};
+
+/**
+ * @brief poll等待的一个fd事件
+ */
+struct poll_entry {
+    fisher::IoWaiter waiter;
+    int fd = -1;
+    fisher::IOManager::Event event = fisher::IOManager::NONE;
+};
+
+/// 栈上的poll_entry数量,超过时才分配
+static const size_t s_poll_inline = 16;
+
+static void poll_wake(void* arg) {
+    poll_state* state = (poll_state*)arg;
+    if(!state->fired.exchange(true)) {
+        state->waiter.wake();
+    }
+}
+
+/**
+ * @brief 在IOManager中挂起当前协程,直到fds中任意一个fd可能就绪或超时
+ * @details 被唤醒不代表fd一定就绪,调用方需要再次检查。
+ *          同一fd的事件可以同时被其他协程(如阻塞在recv中的协程)等待,就绪时一起唤醒。
+ *          注册失败的fd不等待;没有可等待的事件且不超时时永远挂起
+ * @param[in] timeout_ms 超时时间毫秒,-1表示不超时
+ */
+static void wait_fds(fisher::IOManager* iom, const struct pollfd* fds, nfds_t nfds, uint64_t timeout_ms) {
+    poll_entry local[s_poll_inline];
+    std::unique_ptr<poll_entry[]> heap;
+    poll_entry* entries = local;
+    if(nfds * 2 > s_poll_inline) {
+        heap.reset(new poll_entry[nfds * 2]);
+        entries = heap.get();
+    }
+
+    poll_state state;
+    fisher::Fiber* self = state.waiter.prepare();
+    size_t added = 0;
+    for(nfds_t i = 0; i < nfds; ++i) {
+        if(fds[i].fd < 0) {
+            continue;
+        }
+        bool read = fds[i].events & (POLLIN | POLLPRI | POLLRDNORM | POLLRDBAND);
+        bool write = fds[i].events & (POLLOUT | POLLWRNORM | POLLWRBAND);
+        for(fisher::IOManager::Event e : {fisher::IOManager::READ, fisher::IOManager::WRITE}) {
+            if(!(e == fisher::IOManager::READ ? read : write)) {
+                continue;
+            }
+            poll_entry& entry = entries[added];
+            entry.waiter.cb = &poll_wake;
+            entry.waiter.arg = &state;
+            entry.fd = fds[i].fd;
+            entry.event = e;
+            if(iom->addEvent(entry.fd, e, &entry.waiter) == 0) {
+                ++added;
+            }
+        }
+    }
+
+    fisher::TimerHandle timer(&poll_wake, &state);
+    if(timeout_ms != (uint64_t)-1) {
+        iom->addTimer(timer, timeout_ms);
+    }
+    self->yeild();
+    timer.cancel();
+    for(size_t i = 0; i < added; ++i) {
+        iom->delEvent(entries[i].fd, entries[i].event, &entries[i].waiter);
+    }
+}
+
+/**
+ * @brief 校验nanosleep系列函数的时间参数
+ */
+static bool valid_timespec(const struct timespec* ts) {
+    return ts && ts->tv_sec >= 0 && ts->tv_nsec >= 0 && ts->tv_nsec < 1000000000;
+}
+
+/**
+ * @brief 时间间隔转换为微秒,不足1微秒向上取整
+ */
+static uint64_t timespec_to_us(time_t sec, long nsec) {
+    return (uint64_t)sec * 1000000 + (nsec + 999) / 1000;
 }
 
 struct timer_info {
     int cancelled = 0;
+    fisher::IOManager* iom = nullptr;
+    int fd = -1;
+    fisher::IOManager::Event event = fisher::IOManager::NONE;
+    /// 协程的等待节点,超时只取消它,不影响同一事件的其他等待者
+    fisher::IoWaiter waiter;
 };
 
+static void on_io_timeout(void* arg) {
+    timer_info* t = (timer_info*)arg;
+    // 事件已经触发时协程会重试IO,不算超时
+    if(t->iom->cancelEvent(t->fd, t->event, &t->waiter)) {
+        t->cancelled = ETIMEDOUT;
+    }
+}
+
 template<typename OriginFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
         uint32_t event, int timeout_so, Args&&... args) {
     if(!fisher::t_hook_enable) {
         return fun(fd, std::forward<Args>(args)...);
     }
-    fisher::FdCtx::FdCtxRef ctx = fisher::FdMgr::getInstance().get(fd);
+    fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(fd);
     if(!ctx) {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -91,65 +243,129 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
         return -1;
     }
 
-    if(!ctx->isSocket() || ctx->getNonblock()) {
+    fisher::IOManager* iom = fisher::IOManager::GetThis();
+    if(!iom || !ctx->isSocket() || ctx->getUserNonblock()) {
         return fun(fd, std::forward<Args>(args)...);
     }
 
     uint64_t to = ctx->getTimeout(timeout_so);
-    std::shared_ptr<timer_info> tinfo(new timer_info);
+    // 超时定时器和等待节点放在栈上,不分配内存
+    timer_info tinfo;
+    tinfo.iom = iom;
+    tinfo.fd = fd;
+    tinfo.event = (fisher::IOManager::Event)(event);
+    fisher::TimerHandle timer(&on_io_timeout, &tinfo);
 
     ssize_t n = fun(fd, std::forward<Args>(args)...);
     while (n == -1) {
-        if (errno == EINTR) {
+        if (fisher::GetErrno() == EINTR) {
             n = fun(fd, std::forward<Args>(args)...);
             continue;
         }
-        if (n == -1 && errno == EAGAIN) {
-            fisher::IOManager* iom = fisher::IOManager::GetThis();
-            fisher::Timer::TimerRef timer;
-            std::weak_ptr<timer_info> winfo(tinfo);
-
-            if(to != (uint64_t)-1) {
-                timer = iom->addConditionTimer(to, [winfo, fd, iom, event]() {
-                    auto t = winfo.lock();
-                    if(!t || t->cancelled) {
-                        return;
-                    }
-                    t->cancelled = ETIMEDOUT;
-                    iom->cancelEvent(fd, (fisher::IOManager::Event)(event));
-                }, winfo);
-            }
-
-            int rt = iom->addEvent(fd, (fisher::IOManager::Event)(event));
+        if (n == -1 && fisher::GetErrno() == EAGAIN) {
+            int rt = iom->addEvent(fd, tinfo.event, &tinfo.waiter);
             if(rt) {
                 // error rt
                 FISHER_LOG_ERROR(g_logger) << hook_fun_name << " addEvent("
                     << fd << ", " << event << ")";
-                if(timer) {
-                    timer->cancel();
-                }
                 return -1;
-
-            } else {
-                fisher::Fiber::GetThis()->yeild();
-                if(timer) {
-                    timer->cancel();
-                }
-                if(tinfo->cancelled) {
-                    errno = tinfo->cancelled;
-                    return -1;
-                }
-                // try again
-                n = fun(fd, std::forward<Args>(args)...);
             }
+            // 节点挂上之后再计时,超时时一定能找到它
+            if(to != (uint64_t)-1) {
+                iom->addTimer(timer, to);
+            }
+            fisher::Fiber::GetThis()->yeild();
+            timer.cancel();
+            if(tinfo.cancelled) {
+                fisher::SetErrno(tinfo.cancelled);
+                return -1;
+            }
+            // try again
+            n = fun(fd, std::forward<Args>(args)...);
         // n >= 0
         } else {
             break;
         }
     }
+    timer.cancel();
     return n;
 }
 
+static io_uring_sqe make_sqe(uint8_t opcode, int fd, const void* addr, size_t len
+                             ,uint64_t off, uint32_t flags) {
+    io_uring_sqe sqe;
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = fd;
+    sqe.addr = (uint64_t)addr;
+    sqe.len = len > INT_MAX ? INT_MAX : len;
+    sqe.off = off;
+    sqe.msg_flags = flags;
+    return sqe;
+}
+
+/**
+ * @brief IOManager启用io_uring时,阻塞语义的socket IO
+ * @details 先直接调用非阻塞的原始函数,数据已就绪时不经过ring;返回EAGAIN时才提交请求挂起
+ * @param[in] sqe 请求
+ * @param[in] event 事件类型
+ * @param[in] timeout_so 超时类型SO_RCVTIMEO/SO_SNDTIMEO
+ * @param[in] fun 原始调用
+ * @param[out] n IO结果
+ * @return 条件不满足(未hook,非工作线程,非socket或用户设置了非阻塞)时返回false,
+ *         由调用方走do_io
+ */
+template<typename Fun>
+static bool do_uring(const io_uring_sqe& sqe, uint32_t event, int timeout_so, Fun&& fun, ssize_t& n) {
+    if(!fisher::t_hook_enable) {
+        return false;
+    }
+    fisher::IOManager* iom = fisher::IOManager::GetThis();
+    if(!iom || !iom->hasUring()) {
+        return false;
+    }
+    fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(sqe.fd);
+    if(!ctx || ctx->isClose() || !ctx->isSocket() || ctx->getUserNonblock()) {
+        return false;
+    }
+    do {
+        n = fun();
+    } while(n == -1 && errno == EINTR);
+    if(n != -1 || errno != EAGAIN) {
+        return true;
+    }
+    n = iom->submitIo(sqe, (fisher::IOManager::Event)event, ctx->getTimeout(timeout_so));
+    return true;
+}
+
+/**
+ * @brief 普通文件的阻塞IO,挂起当前协程直到完成
+ * @details IOManager启用io_uring时提交到本线程的ring,否则交给磁盘IO线程池
+ * @param[in] fd 文件句柄,-1表示不需要检查句柄(如open)
+ * @param[in] sqe 对应的io_uring请求
+ * @param[in] fun 在线程池中执行的原始调用
+ * @param[out] n IO结果
+ * @return 未hook、不在调度器中或fd不是普通文件时返回false,由调用方直接调用
+ */
+template<typename Fun>
+static bool do_file(int fd, const io_uring_sqe& sqe, Fun&& fun, ssize_t& n) {
+    if(!fisher::t_hook_enable || !fisher::Scheduler::GetThis()) {
+        return false;
+    }
+    if(fd != -1) {
+        fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(fd);
+        if(!ctx || ctx->isClose() || !ctx->isFile()) {
+            return false;
+        }
+    }
+    fisher::IOManager* iom = fisher::IOManager::GetThis();
+    if(iom && iom->hasUring()) {
+        n = iom->submitFileIo(sqe);
+    } else {
+        n = fisher::DiskIOMgr::getInstance().run(fun);
+    }
+    return true;
+}
 
 extern "C" {
 #define XX(name) name ## _fun name ## _f = nullptr;
@@ -161,12 +377,62 @@ unsigned int sleep(unsigned int seconds) {
         return sleep_f(seconds);
     }
 
-    fisher::Fiber::FiberRef fiber = fisher::Fiber::GetThis();
-    fisher::IOManager* iom = fisher::IOManager::GetThis();
-    iom->addTimer(seconds * 1000, std::bind((void(fisher::Scheduler::*)
-            (fisher::Fiber::FiberRef, int thread))&fisher::IOManager::schedule
-            ,iom, fiber, -1));
-    fiber->yeild();
+    fisher::sleep_for_us((uint64_t)seconds * 1000000);
+    return 0;
+}
+
+int usleep(useconds_t usec) {
+    if(!fisher::t_hook_enable || !fisher::IOManager::GetThis()) {
+        return usleep_f(usec);
+    }
+    // POSIX允许usec不小于1000000时返回EINVAL,协程中按此处理,超过1秒用nanosleep或sleep
+    if(usec >= 1000000) {
+        errno = EINVAL;
+        return -1;
+    }
+    fisher::sleep_for_us(usec);
+    return 0;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    if(!fisher::t_hook_enable || !fisher::IOManager::GetThis()) {
+        return nanosleep_f(req, rem);
+    }
+    if(!valid_timespec(req)) {
+        errno = req ? EINVAL : EFAULT;
+        return -1;
+    }
+    // 协程睡眠不会被信号中断,rem不需要填写
+    fisher::sleep_for_us(timespec_to_us(req->tv_sec, req->tv_nsec));
+    return 0;
+}
+
+int clock_nanosleep(clockid_t clockid, int flags, const struct timespec *req, struct timespec *rem) {
+    if(!fisher::t_hook_enable || !fisher::IOManager::GetThis()
+            || (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC
+                && clockid != CLOCK_BOOTTIME)) {
+        return clock_nanosleep_f(clockid, flags, req, rem);
+    }
+    if(!valid_timespec(req)) {
+        return req ? EINVAL : EFAULT;
+    }
+    if(!(flags & TIMER_ABSTIME)) {
+        fisher::sleep_for_us(timespec_to_us(req->tv_sec, req->tv_nsec));
+        return 0;
+    }
+    struct timespec now;
+    if(clock_gettime(clockid, &now)) {
+        return errno;
+    }
+    time_t sec = req->tv_sec - now.tv_sec;
+    long nsec = req->tv_nsec - now.tv_nsec;
+    if(nsec < 0) {
+        nsec += 1000000000;
+        --sec;
+    }
+    if(sec >= 0) {
+        fisher::sleep_for_us(timespec_to_us(sec, nsec));
+    }
     return 0;
 }
 
@@ -179,6 +445,10 @@ int socket(int domain, int type, int protocol) {
         return fd;
     }
     fisher::FdMgr::getInstance().get(fd, true);
+    fisher::IOManager* iom = fisher::IOManager::GetThis();
+    if(iom) {
+        iom->registerFd(fd);
+    }
     return fd;
 }
 
@@ -186,15 +456,24 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     if(!fisher::t_hook_enable) {
         return connect_f(fd, addr, addrlen);
     }
-    fisher::FdCtx::FdCtxRef ctx = fisher::FdMgr::getInstance().get(fd);
+    fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(fd);
     if(!ctx || ctx->isClose()) {
         errno = EBADF;
         return -1;
     }
 
-    if(!ctx->isSocket()) {
+    if(!ctx->isSocket() || ctx->getUserNonblock()) {
+        return connect_f(fd, addr, addrlen);
+    }
+
+    fisher::IOManager* iom = fisher::IOManager::GetThis();
+    if(!iom) {
         return connect_f(fd, addr, addrlen);
     }
+    if(iom->hasUring()) {
+        return iom->submitIo(make_sqe(IORING_OP_CONNECT, fd, addr, 0, addrlen, 0)
+                             ,fisher::IOManager::WRITE, timeout_ms);
+    }
 
     int n = connect_f(fd, addr, addrlen);
     if(n == 0) {
@@ -203,37 +482,24 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         return n;
     }
 
-    fisher::IOManager* iom = fisher::IOManager::GetThis();
-    fisher::Timer::TimerRef timer;
-    std::shared_ptr<timer_info> tinfo(new timer_info);
-    std::weak_ptr<timer_info> winfo(tinfo);
-
-    if(timeout_ms != (uint64_t)-1) {
-        timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]() {
-                auto t = winfo.lock();
-                // when back from main, the func exits, winfo is released, return directly
-                if(!t || t->cancelled) {
-                    return;
-                }
-                t->cancelled = ETIMEDOUT;
-                iom->cancelEvent(fd, fisher::IOManager::WRITE);
-        }, winfo);
-    }
-
-    int rt = iom->addEvent(fd, fisher::IOManager::WRITE);
+    timer_info tinfo;
+    tinfo.iom = iom;
+    tinfo.fd = fd;
+    tinfo.event = fisher::IOManager::WRITE;
+    fisher::TimerHandle timer(&on_io_timeout, &tinfo);
+    int rt = iom->addEvent(fd, fisher::IOManager::WRITE, &tinfo.waiter);
     if(rt == 0) {
-        fisher::Fiber::GetThis()->yeild();
-        if(timer) {
-            timer->cancel();
+        if(timeout_ms != (uint64_t)-1) {
+            iom->addTimer(timer, timeout_ms);
         }
-        if(tinfo->cancelled) {
-            errno = tinfo->cancelled;
+        fisher::Fiber::GetThis()->yeild();
+        timer.cancel();
+        if(tinfo.cancelled) {
+            fisher::SetErrno(tinfo.cancelled);
             return -1;
         }
     } else {
-        if(timer) {
-            timer->cancel();
-        }
+        timer.cancel();
         FISHER_LOG_ERROR(g_logger) << "connect addEvent(" << fd << ", WRITE) error";
     }
 
@@ -245,7 +511,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     if(!error) {
         return 0;
     } else {
-        errno = error;
+        fisher::SetErrno(error);
         return -1;
     }
 }
@@ -255,22 +521,62 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
-    int fd = do_io(s, accept_f, "accept", fisher::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    ssize_t n;
+    int fd;
+    if(do_uring(make_sqe(IORING_OP_ACCEPT, s, addr, 0, (uint64_t)addrlen, 0)
+                ,fisher::IOManager::READ, SO_RCVTIMEO
+                ,[&]() { return accept_f(s, addr, addrlen);}, n)) {
+        fd = n;
+    } else {
+        fd = do_io(s, accept_f, "accept", fisher::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    }
     if(fd >= 0) {
         fisher::FdMgr::getInstance().get(fd, true);
+        fisher::IOManager* iom = fisher::IOManager::GetThis();
+        if(iom) {
+            iom->registerFd(fd);
+        }
     }
     return fd;
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_READ, fd, buf, count, (uint64_t)-1, 0)
+               ,[&]() { return read_f(fd, buf, count);}, n)) {
+        return n;
+    }
+    if(do_uring(make_sqe(IORING_OP_RECV, fd, buf, count, 0, 0), fisher::IOManager::READ, SO_RCVTIMEO
+                ,[&]() { return read_f(fd, buf, count);}, n)) {
+        return n;
+    }
     return do_io(fd, read_f, "read", fisher::IOManager::READ, SO_RCVTIMEO, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_READV, fd, iov, iovcnt, (uint64_t)-1, 0)
+               ,[&]() { return readv_f(fd, iov, iovcnt);}, n)) {
+        return n;
+    }
     return do_io(fd, readv_f, "readv", fisher::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
 }
 
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_READ, fd, buf, count, offset, 0)
+               ,[&]() { return pread_f(fd, buf, count, offset);}, n)) {
+        return n;
+    }
+    return pread_f(fd, buf, count, offset);
+}
+
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+    ssize_t n;
+    if(do_uring(make_sqe(IORING_OP_RECV, sockfd, buf, len, 0, flags), fisher::IOManager::READ, SO_RCVTIMEO
+                ,[&]() { return recv_f(sockfd, buf, len, flags);}, n)) {
+        return n;
+    }
     return do_io(sockfd, recv_f, "recv", fisher::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
 }
 
@@ -283,14 +589,42 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_WRITE, fd, buf, count, (uint64_t)-1, 0)
+               ,[&]() { return write_f(fd, buf, count);}, n)) {
+        return n;
+    }
+    if(do_uring(make_sqe(IORING_OP_SEND, fd, buf, count, 0, 0), fisher::IOManager::WRITE, SO_SNDTIMEO
+                ,[&]() { return write_f(fd, buf, count);}, n)) {
+        return n;
+    }
     return do_io(fd, write_f, "write", fisher::IOManager::WRITE, SO_SNDTIMEO, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_WRITEV, fd, iov, iovcnt, (uint64_t)-1, 0)
+               ,[&]() { return writev_f(fd, iov, iovcnt);}, n)) {
+        return n;
+    }
     return do_io(fd, writev_f, "writev", fisher::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
 }
 
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_WRITE, fd, buf, count, offset, 0)
+               ,[&]() { return pwrite_f(fd, buf, count, offset);}, n)) {
+        return n;
+    }
+    return pwrite_f(fd, buf, count, offset);
+}
+
 ssize_t send(int s, const void *msg, size_t len, int flags) {
+    ssize_t n;
+    if(do_uring(make_sqe(IORING_OP_SEND, s, msg, len, 0, flags), fisher::IOManager::WRITE, SO_SNDTIMEO
+                ,[&]() { return send_f(s, msg, len, flags);}, n)) {
+        return n;
+    }
     return do_io(s, send_f, "send", fisher::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
 }
 
@@ -302,12 +636,42 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
     return do_io(s, sendmsg_f, "sendmsg", fisher::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+int open(const char *pathname, int flags, ...) {
+    mode_t mode = 0;
+    if((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+        va_list va;
+        va_start(va, flags);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+    ssize_t n;
+    io_uring_sqe sqe = make_sqe(IORING_OP_OPENAT, AT_FDCWD, pathname, mode, 0, 0);
+    sqe.open_flags = flags;
+    if(!do_file(-1, sqe, [&]() { return open_f(pathname, flags, mode);}, n)) {
+        return open_f(pathname, flags, mode);
+    }
+    if(n >= 0) {
+        // 之后的读写根据fd上下文判断是否为普通文件
+        fisher::FdMgr::getInstance().get(n, true);
+    }
+    return n;
+}
+
+int fsync(int fd) {
+    ssize_t n;
+    if(do_file(fd, make_sqe(IORING_OP_FSYNC, fd, nullptr, 0, 0, 0)
+               ,[&]() { return fsync_f(fd);}, n)) {
+        return n;
+    }
+    return fsync_f(fd);
+}
+
 int close(int fd) {
     if(!fisher::t_hook_enable) {
         return close_f(fd);
     }
 
-    fisher::FdCtx::FdCtxRef ctx = fisher::FdMgr::getInstance().get(fd);
+    fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(fd);
     if(ctx) {
         auto iom = fisher::IOManager::GetThis();
         if(iom) {
@@ -318,6 +682,168 @@ int close(int fd) {
     return close_f(fd);
 }
 
+int fcntl(int fd, int cmd, ... /* arg */ ) {
+    // 与glibc相同,按指针大小取出参数,整数参数也能原样传递
+    va_list va;
+    va_start(va, cmd);
+    void* arg = va_arg(va, void*);
+    va_end(va);
+
+    if(cmd != F_SETFL && cmd != F_GETFL) {
+        return fcntl_f(fd, cmd, arg);
+    }
+    fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(fd);
+    if(!ctx || ctx->isClose() || !ctx->isSocket()) {
+        return fcntl_f(fd, cmd, arg);
+    }
+    if(cmd == F_GETFL) {
+        int flags = fcntl_f(fd, cmd);
+        if(flags == -1) {
+            return flags;
+        }
+        // 返回用户设置的状态,而不是hook强制的O_NONBLOCK
+        return ctx->getUserNonblock() ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    }
+    int flags = (int)(intptr_t)arg;
+    ctx->setUserNonblock(flags & O_NONBLOCK);
+    if(ctx->getSysNonblock()) {
+        flags |= O_NONBLOCK;
+    } else {
+        flags &= ~O_NONBLOCK;
+    }
+    return fcntl_f(fd, cmd, flags);
+}
+
+int ioctl(int d, unsigned long int request, ...) {
+    va_list va;
+    va_start(va, request);
+    void* arg = va_arg(va, void*);
+    va_end(va);
+
+    if(request == FIONBIO && arg) {
+        fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(d);
+        if(ctx && !ctx->isClose() && ctx->isSocket()) {
+            // 内核中保持系统状态,只记录用户设置的状态
+            bool user_nonblock = !!*(int*)arg;
+            int on = ctx->getSysNonblock();
+            int rt = ioctl_f(d, request, &on);
+            if(rt == 0) {
+                ctx->setUserNonblock(user_nonblock);
+            }
+            return rt;
+        }
+    }
+    return ioctl_f(d, request, arg);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    fisher::IOManager* iom = fisher::IOManager::GetThis();
+    if(!fisher::t_hook_enable || !iom) {
+        return poll_f(fds, nfds, timeout);
+    }
+    if(!nfds && timeout >= 0) {
+        fisher::sleep_for_us((uint64_t)timeout * 1000);
+        return 0;
+    }
+    int rt = poll_f(fds, nfds, 0);
+    if(rt != 0 || timeout == 0) {
+        return rt;
+    }
+    uint64_t deadline = timeout < 0 ? (uint64_t)-1
+                        : fisher::Clock::NowMS(fisher::Clock::MONOTONIC) + timeout;
+    while(true) {
+        uint64_t wait = (uint64_t)-1;
+        if(deadline != (uint64_t)-1) {
+            uint64_t now = fisher::Clock::NowMS(fisher::Clock::MONOTONIC);
+            if(now >= deadline) {
+                return 0;
+            }
+            wait = deadline - now;
+        }
+        wait_fds(iom, fds, nfds, wait);
+        rt = poll_f(fds, nfds, 0);
+        if(rt != 0) {
+            return rt;
+        }
+    }
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+    if(!fisher::t_hook_enable || !fisher::IOManager::GetThis()) {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+    if(nfds < 0 || nfds > FD_SETSIZE
+            || (timeout && (timeout->tv_sec < 0 || timeout->tv_usec < 0))) {
+        errno = EINVAL;
+        return -1;
+    }
+    std::vector<struct pollfd> fds;
+    for(int fd = 0; fd < nfds; ++fd) {
+        short events = 0;
+        if(readfds && FD_ISSET(fd, readfds)) {
+            events |= POLLIN;
+        }
+        if(writefds && FD_ISSET(fd, writefds)) {
+            events |= POLLOUT;
+        }
+        if(exceptfds && FD_ISSET(fd, exceptfds)) {
+            events |= POLLPRI;
+        }
+        if(events) {
+            fds.push_back({fd, events, 0});
+        }
+    }
+    int timeout_ms = -1;
+    uint64_t start = 0;
+    if(timeout) {
+        uint64_t ms = (uint64_t)timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+        timeout_ms = ms > INT_MAX ? INT_MAX : ms;
+        start = fisher::Clock::NowMS(fisher::Clock::MONOTONIC);
+    }
+    int rt = poll(fds.data(), fds.size(), timeout_ms);
+    if(rt < 0) {
+        return rt;
+    }
+    if(timeout) {
+        // 与Linux一致,返回剩余的时间
+        uint64_t used = fisher::Clock::NowMS(fisher::Clock::MONOTONIC) - start;
+        uint64_t left = used < (uint64_t)timeout_ms ? timeout_ms - used : 0;
+        timeout->tv_sec = left / 1000;
+        timeout->tv_usec = left % 1000 * 1000;
+    }
+    for(auto& i : fds) {
+        if(i.revents & POLLNVAL) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+    rt = 0;
+    for(auto& i : fds) {
+        if(readfds) {
+            if(FD_ISSET(i.fd, readfds) && (i.revents & (POLLIN | POLLHUP | POLLERR))) {
+                ++rt;
+            } else {
+                FD_CLR(i.fd, readfds);
+            }
+        }
+        if(writefds) {
+            if(FD_ISSET(i.fd, writefds) && (i.revents & (POLLOUT | POLLERR))) {
+                ++rt;
+            } else {
+                FD_CLR(i.fd, writefds);
+            }
+        }
+        if(exceptfds) {
+            if(FD_ISSET(i.fd, exceptfds) && (i.revents & POLLPRI)) {
+                ++rt;
+            } else {
+                FD_CLR(i.fd, exceptfds);
+            }
+        }
+    }
+    return rt;
+}
+
 int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen) {
     return getsockopt_f(sockfd, level, optname, optval, optlen);
 }
@@ -328,7 +854,7 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
     }
     if(level == SOL_SOCKET) {
         if(optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) {
-            fisher::FdCtx::FdCtxRef ctx = fisher::FdMgr::getInstance().get(sockfd);
+            fisher::FdCtx* ctx = fisher::FdMgr::getInstance().get(sockfd);
             if(ctx) {
                 const timeval* v = (const timeval*)optval;
                 ctx->setTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
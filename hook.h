@@ -1,12 +1,15 @@
 #pragma once
 
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdint.h>
 #include <time.h>
 #include <unistd.h>
+#include <chrono>
 
 namespace fisher {
     /**
@@ -17,6 +20,23 @@ namespace fisher {
      * @brief 设置当前线程的hook状态
      */
     void set_hook_enable(bool flag);
+
+    /**
+     * @brief 挂起当前协程us微秒,由IOManager的定时器唤醒,不阻塞线程
+     * @details 定时器精度为毫秒,不足1毫秒向上取整;不在IOManager中时阻塞当前线程
+     */
+    void sleep_for_us(uint64_t us);
+
+    /**
+     * @brief 挂起当前协程指定的时间,见sleep_for_us
+     */
+    template<class Rep, class Period>
+    void sleep_for(const std::chrono::duration<Rep, Period>& d) {
+        if(d <= d.zero()) {
+            return;
+        }
+        sleep_for_us(std::chrono::ceil<std::chrono::microseconds>(d).count());
+    }
 }
 
 extern "C" {
@@ -25,6 +45,15 @@ extern "C" {
 using sleep_fun = unsigned int (*)(unsigned int seconds);
 extern sleep_fun sleep_f;
 
+using usleep_fun = int (*)(useconds_t usec);
+extern usleep_fun usleep_f;
+
+using nanosleep_fun = int (*)(const struct timespec *req, struct timespec *rem);
+extern nanosleep_fun nanosleep_f;
+
+using clock_nanosleep_fun = int (*)(clockid_t clockid, int flags, const struct timespec *req, struct timespec *rem);
+extern clock_nanosleep_fun clock_nanosleep_f;
+
 //socket
 using socket_fun = int (*)(int domain, int type, int protocol);
 extern socket_fun socket_f;
@@ -42,6 +71,9 @@ extern read_fun read_f;
 using readv_fun = ssize_t (*)(int fd, const struct iovec *iov, int iovcnt);
 extern readv_fun readv_f;
 
+using pread_fun = ssize_t (*)(int fd, void *buf, size_t count, off_t offset);
+extern pread_fun pread_f;
+
 using recv_fun = ssize_t (*)(int sockfd, void *buf, size_t len, int flags);
 extern recv_fun recv_f;
 
@@ -58,6 +90,9 @@ extern write_fun write_f;
 using writev_fun = ssize_t (*)(int fd, const struct iovec *iov, int iovcnt);
 extern writev_fun writev_f;
 
+using pwrite_fun = ssize_t (*)(int fd, const void *buf, size_t count, off_t offset);
+extern pwrite_fun pwrite_f;
+
 using send_fun = ssize_t (*)(int s, const void *msg, size_t len, int flags);
 extern send_fun send_f;
 
@@ -67,9 +102,29 @@ extern sendto_fun sendto_f;
 using sendmsg_fun = ssize_t (*)(int s, const struct msghdr *msg, int flags);
 extern sendmsg_fun sendmsg_f;
 
+//file
+using open_fun = int (*)(const char *pathname, int flags, ...);
+extern open_fun open_f;
+
+using fsync_fun = int (*)(int fd);
+extern fsync_fun fsync_f;
+
 using close_fun = int (*)(int fd);
 extern close_fun close_f;
 
+using fcntl_fun = int (*)(int fd, int cmd, ... /* arg */ );
+extern fcntl_fun fcntl_f;
+
+using ioctl_fun = int (*)(int d, unsigned long int request, ...);
+extern ioctl_fun ioctl_f;
+
+//poll
+using poll_fun = int (*)(struct pollfd *fds, nfds_t nfds, int timeout);
+extern poll_fun poll_f;
+
+using select_fun = int (*)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+extern select_fun select_f;
+
 //opt
 using getsockopt_fun = int (*)(int sockfd, int level, int optname, void *optval, socklen_t *optlen);
 extern getsockopt_fun getsockopt_f;
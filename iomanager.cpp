@@ -5,8 +5,12 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <string.h>
 #include "hook.h"
+#include "uring.h"
+#include "util.h"
+#include "clock.h"
 
 namespace fisher {
 
@@ -59,257 +63,674 @@ static std::ostream& operator<< (std::ostream& os, EPOLL_EVENTS events) {
     return os;
 }
 
-IOManager::FdContext::EventContext& IOManager::FdContext::getContext(IOManager::Event event) {
+/**
+ * @brief 挂起在io_uring请求上的协程,位于该协程的栈上
+ */
+struct UringWait {
+    /// 等待的协程
+    Fiber::FiberRef fiber;
+    /// 请求的fd上下文
+    FdCtx* fd_ctx = nullptr;
+    /// 事件类型
+    IOManager::Event event = IOManager::NONE;
+    /// 提交请求的工作线程下标
+    int worker = -1;
+    /// 所属工作线程内的序号,用于识别跨线程取消时请求是否已更换
+    uint64_t id = 0;
+    /// 请求结果(cqe->res)
+    int res = 0;
+    /// 是否被主动取消
+    bool cancelled = false;
+    /// 同一事件的下一个请求
+    UringWait* next = nullptr;
+};
+
+/**
+ * @brief 从请求链表中摘下wait
+ * @return wait不在链表中返回false
+ */
+static bool UnlinkUring(UringWait*& head, UringWait* wait) {
+    for(UringWait** link = &head; *link; link = &(*link)->next) {
+        if(*link == wait) {
+            *link = wait->next;
+            wait->next = nullptr;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// IOManager编号,从1开始
+static std::atomic<uint32_t> s_iomanager_id {0};
+
+IoWaiter*& IOManager::getWaiters(FdCtx* fd_ctx, Event event) {
     switch(event) {
-        case IOManager::READ:
-            return read;
-        case IOManager::WRITE:
-            return write;
+        case READ:
+            return fd_ctx->readers_;
+        case WRITE:
+            return fd_ctx->writers_;
         default:
-            // SYLAR_ASSERT2(false, "getContext");
-            std::cout << "failed getcontext" << std::endl;
+            break;
     }
-    throw std::invalid_argument("getContext invalid event");
+    throw std::invalid_argument("getWaiters invalid event");
 }
 
-void IOManager::FdContext::resetContext(EventContext& ctx) {
-    ctx = (std::function<void()>) nullptr;
+UringWait*& IOManager::getUring(FdCtx* fd_ctx, Event event) {
+    switch(event) {
+        case READ:
+            return fd_ctx->uringRead_;
+        case WRITE:
+            return fd_ctx->uringWrite_;
+        default:
+            break;
+    }
+    throw std::invalid_argument("getUring invalid event");
 }
 
-void IOManager::FdContext::triggerEvent(IOManager::Event event) {
-    assert(events & event);
-    events = (Event)(events & ~event);
-    EventContext& ctx = getContext(event);
-    std::visit([](auto k){
-        IOManager::GetThis()->schedule(k);
-    }, ctx);
-    return;
+void IOManager::triggerEvent(FdCtx* fd_ctx, Event event, int thread) {
+    assert(fd_ctx->events_ & event);
+    fd_ctx->events_ &= ~event;
+    IoWaiter*& head = getWaiters(fd_ctx, event);
+    IoWaiter* w = head;
+    head = nullptr;
+    while(w) {
+        // 唤醒之后节点可能随等待方返回而失效
+        IoWaiter* next = w->next;
+        wakeWaiter(w, thread);
+        w = next;
+    }
 }
 
-IOManager::IOManager(size_t threads, const std::string& name)
-    :Scheduler(threads, name) {
+void IOManager::wakeWaiter(IoWaiter* waiter, int thread) {
+    if(waiter->cb) {
+        waiter->cb(waiter->arg);
+        --n_pendingEvent_;
+        return;
+    }
+    Fiber::FiberRef f = std::move(waiter->fiber);
+    int idx = getWorkerIndex();
+    if(thread == -1 && idx >= 0 && pollers_[idx]->dispatching) {
+        pollers_[idx]->ready.push_back(std::move(f));
+    } else {
+        schedule(std::move(f), thread);
+    }
+    --n_pendingEvent_;
+}
+
+IoWaiter* IOManager::unlinkWaiter(FdCtx* fd_ctx, Event event, IoWaiter* waiter) {
+    if(!(fd_ctx->events_ & event)) {
+        return nullptr;
+    }
+    IoWaiter*& head = getWaiters(fd_ctx, event);
+    IoWaiter* found = nullptr;
+    if(!waiter) {
+        found = head;
+        head = nullptr;
+    } else {
+        for(IoWaiter** link = &head; *link; link = &(*link)->next) {
+            if(*link == waiter) {
+                *link = waiter->next;
+                waiter->next = nullptr;
+                found = waiter;
+                break;
+            }
+        }
+        if(!found) {
+            return nullptr;
+        }
+    }
+    if(head) {
+        return found;
+    }
+
+    Event new_events = (Event)(fd_ctx->events_ & ~event);
+    if(!fd_ctx->registered_) {
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
+
+        int epfd = epollFd(fd_ctx);
+        int rt = epoll_ctl(epfd, op, fd_ctx->fd_, &epevent);
+        if(rt) {
+            // 节点由等待方持有,无论如何都要摘下;残留的注册只会带来一次没有等待者的事件
+            FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                << (EpollCtlOp)op << ", " << fd_ctx->fd_ << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                << rt << " (" << errno << ") (" << strerror(errno) << ")";
+        }
+    }
+    fd_ctx->events_ = new_events;
+    return found;
+}
+
+IOManager::IOManager(size_t threads, const std::string& name, int options)
+    :Scheduler(threads, name)
+    ,options_(options)
+    ,id_(++s_iomanager_id) {
     epfd_ = epoll_create(5000);
     assert(epfd_ > 0);
 
-    int rt = pipe(tickleFds_);
-    assert(!rt);
-
-    epoll_event event;
-    memset(&event, 0, sizeof(epoll_event));
-    event.events = EPOLLIN | EPOLLET;
-    event.data.fd = tickleFds_[0];
+    // 每个工作线程一个私有epoll,包含自己的eventfd,
+    // 同一时刻只有一个空闲线程(leader)把共享的epfd_加入自己的私有epoll
+    for(size_t i = 0; i < n_thread_; ++i) {
+        std::unique_ptr<Poller> poller(new Poller);
+        poller->epfd = epoll_create(16);
+        assert(poller->epfd > 0);
+        poller->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        assert(poller->eventfd >= 0);
+
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events = EPOLLIN;
+        event.data.ptr = poller.get();
+        int rt = epoll_ctl(poller->epfd, EPOLL_CTL_ADD, poller->eventfd, &event);
+        assert(!rt);
+        pollers_.push_back(std::move(poller));
+    }
 
-    rt = fcntl(tickleFds_[0], F_SETFL, O_NONBLOCK);
-    assert(!rt);
+    if(options_ & URING) {
+        for(auto& poller : pollers_) {
+            poller->ring.reset(new IoUring(256));
+            if(!poller->ring->isValid()) {
+                FISHER_LOG_ERROR(g_logger) << "io_uring unavailable, fall back to epoll";
+                options_ &= ~URING;
+                break;
+            }
+            // 有完成事件时ring可读,和eventfd一样唤醒阻塞在私有epoll上的线程
+            epoll_event event;
+            memset(&event, 0, sizeof(epoll_event));
+            event.events = EPOLLIN;
+            event.data.ptr = poller->ring.get();
+            int rt = epoll_ctl(poller->epfd, EPOLL_CTL_ADD, poller->ring->getFd(), &event);
+            assert(!rt);
+        }
+        if(!(options_ & URING)) {
+            for(auto& poller : pollers_) {
+                poller->ring.reset();
+            }
+        }
+    }
 
-    rt = epoll_ctl(epfd_, EPOLL_CTL_ADD, tickleFds_[0], &event);
-    assert(!rt);
+    if(options_ & TIMER_PER_WORKER) {
+        setTimerWheels(n_thread_);
+    }
 
-    contextResize(32);
     start();
 }
 
 IOManager::~IOManager() {
     // stop();
-    close(epfd_);
-    close(tickleFds_[0]);
-    close(tickleFds_[1]);
-    for(size_t i = 0; i < fdContexts_.size(); ++i) {
-        if(fdContexts_[i]) {
-            delete fdContexts_[i];
-        }
+    for(auto& poller : pollers_) {
+        close(poller->epfd);
+        close(poller->eventfd);
     }
+    close(epfd_);
 }
 
-void IOManager::contextResize(size_t size) {
-    fdContexts_.resize(size);
+FdCtx* IOManager::getFdContext(int fd) {
+    return FdMgr::getInstance().getRecord(fd);
+}
 
-    for(size_t i = 0; i < fdContexts_.size(); ++i) {
-        if(!fdContexts_[i]) {
-            fdContexts_[i] = new FdContext;
-            fdContexts_[i]->fd = i;
-        }
+FdCtx* IOManager::findFdContext(int fd) {
+    return FdMgr::getInstance().getRecord(fd, false);
+}
+
+void IOManager::adoptContext(FdCtx* fd_ctx) {
+    if(fd_ctx->owner_ == id_) {
+        return;
     }
+    // 之前的IOManager已经不再等待该fd,它的注册状态对当前epoll无效
+    fd_ctx->owner_ = id_;
+    fd_ctx->shard_ = -1;
+    fd_ctx->registered_ = false;
+    fd_ctx->ready_ = NONE;
 }
 
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-    FdContext* fd_ctx;
-    {
-        std::unique_lock lock(mutex_);
-        if((int)fdContexts_.size() > fd) {
-            fd_ctx = fdContexts_[fd];
-        } else {
-            contextResize(fd * 1.5);
-            fd_ctx = fdContexts_[fd];
+int IOManager::addEvent(int fd, Event event, IoWaiter* waiter) {
+    FdCtx* fd_ctx = getFdContext(fd);
+    if(!fd_ctx) {
+        FISHER_LOG_ERROR(g_logger) << "addEvent fd=" << fd << " out of range";
+        errno = EBADF;
+        return -1;
+    }
+    if(!waiter->cb && !waiter->fiber) {
+        waiter->fiber = Fiber::GetThis();
+    }
+
+    std::unique_lock lock2(fd_ctx->mutex_);
+    adoptContext(fd_ctx);
+    if(options_ & PERSISTENT) {
+        if(fd_ctx->ready_ & event) {
+            // 等待之前边沿已经到达,直接恢复,由调用方重试IO
+            fd_ctx->ready_ = (Event)(fd_ctx->ready_ & ~event);
+            int self = getWorkerIndex();
+            ++n_pendingEvent_;
+            wakeWaiter(waiter, self >= 0 ? self + 1 : -1);
+            return 0;
+        }
+        if(!fd_ctx->registered_ && registerContext(fd_ctx)) {
+            return -1;
         }
     }
 
-    std::unique_lock lock2(fd_ctx->mutex);
-    if(fd_ctx->events & event) {
-        FISHER_LOG_ERROR(g_logger) << "addEvent assert fd=" << fd
-                    << " event=" << (EPOLL_EVENTS)event
-                    << " fd_ctx.event=" << (EPOLL_EVENTS)fd_ctx->events;
-        assert(!(fd_ctx->events & event));
+    // 同一事件已有等待者时已经注册过,只加入链表
+    if(!(fd_ctx->events_ & event)) {
+        int op = fd_ctx->events_ ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        epoll_event epevent;
+        epevent.events = EPOLLET | fd_ctx->events_ | event;
+        epevent.data.ptr = fd_ctx;
+
+        if((options_ & SHARDED) && !fd_ctx->events_ && fd_ctx->shard_ < 0) {
+            // 注册到首次等待它的工作线程的epoll上
+            fd_ctx->shard_ = getWorkerIndex();
+        }
+        int epfd = epollFd(fd_ctx);
+        if(!fd_ctx->registered_) {
+            int rt = epoll_ctl(epfd, op, fd, &epevent);
+            if(rt) {
+                FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                    << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                    << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
+                    << (EPOLL_EVENTS)fd_ctx->events_;
+                return -1;
+            }
+        }
+        fd_ctx->events_ = (Event)(fd_ctx->events_ | event);
     }
 
-    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    IoWaiter*& head = getWaiters(fd_ctx, event);
+    waiter->next = head;
+    head = waiter;
+    ++n_pendingEvent_;
+    return 0;
+}
+
+int IOManager::registerContext(FdCtx* fd_ctx) {
+    if((options_ & SHARDED) && fd_ctx->shard_ < 0) {
+        fd_ctx->shard_ = getWorkerIndex();
+    }
     epoll_event epevent;
-    epevent.events = EPOLLET | fd_ctx->events | event;
+    epevent.events = EPOLLET | EPOLLIN | EPOLLOUT | EPOLLRDHUP;
     epevent.data.ptr = fd_ctx;
 
-    fd_ctx->events = (Event)(fd_ctx->events | event);
-    FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
-    // originally, no ctx
-    assert(!event_ctx.index());
-    
-    // assign ctx
-    if(cb) {
-        event_ctx = cb;
-    } else {
-        event_ctx = Fiber::GetThis();
-        // SYLAR_ASSERT2(event_ctx.fiber->getState() == Fiber::EXEC
-        //               ,"state=" << event_ctx.fiber->getState());
-        assert(std::get<Fiber::FiberRef>(event_ctx)->getState() == Fiber::EXEC);
+    int epfd = epollFd(fd_ctx);
+    int op = EPOLL_CTL_ADD;
+    int rt = epoll_ctl(epfd, op, fd_ctx->fd_, &epevent);
+    if(rt && errno == EEXIST) {
+        // 同号的旧fd没有经过cancelAll就被关闭,其注册还在
+        op = EPOLL_CTL_MOD;
+        rt = epoll_ctl(epfd, op, fd_ctx->fd_, &epevent);
     }
-
-    int rt = epoll_ctl(epfd_, op, fd, &epevent);
     if(rt) {
-        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", "
-            << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-            << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
-            << (EPOLL_EVENTS)fd_ctx->events;
+        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+            << (EpollCtlOp)op << ", " << fd_ctx->fd_ << ", " << (EPOLL_EVENTS)epevent.events << "):"
+            << rt << " (" << errno << ") (" << strerror(errno) << ")";
         return -1;
     }
-    ++n_pendingEvent_;
+    // 注册后内核会立即报告当前已就绪的方向
+    fd_ctx->ready_ = NONE;
+    fd_ctx->registered_ = true;
     return 0;
 }
 
-bool IOManager::delEvent(int fd, Event event) {
-    FdContext* fd_ctx;
-    {
-        std::shared_lock lock(mutex_);
-        if((int)fdContexts_.size() <= fd) {
-            return false;
-        }
-        fd_ctx = fdContexts_[fd];
+int IOManager::registerFd(int fd) {
+    if(!(options_ & PERSISTENT)) {
+        return 0;
+    }
+    FdCtx* fd_ctx = getFdContext(fd);
+    if(!fd_ctx) {
+        return -1;
+    }
+    std::unique_lock lock(fd_ctx->mutex_);
+    adoptContext(fd_ctx);
+    if(fd_ctx->registered_) {
+        return 0;
     }
+    return registerContext(fd_ctx);
+}
 
-    std::unique_lock lock(fd_ctx->mutex);
-    if(!(fd_ctx->events & event)) {
+bool IOManager::delEvent(int fd, Event event, IoWaiter* waiter) {
+    FdCtx* fd_ctx = findFdContext(fd);
+    if(!fd_ctx) {
         return false;
     }
 
-    Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
-    epevent.data.ptr = fd_ctx;
+    std::unique_lock lock(fd_ctx->mutex_);
+    if(fd_ctx->owner_ != id_) {
+        return false;
+    }
+    IoWaiter* w = unlinkWaiter(fd_ctx, event, waiter);
+    if(!w) {
+        return false;
+    }
+    while(w) {
+        IoWaiter* next = w->next;
+        w->fiber.reset();
+        --n_pendingEvent_;
+        w = next;
+    }
+    return true;
+}
 
-    int rt = epoll_ctl(epfd_, op, fd, &epevent);
-    if(rt) {
-        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", "
-            << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-            << rt << " (" << errno << ") (" << strerror(errno) << ")";
+bool IOManager::cancelEvent(int fd, Event event, IoWaiter* waiter) {
+    FdCtx* fd_ctx = findFdContext(fd);
+    if(!fd_ctx) {
         return false;
     }
 
-    --n_pendingEvent_;
-    fd_ctx->events = new_events;
-    FdContext::EventContext& event_ctx = fd_ctx->getContext(event);
-    fd_ctx->resetContext(event_ctx);
+    std::unique_lock lock(fd_ctx->mutex_);
+    if(fd_ctx->owner_ != id_) {
+        return false;
+    }
+    bool cancelled = !waiter && cancelUring(fd_ctx, event);
+    IoWaiter* w = unlinkWaiter(fd_ctx, event, waiter);
+    if(!w) {
+        return cancelled;
+    }
+    int thread = ownerThread(fd_ctx);
+    while(w) {
+        IoWaiter* next = w->next;
+        wakeWaiter(w, thread);
+        w = next;
+    }
     return true;
 }
 
-bool IOManager::cancelEvent(int fd, Event event) {
-    FdContext* fd_ctx;
-    {
-        std::shared_lock lock(mutex_);
-        if((int)fdContexts_.size() <= fd) {
-            return false;
-        }
-        fd_ctx = fdContexts_[fd];
+bool IOManager::cancelAll(int fd) {
+    FdCtx* fd_ctx = findFdContext(fd);
+    if(!fd_ctx) {
+        return false;
     }
 
-    std::unique_lock lock(fd_ctx->mutex);
-    if(!(fd_ctx->events & event)) {
+    std::unique_lock lock(fd_ctx->mutex_);
+    if(fd_ctx->owner_ != id_) {
         return false;
     }
+    bool cancelled = cancelUring(fd_ctx, READ);
+    cancelled = cancelUring(fd_ctx, WRITE) || cancelled;
+    if(!fd_ctx->events_ && !fd_ctx->registered_) {
+        return cancelled;
+    }
 
-    Event new_events = (Event)(fd_ctx->events & ~event);
-    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    // 持久注册的fd在关闭前移除,之后同号的fd重新注册
+    int op = EPOLL_CTL_DEL;
     epoll_event epevent;
-    epevent.events = EPOLLET | new_events;
+    epevent.events = 0;
     epevent.data.ptr = fd_ctx;
 
-    int rt = epoll_ctl(epfd_, op, fd, &epevent);
+    int epfd = epollFd(fd_ctx);
+    int rt = epoll_ctl(epfd, op, fd, &epevent);
     if(rt) {
-        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", "
+        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
             << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
             << rt << " (" << errno << ") (" << strerror(errno) << ")";
         return false;
     }
 
-    fd_ctx->triggerEvent(event);
-    --n_pendingEvent_;
-    return true;
+    cancelled = cancelled || fd_ctx->events_;
+    int thread = ownerThread(fd_ctx);
+    if(fd_ctx->events_ & READ) {
+        triggerEvent(fd_ctx, READ, thread);
+    }
+    if(fd_ctx->events_ & WRITE) {
+        triggerEvent(fd_ctx, WRITE, thread);
+    }
+
+    assert(fd_ctx->events_ == 0);
+    fd_ctx->shard_ = -1;
+    fd_ctx->registered_ = false;
+    fd_ctx->ready_ = NONE;
+    return cancelled;
 }
 
-bool IOManager::cancelAll(int fd) {
-    FdContext* fd_ctx;
+bool IOManager::hasUring() {
+    return (options_ & URING) && getWorkerIndex() >= 0;
+}
+
+ssize_t IOManager::submitIo(const io_uring_sqe& sqe, Event event, uint64_t timeout_ms) {
+    int idx = getWorkerIndex();
+    assert(idx >= 0 && pollers_[idx]->ring);
+    Poller& poller = *pollers_[idx];
+    IoUring& ring = *poller.ring;
+    FdCtx* fd_ctx = getFdContext(sqe.fd);
+    if(!fd_ctx) {
+        errno = EBADF;
+        return -1;
+    }
+    unsigned need = timeout_ms != (uint64_t)-1 ? 2 : 1;
+    if(ring.sqSpace() < need) {
+        ring.submit();
+        if(ring.sqSpace() < need) {
+            errno = EBUSY;
+            return -1;
+        }
+    }
+
+    UringWait wait;
+    wait.fiber = Fiber::GetThis();
+    wait.fd_ctx = fd_ctx;
+    wait.event = event;
+    wait.worker = idx;
+    wait.id = ++poller.n_uring;
     {
-        std::shared_lock lock(mutex_);
-        if((int)fdContexts_.size() <= fd) {
-            return false;
+        std::unique_lock lock(wait.fd_ctx->mutex_);
+        adoptContext(wait.fd_ctx);
+        // 同一事件可以有多个进行中的请求,取消时全部取消
+        UringWait*& head = getUring(wait.fd_ctx, event);
+        wait.next = head;
+        head = &wait;
+    }
+
+    io_uring_sqe* io = ring.getSqe();
+    *io = sqe;
+    io->user_data = (uint64_t)&wait;
+    // 链接的超时在内核中取消请求,请求以-ECANCELED完成
+    struct __kernel_timespec ts;
+    if(need == 2) {
+        io->flags |= IOSQE_IO_LINK;
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = timeout_ms % 1000 * 1000000;
+        io_uring_sqe* timeout = ring.getSqe();
+        timeout->opcode = IORING_OP_LINK_TIMEOUT;
+        timeout->fd = -1;
+        timeout->addr = (uint64_t)&ts;
+        timeout->len = 1;
+        timeout->user_data = 0;
+    }
+    ++n_pendingEvent_;
+    // 提交失败的请求留在队列中,由idle再次提交
+    int rt = ring.submit();
+    if(rt < 0) {
+        FISHER_LOG_ERROR(g_logger) << "io_uring submit errno=" << -rt
+            << " errstr=" << strerror(-rt);
+    }
+
+    Fiber::GetThis()->yeild();
+
+    if(wait.res >= 0) {
+        return wait.res;
+    }
+    if(wait.res == -ECANCELED) {
+        SetErrno(wait.cancelled ? ECANCELED : ETIMEDOUT);
+    } else {
+        SetErrno(-wait.res);
+    }
+    return -1;
+}
+
+ssize_t IOManager::submitFileIo(const io_uring_sqe& sqe) {
+    int idx = getWorkerIndex();
+    assert(idx >= 0 && pollers_[idx]->ring);
+    Poller& poller = *pollers_[idx];
+    IoUring& ring = *poller.ring;
+    if(!ring.sqSpace()) {
+        ring.submit();
+        if(!ring.sqSpace()) {
+            errno = EBUSY;
+            return -1;
         }
-        fd_ctx = fdContexts_[fd];
     }
 
-    std::unique_lock lock(fd_ctx->mutex);
-    if(!fd_ctx->events) {
-        return false;
+    UringWait wait;
+    wait.fiber = Fiber::GetThis();
+    wait.worker = idx;
+    wait.id = ++poller.n_uring;
+    io_uring_sqe* io = ring.getSqe();
+    *io = sqe;
+    io->user_data = (uint64_t)&wait;
+    ++n_pendingEvent_;
+    int rt = ring.submit();
+    if(rt < 0) {
+        FISHER_LOG_ERROR(g_logger) << "io_uring submit errno=" << -rt
+            << " errstr=" << strerror(-rt);
     }
 
-    int op = EPOLL_CTL_DEL;
-    epoll_event epevent;
-    epevent.events = 0;
-    epevent.data.ptr = fd_ctx;
+    Fiber::GetThis()->yeild();
 
-    int rt = epoll_ctl(epfd_, op, fd, &epevent);
-    if(rt) {
-        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", "
-            << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
-            << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+    if(wait.res >= 0) {
+        return wait.res;
     }
+    SetErrno(-wait.res);
+    return -1;
+}
 
-    if(fd_ctx->events & READ) {
-        fd_ctx->triggerEvent(READ);
+void IOManager::reapCompletions(Poller& poller, int idx) {
+    io_uring_cqe cqe;
+    while(poller.ring->popCqe(cqe)) {
+        // 链接的超时和取消请求不关联协程
+        if(!cqe.user_data) {
+            continue;
+        }
+        UringWait* wait = (UringWait*)cqe.user_data;
+        Fiber::FiberRef fiber;
+        if(!wait->fd_ctx) {
+            // submitFileIo提交的请求不关联fd上下文
+            wait->res = cqe.res;
+            fiber = std::move(wait->fiber);
+        } else {
+            std::unique_lock lock(wait->fd_ctx->mutex_);
+            UnlinkUring(getUring(wait->fd_ctx, wait->event), wait);
+            wait->res = cqe.res;
+            fiber = std::move(wait->fiber);
+        }
         --n_pendingEvent_;
+        schedule(std::move(fiber), idx + 1);
     }
-    if(fd_ctx->events & WRITE) {
-        fd_ctx->triggerEvent(WRITE);
-        --n_pendingEvent_;
+}
+
+bool IOManager::cancelUring(FdCtx* fd_ctx, Event event) {
+    bool cancelled = false;
+    int self = getWorkerIndex();
+    for(UringWait* wait = getUring(fd_ctx, event); wait; wait = wait->next) {
+        if(wait->cancelled) {
+            continue;
+        }
+        wait->cancelled = true;
+        cancelled = true;
+        int worker = wait->worker;
+        if(worker == self) {
+            submitCancel(*pollers_[worker], (uint64_t)wait);
+            continue;
+        }
+        // ring只能由所属线程提交,转交给该线程。执行时请求可能已经完成,
+        // 需要确认还是同一个请求
+        uint64_t id = wait->id;
+        schedule([this, fd_ctx, event, wait, id]() {
+            std::unique_lock lock(fd_ctx->mutex_);
+            for(UringWait* cur = getUring(fd_ctx, event); cur; cur = cur->next) {
+                if(cur == wait && cur->id == id) {
+                    submitCancel(*pollers_[cur->worker], (uint64_t)cur);
+                    break;
+                }
+            }
+        }, worker + 1);
     }
+    return cancelled;
+}
 
-    assert(fd_ctx->events == 0);
-    return true;
+void IOManager::submitCancel(Poller& poller, uint64_t user_data) {
+    IoUring& ring = *poller.ring;
+    io_uring_sqe* sqe = ring.getSqe();
+    if(!sqe) {
+        ring.submit();
+        sqe = ring.getSqe();
+        if(!sqe) {
+            FISHER_LOG_ERROR(g_logger) << "io_uring cancel: submission queue full";
+            return;
+        }
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = 0;
+    ring.submit();
 }
 
 IOManager* IOManager::GetThis() {
     return dynamic_cast<IOManager*>(Scheduler::GetThis());
 }
 
-void IOManager::tickle() {
+bool IOManager::notify(size_t idx) {
+    Poller& poller = *pollers_[idx];
+    if(poller.notified.exchange(true)) {
+        ++n_tickle_suppressed_;
+        return false;
+    }
+    uint64_t one = 1;
+    int rt = write(poller.eventfd, &one, sizeof(one));
+    assert(rt == sizeof(one));
+    ++n_tickle_sent_;
+    return true;
+}
+
+bool IOManager::notifyIdle(int skip) {
     if(!hasIdleThreads()) {
+        ++n_tickle_suppressed_;
+        return false;
+    }
+    size_t n = pollers_.size();
+    size_t start = n_tickle_rr_++;
+    for(size_t i = 0; i < n; ++i) {
+        size_t idx = (start + i) % n;
+        if((int)idx != skip && isIdleThread(idx + 1) && !pollers_[idx]->notified) {
+            return notify(idx);
+        }
+    }
+    ++n_tickle_suppressed_;
+    return false;
+}
+
+void IOManager::tickle() {
+    notifyIdle(-1);
+}
+
+void IOManager::tickleIdle(size_t n) {
+    int skip = getWorkerIndex();
+    while(n-- && notifyIdle(skip));
+}
+
+void IOManager::tickle(int thread) {
+    if(thread < 1 || thread > (int)pollers_.size()) {
+        tickle();
         return;
     }
-    int rt = write(tickleFds_[1], "T", 1);
-    assert(rt == 1);
+    if(!isIdleThread(thread)) {
+        ++n_tickle_suppressed_;
+        return;
+    }
+    notify(thread - 1);
+}
+
+IOManager::TickleStats IOManager::getTickleStats() const {
+    TickleStats stats;
+    stats.sent = n_tickle_sent_;
+    stats.suppressed = n_tickle_suppressed_;
+    return stats;
 }
 
 bool IOManager::stopping(uint64_t& timeout) {
     timeout = getNextTimer();
-    return timeout == ~0ull && n_pendingEvent_ == 0 && Scheduler::stopping();
+    return !hasTimer() && n_pendingEvent_ == 0 && Scheduler::stopping();
 }
 
 bool IOManager::stopping() {
@@ -317,16 +738,133 @@ bool IOManager::stopping() {
     return stopping(timeout);
 }
 
+void IOManager::handleEvent(epoll_event& event) {
+    FdCtx* fd_ctx = (FdCtx*)event.data.ptr;
+    std::unique_lock lock(fd_ctx->mutex_);
+    if(fd_ctx->registered_) {
+        if(event.events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+            event.events |= EPOLLIN | EPOLLOUT;
+        }
+    } else if(event.events & (EPOLLERR | EPOLLHUP)) {
+        event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events_;
+    }
+    int real_events = NONE;
+    if(event.events & EPOLLIN) {
+        real_events |= READ;
+    }
+    if(event.events & EPOLLOUT) {
+        real_events |= WRITE;
+    }
+
+    if(fd_ctx->registered_) {
+        // 持久注册:有等待者就唤醒,否则记录就绪位,不再调用epoll_ctl
+        int thread = ownerThread(fd_ctx);
+        for(Event e : {READ, WRITE}) {
+            if(!(real_events & e)) {
+                continue;
+            }
+            if(fd_ctx->events_ & e) {
+                triggerEvent(fd_ctx, e, thread);
+            } else {
+                fd_ctx->ready_ = (Event)(fd_ctx->ready_ | e);
+            }
+        }
+        return;
+    }
+
+    if((fd_ctx->events_ & real_events) == NONE) {
+        return;
+    }
+
+    int left_events = (fd_ctx->events_ & ~real_events);
+    int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    event.events = EPOLLET | left_events;
+
+    int epfd = epollFd(fd_ctx);
+    if(int rt2 = epoll_ctl(epfd, op, fd_ctx->fd_, &event)) {
+        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+            << (EpollCtlOp)op << ", " << fd_ctx->fd_ << ", " << (EPOLL_EVENTS)event.events << "):"
+            << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+        return;
+    }
+
+    int thread = ownerThread(fd_ctx);
+    if(real_events & READ) {
+        triggerEvent(fd_ctx, READ, thread);
+    }
+    if(real_events & WRITE) {
+        triggerEvent(fd_ctx, WRITE, thread);
+    }
+}
+
+int IOManager::epollFd(FdCtx* fd_ctx) {
+    if(fd_ctx->shard_ >= 0) {
+        return pollers_[fd_ctx->shard_]->epfd;
+    }
+    return epfd_;
+}
+
+int IOManager::ownerThread(FdCtx* fd_ctx) {
+    return fd_ctx->shard_ >= 0 ? fd_ctx->shard_ + 1 : -1;
+}
+
+bool IOManager::becomeLeader(Poller& poller, int idx) {
+    if(poller.leader) {
+        return true;
+    }
+    int expected = -1;
+    if(!leader_.compare_exchange_strong(expected, idx)) {
+        if(poller.attached) {
+            // 其他线程已经是leader,移除残留的epfd_避免一起被唤醒
+            epoll_ctl(poller.epfd, EPOLL_CTL_DEL, epfd_, nullptr);
+            poller.attached = false;
+        }
+        return false;
+    }
+    poller.leader = true;
+    if(poller.attached) {
+        return true;
+    }
+    epoll_event event;
+    memset(&event, 0, sizeof(epoll_event));
+    event.events = EPOLLIN;
+    event.data.ptr = this;
+    if(epoll_ctl(poller.epfd, EPOLL_CTL_ADD, epfd_, &event)) {
+        FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << poller.epfd << ", EPOLL_CTL_ADD, "
+            << epfd_ << ") (" << errno << ") (" << strerror(errno) << ")";
+        poller.leader = false;
+        leader_ = -1;
+        return false;
+    }
+    poller.attached = true;
+    return true;
+}
+
+void IOManager::resignLeader(Poller& poller, int idx) {
+    if(!poller.leader) {
+        return;
+    }
+    // epfd_先留在私有epoll中,再次成为leader时不需要重新添加,
+    // 其他线程成为leader后才移除
+    poller.leader = false;
+    leader_ = -1;
+    // 交给其他空闲线程继续等待共享的epfd_
+    notifyIdle(idx);
+}
+
 void IOManager::idle() {
     const uint64_t MAX_EVENTS = 256;
-    epoll_event* events = new epoll_event[MAX_EVENTS]();
-    // std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
-    //     delete[] ptr;
-    // });
+    std::unique_ptr<epoll_event[]> events(new epoll_event[MAX_EVENTS]());
+    std::unique_ptr<epoll_event[]> shared_events(new epoll_event[MAX_EVENTS]());
+    int idx = getWorkerIndex();
+    Poller& poller = *pollers_[idx];
     static const uint64_t MAX_TIMEOUT = 10000;
     while(true) {
+        Clock::Update();
+        FiberPool::Shrink();
         uint64_t next_timeout = ~0ull;
         if(stopping(next_timeout)) {
+            resignLeader(poller, idx);
             break;
         }
         FISHER_LOG_INFO(g_logger) << "idle";
@@ -335,68 +873,67 @@ void IOManager::idle() {
         } else {
             next_timeout = MAX_TIMEOUT;
         }
-        int rt = epoll_wait(epfd_, events, MAX_EVENTS, (int)next_timeout);
-        if (rt < 0 || errno == EINTR) {
+        becomeLeader(poller, idx);
+        if(poller.ring) {
+            poller.ring->submit();
+        }
+        int rt = epoll_wait(poller.epfd, events.get(), MAX_EVENTS, (int)next_timeout);
+        if(rt < 0) {
             continue;
         }
+        Clock::Update();
         FISHER_LOG_INFO(g_logger) << "wake up";
         std::vector<std::function<void()>> cbs;
         listExpiredCb(cbs);
-        for (auto it = cbs.begin(); it != cbs.end(); it++) {
-            schedule(*it);
-        }
+        scheduleBatch(std::make_move_iterator(cbs.begin()), std::make_move_iterator(cbs.end()));
 
+        poller.dispatching = true;
         for(int i = 0; i < rt; ++i) {
             epoll_event& event = events[i];
-            if(event.data.fd == tickleFds_[0]) {
-                uint8_t dummy[256];
-                while(read(tickleFds_[0], dummy, sizeof(dummy)) > 0);
-                continue;
-            }
-
-            FdContext* fd_ctx = (FdContext*)event.data.ptr;
-            std::unique_lock lock(fd_ctx->mutex);
-            if(event.events & (EPOLLERR | EPOLLHUP)) {
-                event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
-            }
-            int real_events = NONE;
-            if(event.events & EPOLLIN) {
-                real_events |= READ;
-            }
-            if(event.events & EPOLLOUT) {
-                real_events |= WRITE;
-            }
-
-            if((fd_ctx->events & real_events) == NONE) {
-                continue;
-            }
-
-            int left_events = (fd_ctx->events & ~real_events);
-            int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            event.events = EPOLLET | left_events;
-
-            if(int rt2 = epoll_ctl(epfd_, op, fd_ctx->fd, &event)) {
-                FISHER_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd_ << ", "
-                    << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
-                    << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
-                continue;
-            }
-
-            if(real_events & READ) {
-                fd_ctx->triggerEvent(READ);
-                --n_pendingEvent_;
-            }
-            if(real_events & WRITE) {
-                fd_ctx->triggerEvent(WRITE);
-                --n_pendingEvent_;
+            if(event.data.ptr == &poller) {
+                uint64_t dummy;
+                while(read(poller.eventfd, &dummy, sizeof(dummy)) > 0);
+                poller.notified = false;
+            } else if(poller.ring && event.data.ptr == poller.ring.get()) {
+                reapCompletions(poller, idx);
+            } else if(event.data.ptr == this) {
+                int n = epoll_wait(epfd_, shared_events.get(), MAX_EVENTS, 0);
+                for(int j = 0; j < n; ++j) {
+                    handleEvent(shared_events[j]);
+                }
+            } else {
+                // 分片模式下注册在本线程epoll上的fd
+                handleEvent(event);
             }
         }
+        poller.dispatching = false;
+        scheduleBatch(std::make_move_iterator(poller.ready.begin()),
+                      std::make_move_iterator(poller.ready.end()));
+        poller.ready.clear();
+        // 仍是leader,本线程取到任务时在onBusy中让出
         Fiber::GetThis()->yeild();
     }
 }
 
-void IOManager::onTimerInsertedAtFront() {
-    tickle();
+void IOManager::onBusy() {
+    // 执行任务期间由其他空闲线程等待共享的epfd_
+    int idx = getWorkerIndex();
+    if(idx >= 0) {
+        resignLeader(*pollers_[idx], idx);
+    }
+}
+
+void IOManager::onTimerInsertedAtFront(size_t wheel) {
+    if(options_ & TIMER_PER_WORKER) {
+        tickle(wheel + 1);
+    } else {
+        tickle();
+    }
+}
+
+size_t IOManager::getTimerWheel() {
+    int idx = getWorkerIndex();
+    return (options_ & TIMER_PER_WORKER) && idx >= 0 ? idx : 0;
 }
 
 }
\ No newline at end of file
@@ -2,10 +2,33 @@
 
 #include "scheduler.h"
 #include "timer.h"
-#include <variant>
+#include "fdmanager.h"
+#include <sys/epoll.h>
+
+struct io_uring_sqe;
 
 namespace fisher {
 
+class IoUring;
+
+/**
+ * @brief 等待fd事件的节点,由等待方提供,通常位于等待协程的栈上
+ * @details 同一个fd的同一事件可以有多个等待者,事件就绪或被取消时全部唤醒。
+ *          没有设置cb时调度fiber(addEvent时为空则取当前协程);设置了cb时在触发事件的线程上
+ *          持有fd的锁直接调用,cb只能做唤醒之类的轻量操作,不能再操作该fd的事件。
+ *          节点在被唤醒或通过delEvent/cancelEvent摘下之前不能销毁
+ */
+struct IoWaiter {
+    /// 等待的协程
+    std::shared_ptr<Fiber> fiber;
+    /// 事件触发时调用的函数,为nullptr时调度fiber
+    void (*cb)(void* arg) = nullptr;
+    /// cb的参数
+    void* arg = nullptr;
+    /// 同一事件的下一个等待者
+    IoWaiter* next = nullptr;
+};
+
 /**
  * @brief 基于Epoll的IO协程调度器
  */
@@ -24,52 +47,35 @@ public:
         /// 写事件(EPOLLOUT)
         WRITE   = 0x4,
     };
-private:
+
     /**
-     * @brief Socket事件上下文类
-     */
-    struct FdContext {
-        using EventContext = std::variant<Fiber::FiberRef, std::function<void()>>;
-
-        /**
-         * @brief 获取事件上下文类
-         * @param[in] event 事件类型
-         * @return 返回对应事件的上线文
-         */
-        EventContext& getContext(Event event);
-
-        /**
-         * @brief 重置事件上下文
-         * @param[in, out] ctx 待重置的上下文类
-         */
-        void resetContext(EventContext& ctx);
-
-        /**
-         * @brief 触发事件
-         * @param[in] event 事件类型
-         */
-        void triggerEvent(Event event);
-
-        /// 读事件上下文
-        EventContext read;
-        /// 写事件上下文
-        EventContext write;
-        /// 事件关联的句柄
-        int fd = 0;
-        /// 当前的事件
-        Event events = NONE;
-
-        std::mutex mutex;
+     * @brief 运行选项,可按位组合
+     */
+    enum Option {
+        /// 所有工作线程共享一个epoll
+        DEFAULT = 0x0,
+        /// 每个工作线程拥有自己的epoll,fd注册到首次等待它的线程上,
+        /// 就绪后协程在同一线程上恢复执行
+        SHARDED = 0x1,
+        /// hook的socket读写/accept/connect直接提交到工作线程自己的io_uring,
+        /// 完成后在同一线程恢复执行。内核不支持时退回epoll
+        URING   = 0x2,
+        /// socket只注册一次(边沿触发,读写两个方向),就绪状态记录在fd上,
+        /// 等待和唤醒时不再调用epoll_ctl
+        PERSISTENT = 0x4,
+        /// 每个工作线程一个时间轮,定时器加到添加它的线程的时间轮上,
+        /// 由该线程处理,非工作线程添加的定时器由第一个工作线程处理
+        TIMER_PER_WORKER = 0x8,
     };
-
 public:
     /**
      * @brief 构造函数
      * @param[in] threads 线程数量
      * @param[in] use_caller 是否将调用线程包含进去
      * @param[in] name 调度器的名称
+     * @param[in] options 运行选项 @see Option
      */
-    IOManager(size_t threads = 1, const std::string& name = "io sched");
+    IOManager(size_t threads = 1, const std::string& name = "io sched", int options = DEFAULT);
 
     /**
      * @brief 析构函数
@@ -77,29 +83,41 @@ public:
     ~IOManager();
 
     /**
-     * @brief 添加事件
+     * @brief 添加事件的等待者
+     * @details 同一事件已有其他等待者时一起等待,就绪时全部唤醒
      * @param[in] fd socket句柄
      * @param[in] event 事件类型
-     * @param[in] cb 事件回调函数
+     * @param[in] waiter 等待节点 @see IoWaiter
      * @return 添加成功返回0,失败返回-1
      */
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+    int addEvent(int fd, Event event, IoWaiter* waiter);
+
+    /**
+     * @brief PERSISTENT模式下将fd注册到epoll,其他模式不做任何事
+     * @param[in] fd socket句柄
+     * @return 成功返回0,失败返回-1
+     */
+    int registerFd(int fd);
 
     /**
      * @brief 删除事件
      * @param[in] fd socket句柄
      * @param[in] event 事件类型
+     * @param[in] waiter 只删除该等待者,nullptr为删除所有等待者
+     * @return 删除了等待者返回true,等待者已被唤醒时返回false
      * @attention 不会触发事件
      */
-    bool delEvent(int fd, Event event);
+    bool delEvent(int fd, Event event, IoWaiter* waiter = nullptr);
 
     /**
      * @brief 取消事件
      * @param[in] fd socket句柄
      * @param[in] event 事件类型
+     * @param[in] waiter 只取消该等待者,nullptr为取消所有等待者和io_uring请求
+     * @return 唤醒了等待者或取消了请求返回true
      * @attention 如果事件存在则触发事件
      */
-    bool cancelEvent(int fd, Event event);
+    bool cancelEvent(int fd, Event event, IoWaiter* waiter = nullptr);
 
     /**
      * @brief 取消所有事件
@@ -107,21 +125,58 @@ public:
      */
     bool cancelAll(int fd);
 
+    /**
+     * @brief 当前线程是否可以通过io_uring提交IO
+     */
+    bool hasUring();
+
+    /**
+     * @brief 通过当前工作线程的io_uring提交IO,挂起当前协程直到完成
+     * @details hook先直接调用非阻塞的原始函数,返回EAGAIN时才提交
+     * @param[in] sqe 已填好opcode/fd/addr/len等字段的请求
+     * @param[in] event 对应的事件类型,cancelEvent/cancelAll会取消该请求
+     * @param[in] timeout_ms 超时时间毫秒,-1表示不超时
+     * @return 成功返回请求结果,失败返回-1并设置errno。
+     *         超时errno为ETIMEDOUT,被cancelEvent/cancelAll取消时为ECANCELED
+     */
+    ssize_t submitIo(const io_uring_sqe& sqe, Event event, uint64_t timeout_ms);
+
+    /**
+     * @brief 通过当前工作线程的io_uring提交普通文件的IO,挂起当前协程直到完成
+     * @details 不关联fd上下文,同一个fd可以同时有多个请求,不支持超时和取消
+     * @param[in] sqe 已填好的请求,可以是openat等不需要fd的请求
+     * @return 成功返回请求结果,失败返回-1并设置errno
+     */
+    ssize_t submitFileIo(const io_uring_sqe& sqe);
+
+    /**
+     * @brief tickle统计信息
+     */
+    struct TickleStats {
+        /// 实际写eventfd唤醒线程的次数
+        uint64_t sent = 0;
+        /// 因目标线程已被通知或没有空闲线程而省略的次数
+        uint64_t suppressed = 0;
+    };
+
+    /**
+     * @brief 返回tickle统计信息
+     */
+    TickleStats getTickleStats() const;
+
     /**
      * @brief 返回当前的IOManager
      */
     static IOManager* GetThis();
 protected:
     void tickle() override;
+    void tickle(int thread) override;
+    void tickleIdle(size_t n) override;
     bool stopping() override;
     void idle() override;
-    void onTimerInsertedAtFront() override;
-
-    /**
-     * @brief 重置socket句柄上下文的容器大小
-     * @param[in] size 容量大小
-     */
-    void contextResize(size_t size);
+    void onBusy() override;
+    void onTimerInsertedAtFront(size_t wheel) override;
+    size_t getTimerWheel() override;
 
     /**
      * @brief 判断是否可以停止
@@ -129,17 +184,161 @@ protected:
      * @return 返回是否可以停止
      */
     bool stopping(uint64_t& timeout);
+
+    /**
+     * @brief 处理就绪的IO事件
+     * @param[in] event 就绪事件
+     */
+    void handleEvent(epoll_event& event);
 private:
+    /**
+     * @brief 工作线程私有的epoll
+     * @details 工作线程阻塞在私有epoll上,其中注册了该线程的eventfd,
+     *          这样可以单独唤醒某个线程。同一时刻只有一个空闲线程(leader)
+     *          会把共享的epfd_加入自己的私有epoll,避免IO就绪时惊群
+     */
+    struct Poller {
+        /// 私有epoll文件句柄
+        int epfd = -1;
+        /// 唤醒该线程的eventfd
+        int eventfd = -1;
+        /// 是否已经通知过且该线程还未处理,用于合并重复的tickle
+        std::atomic<bool> notified {false};
+        /// 是否是leader,只有所属线程访问
+        bool leader = false;
+        /// 共享的epfd_是否在私有epoll中,只有所属线程访问
+        bool attached = false;
+        /// URING模式下该线程的io_uring,只有所属线程提交
+        std::unique_ptr<IoUring> ring;
+        /// 已提交的io_uring请求序号
+        uint64_t n_uring = 0;
+        /// 是否正在处理epoll_wait返回的事件,只有所属线程访问
+        bool dispatching = false;
+        /// 处理事件时唤醒的不指定线程的协程,处理完后批量调度
+        std::vector<Fiber::FiberRef> ready;
+    };
+
+    /**
+     * @brief 获取fd上下文,所在的块不存在时分配
+     * @return 句柄越界返回nullptr
+     */
+    FdCtx* getFdContext(int fd);
+
+    /**
+     * @brief 获取fd上下文,不存在返回nullptr。持有fd_ctx->mutex_后还需检查是否属于当前IOManager
+     */
+    FdCtx* findFdContext(int fd);
+
+    /**
+     * @brief 把fd上下文的IO状态归属到当前IOManager,需持有fd_ctx->mutex_
+     * @details 上下文由所有IOManager共享,fd之前在其他IOManager上使用过时清除其注册状态
+     */
+    void adoptContext(FdCtx* fd_ctx);
+
+    /**
+     * @brief 返回等待事件的节点链表
+     */
+    static IoWaiter*& getWaiters(FdCtx* fd_ctx, Event event);
+
+    /**
+     * @brief 返回事件对应的io_uring请求链表
+     */
+    static UringWait*& getUring(FdCtx* fd_ctx, Event event);
+
+    /**
+     * @brief 触发事件,唤醒所有等待者,需持有fd_ctx->mutex_
+     * @details 本线程正在处理epoll_wait返回的事件时,不指定线程的协程先放入Poller::ready
+     * @param[in] event 事件类型
+     * @param[in] thread 恢复执行的线程id,-1表示任意线程
+     */
+    void triggerEvent(FdCtx* fd_ctx, Event event, int thread = -1);
+
+    /**
+     * @brief 唤醒一个已摘下的等待者,需持有fd_ctx->mutex_
+     */
+    void wakeWaiter(IoWaiter* waiter, int thread);
+
+    /**
+     * @brief 从事件的链表中摘下等待者,需持有fd_ctx->mutex_
+     * @details 链表为空时从epoll中移除该事件
+     * @param[in] waiter 摘下的节点,nullptr为摘下所有节点
+     * @return 摘下的链表,节点已不在链表中时返回nullptr
+     */
+    IoWaiter* unlinkWaiter(FdCtx* fd_ctx, Event event, IoWaiter* waiter);
+
+    /**
+     * @brief 以边沿触发、读写两个方向持久注册fd,需持有fd_ctx->mutex_
+     * @return 成功返回0,失败返回-1
+     */
+    int registerContext(FdCtx* fd_ctx);
+
+    /**
+     * @brief 取出本线程io_uring上完成的请求,唤醒对应协程
+     */
+    void reapCompletions(Poller& poller, int idx);
+
+    /**
+     * @brief 取消fd上下文中对应事件的io_uring请求,需持有fd_ctx->mutex_
+     * @return 存在未取消的请求返回true
+     */
+    bool cancelUring(FdCtx* fd_ctx, Event event);
+
+    /**
+     * @brief 向本线程的io_uring提交取消请求
+     * @param[in] user_data 待取消请求的user_data
+     */
+    void submitCancel(Poller& poller, uint64_t user_data);
+
+    /**
+     * @brief 返回fd注册所在的epoll
+     */
+    int epollFd(FdCtx* fd_ctx);
+
+    /**
+     * @brief 返回fd上等待的协程恢复执行的线程id,-1表示任意线程
+     */
+    int ownerThread(FdCtx* fd_ctx);
+
+    /**
+     * @brief 唤醒第idx个工作线程
+     * @return 该线程已被通知过则返回false
+     */
+    bool notify(size_t idx);
+
+    /**
+     * @brief 唤醒一个空闲且未被通知的工作线程
+     * @param[in] skip 跳过的线程下标
+     */
+    bool notifyIdle(int skip);
+
+    /**
+     * @brief 尝试成为leader,将共享的epfd_加入私有epoll
+     */
+    bool becomeLeader(Poller& poller, int idx);
+
+    /**
+     * @brief 放弃leader,并唤醒其他空闲线程接替
+     */
+    void resignLeader(Poller& poller, int idx);
+
+    /// 运行选项
+    int options_ = DEFAULT;
     /// epoll 文件句柄
     int epfd_ = 0;
-    /// pipe 文件句柄
-    int tickleFds_[2];
+    /// 每个工作线程私有的epoll
+    std::vector<std::unique_ptr<Poller>> pollers_;
+    /// 当前等待共享epfd_的线程下标,-1表示没有
+    std::atomic<int> leader_ = {-1};
+    /// 轮询选择唤醒线程的起始位置
+    std::atomic<size_t> n_tickle_rr_ = {0};
+    /// 实际发送的tickle次数
+    std::atomic<uint64_t> n_tickle_sent_ = {0};
+    /// 被合并省略的tickle次数
+    std::atomic<uint64_t> n_tickle_suppressed_ = {0};
     /// 当前等待执行的事件数量
     std::atomic<size_t> n_pendingEvent_ = {0};
-    /// IOManager的Mutex
-    std::shared_mutex mutex_;
-    /// socket事件上下文的容器
-    std::vector<FdContext*> fdContexts_;
+    /// 编号,用于区分fd上下文属于哪个IOManager
+    uint32_t id_;
 };
 
 }
@@ -15,6 +15,7 @@
 #include <unordered_set>
 #include "singleton.h"
 #include "util.h"
+#include "clock.h"
 
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
@@ -22,7 +23,7 @@
 #define FISHER_LOG_LEVEL(logger, level) \
     if(logger->getLevel() <= level) \
         fisher::LogEventWrap(fisher::LogEvent::LogEventRef(new fisher::LogEvent(logger, level, \
-                        __FILE__, __LINE__, 0, fisher::GetFiberId(), time(0), fisher::GetThreadId(), fisher::GetThreadName()))).getSS()
+                        __FILE__, __LINE__, 0, fisher::GetFiberId(), fisher::Clock::CachedMS(fisher::Clock::WALL) / 1000, fisher::GetThreadId(), fisher::GetThreadName()))).getSS()
 
 /**
  * @brief 使用流式方式将日志级别debug的日志写入到logger
@@ -0,0 +1,318 @@
+#include "mutex.h"
+#include <cassert>
+#include "fiber.h"
+#include "scheduler.h"
+
+namespace fisher {
+
+/// FiberMutex挂起前的自旋次数
+static const int SPIN_COUNT = 100;
+
+static inline void CpuRelax() {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+Fiber* FiberWaiter::prepare() {
+    fiber = Fiber::GetThis();
+    scheduler = Scheduler::GetThis();
+    assert(fiber && scheduler);
+    return fiber.get();
+}
+
+void FiberWaiter::wake() {
+    Scheduler* s = scheduler;
+    Fiber::FiberRef f = std::move(fiber);
+    s->schedule(std::move(f));
+}
+
+/**
+ * @brief 把当前协程加入等待队列,释放guard(和lock)后挂起
+ * @details 返回时已被唤醒。唤醒方可能在当前协程切出之前就唤醒它,
+ *          此时由执行它的线程在切出后放入调度队列
+ */
+static void Park(SpinLock& guard, WaitQueue& queue
+                 ,std::unique_lock<FiberMutex>* lock = nullptr) {
+    FiberWaiter waiter;
+    Fiber* self = waiter.prepare();
+    queue.push(&waiter);
+    guard.unlock();
+    if(lock) {
+        lock->unlock();
+    }
+    self->yeild();
+}
+
+/**
+ * @brief 唤醒以next相连的所有协程
+ */
+static void WakeAll(FiberWaiter* w) {
+    while(w) {
+        FiberWaiter* next = w->next;
+        w->wake();
+        w = next;
+    }
+}
+
+void WaitQueue::push(FiberWaiter* w) {
+    w->next = nullptr;
+    if(tail_) {
+        tail_->next = w;
+    } else {
+        head_ = w;
+    }
+    tail_ = w;
+}
+
+FiberWaiter* WaitQueue::pop() {
+    FiberWaiter* w = head_;
+    if(w) {
+        head_ = w->next;
+        if(!head_) {
+            tail_ = nullptr;
+        }
+    }
+    return w;
+}
+
+FiberWaiter* WaitQueue::popAll() {
+    FiberWaiter* w = head_;
+    head_ = tail_ = nullptr;
+    return w;
+}
+
+bool WaitQueue::remove(FiberWaiter* w) {
+    FiberWaiter* prev = nullptr;
+    for(FiberWaiter* i = head_; i; prev = i, i = i->next) {
+        if(i != w) {
+            continue;
+        }
+        if(prev) {
+            prev->next = i->next;
+        } else {
+            head_ = i->next;
+        }
+        if(tail_ == i) {
+            tail_ = prev;
+        }
+        return true;
+    }
+    return false;
+}
+
+void FiberMutex::lock() {
+    uint32_t expected = 0;
+    if(state_.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+        return;
+    }
+    for(int i = 0; i < SPIN_COUNT; ++i) {
+        CpuRelax();
+        expected = 0;
+        if(state_.load(std::memory_order_relaxed) == 0
+                && state_.compare_exchange_weak(expected, 1, std::memory_order_acquire)) {
+            ++n_spun_;
+            return;
+        }
+    }
+
+    guard_.lock();
+    // 标记有等待者,解锁方会走慢路径检查队列
+    if(state_.exchange(2, std::memory_order_acquire) == 0) {
+        guard_.unlock();
+        return;
+    }
+    ++n_parked_;
+    // 解锁方直接把锁交给当前协程
+    Park(guard_, waiters_);
+}
+
+bool FiberMutex::try_lock() {
+    uint32_t expected = 0;
+    return state_.compare_exchange_strong(expected, 1, std::memory_order_acquire);
+}
+
+void FiberMutex::unlock() {
+    uint32_t expected = 1;
+    if(state_.compare_exchange_strong(expected, 0, std::memory_order_release)) {
+        return;
+    }
+    guard_.lock();
+    FiberWaiter* w = waiters_.pop();
+    if(!w) {
+        state_.store(0, std::memory_order_release);
+    } else {
+        state_.store(waiters_.empty() ? 1 : 2, std::memory_order_relaxed);
+    }
+    guard_.unlock();
+    if(w) {
+        w->wake();
+    }
+}
+
+SyncStats FiberMutex::getStats() const {
+    SyncStats stats;
+    stats.spun = n_spun_;
+    stats.parked = n_parked_;
+    return stats;
+}
+
+void FiberCondVar::wait(std::unique_lock<FiberMutex>& lock) {
+    assert(lock.owns_lock());
+    guard_.lock();
+    ++n_parked_;
+    // 先入队再释放锁,之后的notify不会丢失
+    Park(guard_, waiters_, &lock);
+    lock.lock();
+}
+
+void FiberCondVar::notify_one() {
+    guard_.lock();
+    FiberWaiter* w = waiters_.pop();
+    guard_.unlock();
+    if(w) {
+        w->wake();
+    }
+}
+
+void FiberCondVar::notify_all() {
+    guard_.lock();
+    FiberWaiter* w = waiters_.popAll();
+    guard_.unlock();
+    WakeAll(w);
+}
+
+SyncStats FiberCondVar::getStats() const {
+    SyncStats stats;
+    stats.parked = n_parked_;
+    return stats;
+}
+
+void FiberSemaphore::wait() {
+    if(try_wait()) {
+        return;
+    }
+    guard_.lock();
+    if(try_wait()) {
+        guard_.unlock();
+        return;
+    }
+    ++n_parked_;
+    // post把计数直接交给当前协程
+    Park(guard_, waiters_);
+}
+
+bool FiberSemaphore::try_wait() {
+    uint32_t count = count_.load(std::memory_order_relaxed);
+    while(count) {
+        if(count_.compare_exchange_weak(count, count - 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberSemaphore::post() {
+    guard_.lock();
+    FiberWaiter* w = waiters_.pop();
+    if(!w) {
+        count_.fetch_add(1, std::memory_order_release);
+    }
+    guard_.unlock();
+    if(w) {
+        w->wake();
+    }
+}
+
+SyncStats FiberSemaphore::getStats() const {
+    SyncStats stats;
+    stats.parked = n_parked_;
+    return stats;
+}
+
+void FiberRWMutex::lock() {
+    guard_.lock();
+    if(!writer_ && !readers_) {
+        writer_ = true;
+        guard_.unlock();
+        return;
+    }
+    ++n_parked_;
+    // 解锁方设置writer_后唤醒
+    Park(guard_, writeQueue_);
+}
+
+bool FiberRWMutex::try_lock() {
+    std::unique_lock lock(guard_);
+    if(writer_ || readers_) {
+        return false;
+    }
+    writer_ = true;
+    return true;
+}
+
+void FiberRWMutex::unlock() {
+    guard_.lock();
+    assert(writer_);
+    writer_ = false;
+    FiberWaiter* w = nullptr;
+    if(!readQueue_.empty()) {
+        w = readQueue_.popAll();
+        for(FiberWaiter* r = w; r; r = r->next) {
+            ++readers_;
+        }
+    } else {
+        w = writeQueue_.pop();
+        if(w) {
+            w->next = nullptr;
+            writer_ = true;
+        }
+    }
+    guard_.unlock();
+    WakeAll(w);
+}
+
+void FiberRWMutex::lock_shared() {
+    guard_.lock();
+    if(!writer_ && writeQueue_.empty()) {
+        ++readers_;
+        guard_.unlock();
+        return;
+    }
+    ++n_parked_;
+    // 解锁方增加readers_后唤醒
+    Park(guard_, readQueue_);
+}
+
+bool FiberRWMutex::try_lock_shared() {
+    std::unique_lock lock(guard_);
+    if(writer_ || !writeQueue_.empty()) {
+        return false;
+    }
+    ++readers_;
+    return true;
+}
+
+void FiberRWMutex::unlock_shared() {
+    guard_.lock();
+    assert(readers_ > 0);
+    FiberWaiter* w = nullptr;
+    if(!--readers_) {
+        w = writeQueue_.pop();
+        if(w) {
+            writer_ = true;
+        }
+    }
+    guard_.unlock();
+    if(w) {
+        w->wake();
+    }
+}
+
+SyncStats FiberRWMutex::getStats() const {
+    SyncStats stats;
+    stats.parked = n_parked_;
+    return stats;
+}
+
+}
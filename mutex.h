@@ -0,0 +1,312 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <sched.h>
+
+namespace fisher {
+
+class Fiber;
+class Scheduler;
+
+/**
+ * @brief 自旋锁
+ * @details 只占一个字节,用于临界区很短、需要嵌入紧凑结构体的场景。
+ *          满足BasicLockable,可以配合std::unique_lock使用
+ */
+class SpinLock {
+public:
+    SpinLock() = default;
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+
+    /**
+     * @brief 加锁,自旋一段时间后让出CPU
+     */
+    void lock() {
+        for(int spins = 0; locked_.exchange(true, std::memory_order_acquire); ++spins) {
+            while(locked_.load(std::memory_order_relaxed)) {
+                if(++spins < 64) {
+#if defined(__x86_64__)
+                    __builtin_ia32_pause();
+#endif
+                } else {
+                    sched_yield();
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief 尝试加锁
+     */
+    bool try_lock() {
+        return !locked_.load(std::memory_order_relaxed)
+            && !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief 解锁
+     */
+    void unlock() {
+        locked_.store(false, std::memory_order_release);
+    }
+private:
+    std::atomic<bool> locked_ = {false};
+};
+
+/**
+ * @brief 协程同步原语的统计信息
+ */
+struct SyncStats {
+    /// 自旋等待后获得的次数
+    uint64_t spun = 0;
+    /// 挂起协程等待的次数
+    uint64_t parked = 0;
+};
+
+/**
+ * @brief 挂起在同步原语上的协程,位于该协程的栈上
+ */
+struct FiberWaiter {
+    /// 等待的协程
+    std::shared_ptr<Fiber> fiber;
+    /// 协程所属的调度器
+    Scheduler* scheduler = nullptr;
+    /// 等待队列中的下一个节点
+    FiberWaiter* next = nullptr;
+
+    /**
+     * @brief 记录当前协程和调度器,之后入队并挂起返回的协程
+     * @details 入队之后fiber随时可能被唤醒方取走,挂起时要使用返回的指针
+     */
+    Fiber* prepare();
+
+    /**
+     * @brief 把协程重新加入调度器,调用之后不能再访问该节点
+     */
+    void wake();
+};
+
+/**
+ * @brief 先进先出的等待队列,由使用者加锁保护
+ */
+class WaitQueue {
+public:
+    /**
+     * @brief 是否为空
+     */
+    bool empty() const { return !head_;}
+
+    /**
+     * @brief 加入队尾
+     */
+    void push(FiberWaiter* w);
+
+    /**
+     * @brief 取出队首
+     * @return 队列为空返回nullptr
+     */
+    FiberWaiter* pop();
+
+    /**
+     * @brief 取出所有节点
+     * @return 原队首,节点之间以next相连
+     */
+    FiberWaiter* popAll();
+
+    /**
+     * @brief 移除指定节点
+     * @return 节点不在队列中返回false
+     */
+    bool remove(FiberWaiter* w);
+private:
+    FiberWaiter* head_ = nullptr;
+    FiberWaiter* tail_ = nullptr;
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 只挂起当前协程,不阻塞工作线程。加锁先自旋一段时间,仍失败再挂起;
+ *          解锁时直接把锁交给队首的协程。只能在调度器的协程中使用,
+ *          满足Lockable,可以配合std::unique_lock使用
+ */
+class FiberMutex {
+public:
+    FiberMutex() = default;
+    FiberMutex(const FiberMutex&) = delete;
+    FiberMutex& operator=(const FiberMutex&) = delete;
+
+    /**
+     * @brief 加锁
+     */
+    void lock();
+
+    /**
+     * @brief 尝试加锁
+     */
+    bool try_lock();
+
+    /**
+     * @brief 解锁
+     */
+    void unlock();
+
+    /**
+     * @brief 返回统计信息
+     */
+    SyncStats getStats() const;
+private:
+    /// 0未加锁,1已加锁,2已加锁且可能有等待者
+    std::atomic<uint32_t> state_ = {0};
+    /// 保护等待队列
+    SpinLock guard_;
+    WaitQueue waiters_;
+    std::atomic<uint64_t> n_spun_ = {0};
+    std::atomic<uint64_t> n_parked_ = {0};
+};
+
+/**
+ * @brief 协程条件变量,配合FiberMutex使用
+ */
+class FiberCondVar {
+public:
+    FiberCondVar() = default;
+    FiberCondVar(const FiberCondVar&) = delete;
+    FiberCondVar& operator=(const FiberCondVar&) = delete;
+
+    /**
+     * @brief 释放锁并挂起当前协程,被唤醒后重新加锁
+     */
+    void wait(std::unique_lock<FiberMutex>& lock);
+
+    /**
+     * @brief 等待直到pred()为true
+     */
+    template<class Predicate>
+    void wait(std::unique_lock<FiberMutex>& lock, Predicate pred) {
+        while(!pred()) {
+            wait(lock);
+        }
+    }
+
+    /**
+     * @brief 唤醒一个等待的协程
+     */
+    void notify_one();
+
+    /**
+     * @brief 唤醒所有等待的协程
+     */
+    void notify_all();
+
+    /**
+     * @brief 返回统计信息
+     */
+    SyncStats getStats() const;
+private:
+    SpinLock guard_;
+    WaitQueue waiters_;
+    std::atomic<uint64_t> n_parked_ = {0};
+};
+
+/**
+ * @brief 协程信号量
+ * @details 有剩余计数时不加锁直接获取;post时有等待者则把计数直接交给队首的协程
+ */
+class FiberSemaphore {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] count 初始计数
+     */
+    explicit FiberSemaphore(uint32_t count = 0)
+        :count_(count) {}
+    FiberSemaphore(const FiberSemaphore&) = delete;
+    FiberSemaphore& operator=(const FiberSemaphore&) = delete;
+
+    /**
+     * @brief 获取一个计数,没有时挂起当前协程
+     */
+    void wait();
+
+    /**
+     * @brief 尝试获取一个计数
+     */
+    bool try_wait();
+
+    /**
+     * @brief 释放一个计数
+     */
+    void post();
+
+    /**
+     * @brief 返回统计信息
+     */
+    SyncStats getStats() const;
+private:
+    std::atomic<uint32_t> count_;
+    SpinLock guard_;
+    WaitQueue waiters_;
+    std::atomic<uint64_t> n_parked_ = {0};
+};
+
+/**
+ * @brief 协程读写锁
+ * @details 写优先:有写者等待时新的读者排队。写锁释放时先放行所有排队的读者,
+ *          没有读者再交给下一个写者。满足SharedMutex,可以配合std::shared_lock使用
+ */
+class FiberRWMutex {
+public:
+    FiberRWMutex() = default;
+    FiberRWMutex(const FiberRWMutex&) = delete;
+    FiberRWMutex& operator=(const FiberRWMutex&) = delete;
+
+    /**
+     * @brief 加写锁
+     */
+    void lock();
+
+    /**
+     * @brief 尝试加写锁
+     */
+    bool try_lock();
+
+    /**
+     * @brief 解写锁
+     */
+    void unlock();
+
+    /**
+     * @brief 加读锁
+     */
+    void lock_shared();
+
+    /**
+     * @brief 尝试加读锁
+     */
+    bool try_lock_shared();
+
+    /**
+     * @brief 解读锁
+     */
+    void unlock_shared();
+
+    /**
+     * @brief 返回统计信息
+     */
+    SyncStats getStats() const;
+private:
+    SpinLock guard_;
+    /// 持有读锁的数量
+    uint32_t readers_ = 0;
+    /// 是否有写者持有锁
+    bool writer_ = false;
+    WaitQueue readQueue_;
+    WaitQueue writeQueue_;
+    std::atomic<uint64_t> n_parked_ = {0};
+};
+
+}
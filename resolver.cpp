@@ -0,0 +1,641 @@
+#include "resolver.h"
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "clock.h"
+#include "fiber.h"
+#include "log.h"
+#include "scheduler.h"
+#include "socket.h"
+#include "util.h"
+
+namespace fisher {
+
+static Logger::LoggerRef g_logger = FISHER_LOG_NAME("system");
+
+/// 缓存时间上限(秒)
+static const uint32_t s_max_ttl = 86400;
+/// 不带EDNS时UDP应答的最大长度
+static const size_t s_max_packet = 512;
+
+enum {
+    DNS_TYPE_A = 1,
+    DNS_TYPE_CNAME = 5,
+    DNS_TYPE_SOA = 6,
+    DNS_CLASS_IN = 1,
+    DNS_RCODE_NXDOMAIN = 3,
+};
+
+static uint16_t GetU16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t GetU32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void PutU16(std::string& s, uint16_t v) {
+    s.push_back(v >> 8);
+    s.push_back(v & 0xff);
+}
+
+/**
+ * @brief 跳过报文中的名字,支持压缩指针
+ * @return 名字不完整或格式错误返回false
+ */
+static bool SkipName(const uint8_t* buf, size_t n, size_t& pos) {
+    while(pos < n) {
+        uint8_t len = buf[pos];
+        if((len & 0xc0) == 0xc0) {
+            if(pos + 2 > n) {
+                return false;
+            }
+            pos += 2;
+            return true;
+        }
+        if(len & 0xc0) {
+            return false;
+        }
+        ++pos;
+        if(!len) {
+            return true;
+        }
+        pos += len;
+    }
+    return false;
+}
+
+/**
+ * @brief 读取报文中的名字,支持压缩指针,转成小写并以点分隔
+ * @param[in, out] pos 名字的位置,返回时指向名字之后
+ * @return 名字不完整、格式错误或压缩指针成环返回false
+ */
+static bool ReadName(const uint8_t* buf, size_t n, size_t& pos, std::string& name) {
+    name.clear();
+    size_t p = pos;
+    bool jumped = false;
+    // 压缩指针最多跟随的次数,防止成环
+    int hops = 0;
+    while(p < n) {
+        uint8_t len = buf[p];
+        if((len & 0xc0) == 0xc0) {
+            if(p + 2 > n || ++hops > 64) {
+                return false;
+            }
+            if(!jumped) {
+                pos = p + 2;
+                jumped = true;
+            }
+            p = ((len & 0x3f) << 8) | buf[p + 1];
+            continue;
+        }
+        if(len & 0xc0) {
+            return false;
+        }
+        ++p;
+        if(!len) {
+            if(!jumped) {
+                pos = p;
+            }
+            return true;
+        }
+        if(p + len > n || name.size() + len + 1 > 255) {
+            return false;
+        }
+        if(!name.empty()) {
+            name.push_back('.');
+        }
+        for(size_t i = 0; i < len; ++i) {
+            name.push_back(tolower(buf[p + i]));
+        }
+        p += len;
+    }
+    return false;
+}
+
+/**
+ * @brief 生成查询name的A记录的报文
+ * @return 名字不合法返回false
+ */
+static bool BuildQuery(const std::string& name, uint16_t id, std::string& out) {
+    if(name.empty() || name.size() > 253) {
+        return false;
+    }
+    out.clear();
+    PutU16(out, id);
+    // 期望递归查询
+    PutU16(out, 0x0100);
+    PutU16(out, 1);
+    PutU16(out, 0);
+    PutU16(out, 0);
+    PutU16(out, 0);
+    size_t begin = 0;
+    while(begin <= name.size()) {
+        size_t end = name.find('.', begin);
+        if(end == std::string::npos) {
+            end = name.size();
+        }
+        size_t len = end - begin;
+        if(!len || len > 63) {
+            return false;
+        }
+        out.push_back(len);
+        out.append(name, begin, len);
+        begin = end + 1;
+    }
+    out.push_back(0);
+    PutU16(out, DNS_TYPE_A);
+    PutU16(out, DNS_CLASS_IN);
+    return true;
+}
+
+/**
+ * @brief 应答的解析结果
+ */
+struct Answer {
+    int rcode = 0;
+    std::vector<in_addr> addrs;
+    /// 地址或否定结果可以缓存的秒数
+    uint32_t ttl = 0;
+};
+
+/**
+ * @brief 应答中的资源记录
+ */
+struct Record {
+    std::string owner;
+    uint16_t type;
+    uint32_t ttl;
+    /// rdata在报文中的位置
+    size_t pos;
+    uint16_t rdlen;
+};
+
+/**
+ * @brief 解析应答报文
+ * @details 只接受问题与查询一致的应答。从name开始沿CNAME链查找,
+ *          只有所有者是链上最后一个名字的A记录才作为结果,其他记录忽略
+ * @param[in] name 查询的名字,小写
+ * @return 不是对本次查询的应答或报文格式错误返回false
+ */
+static bool ParseAnswer(const uint8_t* buf, size_t n, uint16_t id
+                        ,const std::string& name, Answer& ans) {
+    if(n < 12 || GetU16(buf) != id || !(buf[2] & 0x80)) {
+        return false;
+    }
+    ans.rcode = buf[3] & 0x0f;
+    uint16_t qdcount = GetU16(buf + 4);
+    uint16_t ancount = GetU16(buf + 6);
+    uint16_t nscount = GetU16(buf + 8);
+    size_t pos = 12;
+    std::string qname;
+    if(qdcount != 1 || !ReadName(buf, n, pos, qname) || pos + 4 > n
+            || qname != name || GetU16(buf + pos) != DNS_TYPE_A
+            || GetU16(buf + pos + 2) != DNS_CLASS_IN) {
+        return false;
+    }
+    pos += 4;
+    std::vector<Record> records;
+    for(uint16_t i = 0; i < ancount; ++i) {
+        Record r;
+        if(!ReadName(buf, n, pos, r.owner) || pos + 10 > n) {
+            return false;
+        }
+        uint16_t cls = GetU16(buf + pos + 2);
+        r.type = GetU16(buf + pos);
+        r.ttl = GetU32(buf + pos + 4);
+        r.rdlen = GetU16(buf + pos + 8);
+        pos += 10;
+        r.pos = pos;
+        if(pos + r.rdlen > n) {
+            return false;
+        }
+        pos += r.rdlen;
+        if(cls == DNS_CLASS_IN && (r.type == DNS_TYPE_A || r.type == DNS_TYPE_CNAME)) {
+            records.push_back(std::move(r));
+        }
+    }
+    // 沿CNAME链找到最终的名字,链上的记录都计入TTL
+    uint32_t ttl = s_max_ttl;
+    std::string target = name;
+    for(size_t hops = 0; hops <= records.size(); ++hops) {
+        auto it = std::find_if(records.begin(), records.end(), [&target](const Record& r) {
+            return r.type == DNS_TYPE_CNAME && r.owner == target;
+        });
+        if(it == records.end()) {
+            break;
+        }
+        size_t p = it->pos;
+        if(!ReadName(buf, n, p, target) || p > it->pos + it->rdlen) {
+            return false;
+        }
+        ttl = std::min(ttl, it->ttl);
+    }
+    for(auto& r : records) {
+        if(r.type == DNS_TYPE_A && r.rdlen == 4 && r.owner == target) {
+            in_addr addr;
+            memcpy(&addr, buf + r.pos, 4);
+            ans.addrs.push_back(addr);
+            ttl = std::min(ttl, r.ttl);
+        }
+    }
+    if(!ans.addrs.empty()) {
+        ans.ttl = ttl;
+        return true;
+    }
+    // 否定结果按authority中SOA的TTL和MINIMUM较小者缓存(RFC 2308),没有SOA不缓存
+    ans.ttl = 0;
+    for(uint16_t i = 0; i < nscount; ++i) {
+        if(!SkipName(buf, n, pos) || pos + 10 > n) {
+            break;
+        }
+        uint16_t type = GetU16(buf + pos);
+        uint32_t rttl = GetU32(buf + pos + 4);
+        uint16_t rdlen = GetU16(buf + pos + 8);
+        pos += 10;
+        if(pos + rdlen > n) {
+            break;
+        }
+        if(type == DNS_TYPE_SOA) {
+            size_t p = pos;
+            if(SkipName(buf, n, p) && SkipName(buf, n, p) && p + 20 <= pos + rdlen) {
+                ans.ttl = std::min(std::min(rttl, GetU32(buf + p + 16)), s_max_ttl);
+            }
+            break;
+        }
+        pos += rdlen;
+    }
+    return true;
+}
+
+static uint16_t RandomId() {
+    static thread_local std::mt19937 s_rng(std::random_device{}());
+    return s_rng();
+}
+
+/**
+ * @brief 转成小写
+ */
+static std::string ToLower(const std::string& s) {
+    std::string rt(s);
+    std::transform(rt.begin(), rt.end(), rt.begin(), [](unsigned char c) {
+        return (char)tolower(c);
+    });
+    return rt;
+}
+
+/**
+ * @brief 唤醒以next相连的所有协程
+ */
+static void WakeAll(FiberWaiter* w) {
+    while(w) {
+        FiberWaiter* next = w->next;
+        w->wake();
+        w = next;
+    }
+}
+
+Resolver::Resolver(const std::string& resolv_conf, const std::string& hosts) {
+    loadResolvConf(resolv_conf);
+    loadHosts(hosts);
+    if(servers_.empty()) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(53);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        servers_.push_back(addr);
+    }
+}
+
+void Resolver::loadResolvConf(const std::string& path) {
+    std::ifstream ifs(path);
+    std::string line;
+    while(std::getline(ifs, line)) {
+        line = line.substr(0, line.find_first_of("#;"));
+        std::istringstream ss(line);
+        std::string key;
+        if(!(ss >> key)) {
+            continue;
+        }
+        if(key == "nameserver") {
+            std::string ip;
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(53);
+            // IPv6的nameserver暂不支持
+            if(ss >> ip && inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) == 1) {
+                servers_.push_back(addr);
+            }
+        } else if(key == "search" || key == "domain") {
+            search_.clear();
+            std::string domain;
+            while(ss >> domain) {
+                domain = ToLower(domain);
+                while(!domain.empty() && domain.back() == '.') {
+                    domain.pop_back();
+                }
+                if(!domain.empty()) {
+                    search_.push_back(domain);
+                }
+            }
+        } else if(key == "options") {
+            std::string opt;
+            while(ss >> opt) {
+                size_t colon = opt.find(':');
+                if(colon == std::string::npos) {
+                    continue;
+                }
+                std::string name = opt.substr(0, colon);
+                int v = atoi(opt.c_str() + colon + 1);
+                if(name == "timeout" && v > 0) {
+                    timeout_ = v * 1000;
+                } else if(name == "attempts" && v > 0) {
+                    attempts_ = v;
+                } else if(name == "ndots" && v >= 0) {
+                    ndots_ = v;
+                }
+            }
+        }
+    }
+}
+
+void Resolver::loadHosts(const std::string& path) {
+    std::ifstream ifs(path);
+    std::string line;
+    while(std::getline(ifs, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        std::string ip;
+        in_addr addr;
+        if(!(ss >> ip) || inet_pton(AF_INET, ip.c_str(), &addr) != 1) {
+            continue;
+        }
+        std::string name;
+        while(ss >> name) {
+            hosts_[ToLower(name)].push_back(addr);
+        }
+    }
+}
+
+Resolver::Status Resolver::lookup(const std::string& host, std::vector<in_addr>& addrs) {
+    addrs.clear();
+    in_addr addr;
+    if(inet_pton(AF_INET, host.c_str(), &addr) == 1) {
+        addrs.push_back(addr);
+        std::unique_lock lock(guard_);
+        ++stats_.hosts;
+        return SUCCESS;
+    }
+    std::string name = ToLower(host);
+    std::string bare = name;
+    if(!bare.empty() && bare.back() == '.') {
+        bare.pop_back();
+    }
+    if(bare.empty()) {
+        return FAILURE;
+    }
+    auto hit = hosts_.find(bare);
+    if(hit != hosts_.end()) {
+        addrs = hit->second;
+        std::unique_lock lock(guard_);
+        ++stats_.hosts;
+        return SUCCESS;
+    }
+
+    guard_.lock();
+    Entry entry;
+    if(findCache(name, Clock::NowMS(Clock::MONOTONIC), entry)) {
+        ++stats_.hits;
+        guard_.unlock();
+        addrs = std::move(entry.addrs);
+        return entry.status;
+    }
+    ++stats_.misses;
+    auto it = pending_.find(name);
+    if(it != pending_.end()) {
+        if(Scheduler::GetThis()) {
+            ++stats_.coalesced;
+            std::shared_ptr<Pending> pending = it->second;
+            FiberWaiter waiter;
+            Fiber* self = waiter.prepare();
+            pending->waiters.push(&waiter);
+            guard_.unlock();
+            self->yeild();
+            // 唤醒前结果已经写好,之后不再修改
+            addrs = pending->result.addrs;
+            return pending->result.status;
+        }
+        // 不在协程中无法挂起,自己查询,不影响正在进行的查询
+        guard_.unlock();
+        entry = resolve(name);
+        addrs = std::move(entry.addrs);
+        return entry.status;
+    }
+    std::shared_ptr<Pending> pending = std::make_shared<Pending>();
+    pending_[name] = pending;
+    guard_.unlock();
+
+    entry = resolve(name);
+
+    guard_.lock();
+    if(entry.expire > Clock::NowMS(Clock::MONOTONIC)) {
+        addCache(name, entry);
+    }
+    pending_.erase(name);
+    pending->result = entry;
+    FiberWaiter* w = pending->waiters.popAll();
+    guard_.unlock();
+    WakeAll(w);
+    addrs = std::move(entry.addrs);
+    return entry.status;
+}
+
+Resolver::Entry Resolver::resolve(const std::string& name) {
+    std::vector<std::string> names;
+    if(name.back() == '.') {
+        names.push_back(name.substr(0, name.size() - 1));
+    } else {
+        int dots = std::count(name.begin(), name.end(), '.');
+        if(dots >= ndots_) {
+            names.push_back(name);
+        }
+        for(auto& i : search_) {
+            names.push_back(name + "." + i);
+        }
+        if(dots < ndots_) {
+            names.push_back(name);
+        }
+    }
+    Entry entry;
+    uint64_t expire = UINT64_MAX;
+    for(auto& i : names) {
+        entry = query(i);
+        if(entry.status == SUCCESS) {
+            return entry;
+        }
+        // 否定结果只有每个候选名字都能缓存时才缓存
+        expire = std::min(expire, entry.expire);
+    }
+    entry.expire = expire;
+    return entry;
+}
+
+Resolver::Entry Resolver::query(const std::string& name) {
+    Entry entry;
+    uint16_t id = RandomId();
+    std::string packet;
+    if(!BuildQuery(name, id, packet)) {
+        FISHER_LOG_DEBUG(g_logger) << "resolve invalid name " << name;
+        return entry;
+    }
+    bool timeout = false;
+    uint8_t buf[s_max_packet];
+    for(int attempt = 0; attempt < attempts_; ++attempt) {
+        for(auto& server : servers_) {
+            // 每次查询用新的socket,源端口由内核随机分配
+            Socket::SocketRef sock = Socket::CreateUDP(std::make_shared<Address>(server));
+            if(!sock->isValid()) {
+                return entry;
+            }
+            fcntl(sock->getSocket(), F_SETFD, FD_CLOEXEC);
+            // 已连接的UDP socket只接收来自该nameserver的报文
+            if(!sock->connect(std::make_shared<Address>(server))
+                    || sock->send(packet.data(), packet.size()) != (int)packet.size()) {
+                continue;
+            }
+            {
+                std::unique_lock lock(guard_);
+                ++stats_.queries;
+            }
+            // 不匹配的报文不延长等待时间,每次recv只等到截止时间
+            uint64_t deadline = Clock::NowMS(Clock::MONOTONIC) + timeout_;
+            Answer ans;
+            bool done = false;
+            while(true) {
+                uint64_t now = Clock::NowMS(Clock::MONOTONIC);
+                int n = -1;
+                if(now < deadline) {
+                    sock->setRecvTimeout(deadline - now);
+                    n = sock->recv(buf, sizeof(buf));
+                } else {
+                    SetErrno(ETIMEDOUT);
+                }
+                if(n < 0) {
+                    int err = GetErrno();
+                    if(err == ETIMEDOUT || err == EAGAIN) {
+                        timeout = true;
+                        std::unique_lock lock(guard_);
+                        ++stats_.timeouts;
+                    }
+                    break;
+                }
+                // 忽略不匹配的报文,继续等待
+                if(ParseAnswer(buf, n, id, name, ans)) {
+                    done = true;
+                    break;
+                }
+                ans = Answer();
+            }
+            sock->close();
+            if(!done) {
+                continue;
+            }
+            if(!ans.addrs.empty()) {
+                entry.status = SUCCESS;
+                entry.addrs = std::move(ans.addrs);
+            } else if(!ans.rcode || ans.rcode == DNS_RCODE_NXDOMAIN) {
+                entry.status = NOT_FOUND;
+            } else {
+                // SERVFAIL/REFUSED等换下一个nameserver
+                FISHER_LOG_DEBUG(g_logger) << "resolve " << name << " rcode=" << ans.rcode;
+                continue;
+            }
+            if(ans.ttl) {
+                entry.expire = Clock::NowMS(Clock::MONOTONIC) + ans.ttl * 1000ull;
+            }
+            return entry;
+        }
+    }
+    entry.status = timeout ? TIMEOUT : FAILURE;
+    FISHER_LOG_DEBUG(g_logger) << "resolve " << name << " failed status=" << entry.status;
+    return entry;
+}
+
+bool Resolver::findCache(const std::string& name, uint64_t now, Entry& entry) {
+    auto it = cache_.find(name);
+    if(it == cache_.end()) {
+        return false;
+    }
+    if(it->second->entry.expire <= now) {
+        lru_.erase(it->second);
+        cache_.erase(it);
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    entry = it->second->entry;
+    return true;
+}
+
+void Resolver::addCache(const std::string& name, const Entry& entry) {
+    auto it = cache_.find(name);
+    if(it != cache_.end()) {
+        it->second->entry = entry;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+    if(!max_cached_) {
+        return;
+    }
+    while(cache_.size() >= max_cached_) {
+        cache_.erase(lru_.back().name);
+        lru_.pop_back();
+    }
+    lru_.push_front(CacheNode{name, entry});
+    cache_[name] = lru_.begin();
+}
+
+void Resolver::setServers(const std::vector<sockaddr_in>& servers) {
+    servers_ = servers;
+}
+
+void Resolver::setTimeout(uint64_t ms) {
+    timeout_ = ms;
+}
+
+void Resolver::setAttempts(int v) {
+    attempts_ = v > 0 ? v : 1;
+}
+
+void Resolver::setMaxCached(size_t v) {
+    std::unique_lock lock(guard_);
+    max_cached_ = v;
+    while(cache_.size() > max_cached_) {
+        cache_.erase(lru_.back().name);
+        lru_.pop_back();
+    }
+}
+
+void Resolver::clearCache() {
+    std::unique_lock lock(guard_);
+    cache_.clear();
+    lru_.clear();
+}
+
+Resolver::Stats Resolver::getStats() {
+    std::unique_lock lock(guard_);
+    Stats stats = stats_;
+    stats.cached = cache_.size();
+    return stats;
+}
+
+}
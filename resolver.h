@@ -0,0 +1,197 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "mutex.h"
+#include "singleton.h"
+
+namespace fisher {
+
+/**
+ * @brief 异步DNS解析器
+ * @details 通过hook后的UDP socket查询A记录,在调度器的协程中只挂起当前协程。
+ *          先查hosts文件,再查带TTL的LRU缓存,都未命中才向nameserver发送查询;
+ *          同一个名字并发的查询合并为一次,其余协程等待第一次查询的结果。
+ *          否定结果(NXDOMAIN/没有记录)按SOA的TTL缓存
+ */
+class Resolver {
+public:
+    /**
+     * @brief 解析结果
+     */
+    enum Status {
+        /// 成功
+        SUCCESS = 0,
+        /// 名字不存在或没有A记录
+        NOT_FOUND,
+        /// 所有nameserver都超时
+        TIMEOUT,
+        /// 名字不合法、nameserver拒绝或返回错误
+        FAILURE,
+    };
+
+    /**
+     * @brief 解析器统计信息
+     */
+    struct Stats {
+        /// 命中hosts文件或本身就是数字地址的次数
+        uint64_t hosts = 0;
+        /// 命中缓存的次数
+        uint64_t hits = 0;
+        /// 未命中缓存的次数
+        uint64_t misses = 0;
+        /// 合并到其他协程正在进行的查询的次数
+        uint64_t coalesced = 0;
+        /// 发送的查询报文数量
+        uint64_t queries = 0;
+        /// 等待应答超时的次数
+        uint64_t timeouts = 0;
+        /// 当前缓存的名字数量
+        uint64_t cached = 0;
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] resolv_conf resolv.conf路径,读取nameserver/search/options
+     * @param[in] hosts hosts文件路径
+     */
+    Resolver(const std::string& resolv_conf = "/etc/resolv.conf"
+            ,const std::string& hosts = "/etc/hosts");
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    /**
+     * @brief 解析主机名的IPv4地址
+     * @details 在调度器的协程中只挂起当前协程,否则阻塞当前线程
+     * @param[in] host 主机名或点分十进制地址
+     * @param[out] addrs 解析到的地址,按应答中的顺序
+     */
+    Status lookup(const std::string& host, std::vector<in_addr>& addrs);
+
+    /**
+     * @brief 替换nameserver,用于指定本地的DNS服务
+     * @details 以下设置都应在开始解析之前调用
+     */
+    void setServers(const std::vector<sockaddr_in>& servers);
+
+    /**
+     * @brief 设置等待每个nameserver应答的超时时间(毫秒)
+     */
+    void setTimeout(uint64_t ms);
+
+    /**
+     * @brief 设置轮询所有nameserver的次数
+     */
+    void setAttempts(int v);
+
+    /**
+     * @brief 设置最多缓存的名字数量,超过时淘汰最久未使用的
+     */
+    void setMaxCached(size_t v);
+
+    /**
+     * @brief 清空缓存
+     */
+    void clearCache();
+
+    /**
+     * @brief 返回统计信息
+     */
+    Stats getStats();
+private:
+    /**
+     * @brief 一个名字的解析结果
+     */
+    struct Entry {
+        Status status = FAILURE;
+        std::vector<in_addr> addrs;
+        /// 过期时间(毫秒)
+        uint64_t expire = 0;
+    };
+
+    /**
+     * @brief 进行中的查询,后到的协程在这里等待结果
+     */
+    struct Pending {
+        Entry result;
+        /// 等待结果的协程
+        WaitQueue waiters;
+    };
+
+    /**
+     * @brief 缓存节点
+     */
+    struct CacheNode {
+        std::string name;
+        Entry entry;
+    };
+
+    /**
+     * @brief 读取resolv.conf
+     */
+    void loadResolvConf(const std::string& path);
+
+    /**
+     * @brief 读取hosts文件
+     */
+    void loadHosts(const std::string& path);
+
+    /**
+     * @brief 按search列表依次查询,返回第一个成功或最后一个结果
+     */
+    Entry resolve(const std::string& name);
+
+    /**
+     * @brief 向nameserver查询一个完整的名字
+     */
+    Entry query(const std::string& name);
+
+    /**
+     * @brief 在缓存中查找未过期的结果并移到最前
+     * @pre 持有guard_
+     */
+    bool findCache(const std::string& name, uint64_t now, Entry& entry);
+
+    /**
+     * @brief 加入缓存,必要时淘汰最久未使用的
+     * @pre 持有guard_
+     */
+    void addCache(const std::string& name, const Entry& entry);
+private:
+    /// nameserver地址
+    std::vector<sockaddr_in> servers_;
+    /// 不是完整名字时依次尝试的后缀
+    std::vector<std::string> search_;
+    /// 名字中的点少于ndots时先尝试search后缀
+    int ndots_ = 1;
+    /// 每个nameserver的超时时间(毫秒)
+    uint64_t timeout_ = 5000;
+    /// 轮询所有nameserver的次数
+    int attempts_ = 2;
+    /// hosts文件中的名字,都是小写
+    std::unordered_map<std::string, std::vector<in_addr> > hosts_;
+
+    /// 保护以下成员
+    SpinLock guard_;
+    /// 最近使用的在前
+    std::list<CacheNode> lru_;
+    std::unordered_map<std::string, std::list<CacheNode>::iterator> cache_;
+    /// 最多缓存的名字数量
+    size_t max_cached_ = 1024;
+    /// 进行中的查询
+    std::unordered_map<std::string, std::shared_ptr<Pending> > pending_;
+    /// 统计信息
+    Stats stats_;
+};
+
+/// 默认DNS解析器单例,使用系统的resolv.conf和hosts
+typedef Singleton<Resolver> ResolverMgr;
+
+}
@@ -1,4 +1,7 @@
+#include <cassert>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
 #include "scheduler.h"
 #include "log.h"
 // #include "macro.h"
@@ -13,6 +16,38 @@ static thread_local Fiber::FiberRef t_mainfiber = nullptr;
 
 static thread_local uint64_t tid = 0;
 static thread_local std::string t_name = "thr m";
+/// 当前线程在所属调度器中的下标,-1表示非工作线程
+static thread_local int t_worker = -1;
+
+/// 一次从注入队列中最多搬到本地队列的协程数量
+static const size_t s_inject_batch = 16;
+/// 本地队列的容量
+static const size_t s_queue_capacity = 4096;
+/// runner一次最多连续执行的回调数量,之后切回调度协程执行其他协程
+static const size_t s_callback_batch = 64;
+
+/**
+ * @brief 执行调度的回调,抛出的异常记录日志后丢弃
+ * @details runner中执行和包装为协程执行的回调都经过这里,异常的处理不取决于回调在哪里执行
+ */
+static void InvokeCallback(std::function<void()>& cb) {
+    try {
+        cb();
+    } catch (std::exception& ex) {
+        FISHER_LOG_ERROR(g_logger) << "callback except: " << ex.what()
+            << " fiber_id=" << Fiber::GetFiberId();
+    } catch (...) {
+        FISHER_LOG_ERROR(g_logger) << "callback except: unknown exception"
+            << " fiber_id=" << Fiber::GetFiberId();
+    }
+}
+
+/**
+ * @brief 把回调包装为协程,协程总是正常结束
+ */
+static Fiber::FiberRef WrapCallback(std::function<void()> cb) {
+    return FiberPool::Acquire([cb = std::move(cb)]() mutable { InvokeCallback(cb);});
+}
 
 uint64_t Scheduler::GetThreadId() {
     return tid;
@@ -27,6 +62,9 @@ Scheduler::Scheduler(size_t threads, const std::string& name)
     :name_(name), n_thread_(threads) {
     // SYLAR_ASSERT(threads > 0);
     threadpool_.resize(n_thread_);
+    for(size_t i = 0; i < n_thread_; ++i) {
+        workers_.emplace_back(new Worker(s_queue_capacity));
+    }
 }
 
 Scheduler::~Scheduler() {
@@ -52,8 +90,50 @@ void Scheduler::start() {
             [=] {
                 tid = i + 1;
                 t_name = "thr " + std::to_string(i + 1);
+                t_worker = i;
                 run();
             });
+        applyCpuAffinity(i);
+    }
+}
+
+void Scheduler::setCpuAffinity(bool v) {
+    std::unique_lock ul(latch_);
+    cpu_affinity_ = v;
+    for(size_t i = 0; i < threadpool_.size(); ++i) {
+        applyCpuAffinity(i);
+    }
+}
+
+void Scheduler::applyCpuAffinity(size_t i) {
+    if(!threadpool_[i].joinable()) {
+        return;
+    }
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if(cpu_affinity_) {
+        std::vector<int> ids;
+        for(int c = 0; c < CPU_SETSIZE; ++c) {
+            if(CPU_ISSET(c, &allowed)) {
+                ids.push_back(c);
+            }
+        }
+        if(ids.empty()) {
+            return;
+        }
+        CPU_SET(ids[i % ids.size()], &cpus);
+    } else {
+        cpus = allowed;
+    }
+    int rt = pthread_setaffinity_np(threadpool_[i].native_handle(), sizeof(cpus), &cpus);
+    if(rt) {
+        FISHER_LOG_ERROR(g_logger) << "pthread_setaffinity_np thread=" << i + 1
+            << " rt=" << rt;
     }
 }
 
@@ -61,12 +141,12 @@ void Scheduler::stop() {
     auto_stop_ = true;
     // SYLAR_ASSERT(GetThis() != this);
     try_stop_ = true;
-    for(size_t i = 0; i < n_thread_; ++i) {
-        tickle();
-        sleep(1);
-    }
+    // 工作线程把队列中剩余的协程执行完后退出idle,最先退出的线程会再次通知其他线程
+    tickleAll();
     for(auto & i : threadpool_) {
-        i.join();
+        if(i.joinable()) {
+            i.join();
+        }
     }
 }
 
@@ -78,72 +158,537 @@ Fiber::FiberRef Scheduler::GetMainFiber() {
     return t_mainfiber;
 }
 
+int Scheduler::getWorkerIndex() {
+    return GetThis() == this ? t_worker : -1;
+}
+
+bool Scheduler::isIdleThread(int thread) {
+    if(thread < 1 || thread > (int)workers_.size()) {
+        return hasIdleThreads();
+    }
+    return workers_[thread - 1]->idle;
+}
+
+Fiber* Scheduler::RetainFiber(Fiber::FiberRef fbr) {
+    Fiber* f = fbr.get();
+    f->self_ = std::move(fbr);
+    return f;
+}
+
+Fiber::FiberRef Scheduler::ReleaseFiber(Fiber* f) {
+    return std::move(f->self_);
+}
+
+bool Scheduler::DeferWake(Fiber* f, int thread) {
+    if(f->state_.load(std::memory_order_relaxed) != Fiber::EXEC) {
+        return false;
+    }
+    // 一次挂起只有一个唤醒方,在READY可见之前写入
+    f->wakeThread_ = thread;
+    Fiber::State state = Fiber::EXEC;
+    return f->state_.compare_exchange_strong(state, Fiber::READY);
+}
+
+void Scheduler::switchedOut(Fiber::FiberRef fbr) {
+    Fiber::State state = Fiber::EXEC;
+    if(fbr->state_.compare_exchange_strong(state, Fiber::HOLD)) {
+        return;
+    }
+    if(state == Fiber::READY) {
+        int thread = fbr->wakeThread_;
+        schedule(std::move(fbr), thread);
+    } else if(state == Fiber::TERM || state == Fiber::EXCEPT) {
+        FiberPool::Recycle(std::move(fbr));
+    }
+}
+
+bool Scheduler::scheduleNoLock(Fiber::FiberRef fbr, int thread) {
+    if(DeferWake(fbr.get(), thread)) {
+        return false;
+    }
+    Fiber* f = fbr.get();
+    f->self_ = std::move(fbr);
+    int self = getWorkerIndex();
+    if(thread >= 1 && thread <= (int)workers_.size()) {
+        Worker& worker = *workers_[thread - 1];
+        if(thread - 1 == self) {
+            worker.local.push_back(f);
+        } else {
+            std::unique_lock ul(worker.mailbox_mutex);
+            worker.mailbox.push_back(f);
+        }
+        ++worker.n_pinned;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return thread - 1 != self && worker.idle;
+    }
+
+    if(self < 0 || !workers_[self]->queue.push(f)) {
+        std::unique_lock ul(latch_);
+        inject_list_.push_back(f);
+        ++n_injected_;
+    }
+    // 与run()中空闲前的检查配对,保证不会丢失唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return hasIdleThreads();
+}
+
+bool Scheduler::scheduleNoLock(std::function<void()> cb, int thread) {
+    int self = getWorkerIndex();
+    if(thread != -1) {
+        return scheduleNoLock(WrapCallback(std::move(cb)), thread);
+    }
+    if(self < 0) {
+        // 协程缓存是线程本地的,在非工作线程上创建的协程回收到工作线程后不会再回来,
+        // 每次都要重新分配栈,所以交给工作线程的runner执行
+        {
+            std::unique_lock ul(latch_);
+            inject_callbacks_.push_back(std::move(cb));
+            ++n_injected_callbacks_;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return hasIdleThreads();
+    }
+    Worker& worker = *workers_[self];
+    {
+        std::unique_lock lock(worker.callbacks_mutex);
+        worker.callbacks.push_back(std::move(cb));
+        ++worker.n_callbacks;
+    }
+    // 与run()中空闲前的检查配对,空闲线程可以窃取回调
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return hasIdleThreads();
+}
+
+Scheduler::Batch& Scheduler::GetBatch() {
+    static thread_local Batch s_batch;
+    return s_batch;
+}
+
+size_t Scheduler::scheduleBatchNoLock(Batch& batch, int thread) {
+    int self = getWorkerIndex();
+    bool pinned = thread >= 1 && thread <= (int)workers_.size();
+    if(pinned) {
+        // 指定线程的回调包装为协程放入该线程的mailbox
+        for(auto& cb : batch.callbacks) {
+            batch.fibers.push_back(RetainFiber(WrapCallback(std::move(cb))));
+        }
+        batch.callbacks.clear();
+    }
+    size_t n = batch.fibers.size() + batch.callbacks.size();
+    if(!n) {
+        return 0;
+    }
+
+    if(pinned) {
+        Worker& worker = *workers_[thread - 1];
+        if(thread - 1 == self) {
+            worker.local.insert(worker.local.end(), batch.fibers.begin(), batch.fibers.end());
+        } else {
+            std::unique_lock ul(worker.mailbox_mutex);
+            worker.mailbox.insert(worker.mailbox.end(), batch.fibers.begin(), batch.fibers.end());
+        }
+        worker.n_pinned += n;
+        batch.fibers.clear();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return thread - 1 != self && worker.idle ? 1 : 0;
+    }
+
+    if(!batch.callbacks.empty() && self < 0) {
+        std::unique_lock ul(latch_);
+        for(auto& cb : batch.callbacks) {
+            inject_callbacks_.push_back(std::move(cb));
+        }
+        n_injected_callbacks_ += batch.callbacks.size();
+        batch.callbacks.clear();
+    } else if(!batch.callbacks.empty()) {
+        Worker& worker = *workers_[self];
+        std::unique_lock lock(worker.callbacks_mutex);
+        for(auto& cb : batch.callbacks) {
+            worker.callbacks.push_back(std::move(cb));
+        }
+        worker.n_callbacks += batch.callbacks.size();
+        batch.callbacks.clear();
+    }
+    auto it = batch.fibers.begin();
+    if(self >= 0) {
+        while(it != batch.fibers.end() && workers_[self]->queue.push(*it)) {
+            ++it;
+        }
+    }
+    if(it != batch.fibers.end()) {
+        std::unique_lock ul(latch_);
+        n_injected_ += batch.fibers.end() - it;
+        inject_list_.insert(inject_list_.end(), it, batch.fibers.end());
+    }
+    batch.fibers.clear();
+    // 与run()中空闲前的检查配对,保证不会丢失唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return hasIdleThreads() ? n : 0;
+}
+
+bool Scheduler::popCallback(Worker& worker, std::function<void()>& cb) {
+    if(!worker.n_callbacks.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    std::unique_lock lock(worker.callbacks_mutex);
+    if(worker.callbacks.empty()) {
+        return false;
+    }
+    cb = std::move(worker.callbacks.front());
+    worker.callbacks.pop_front();
+    --worker.n_callbacks;
+    return true;
+}
+
+bool Scheduler::stealCallbacks() {
+    static thread_local std::vector<std::function<void()>> s_stolen;
+    size_t n = workers_.size();
+    for(size_t i = 1; i < n; ++i) {
+        Worker& victim = *workers_[(t_worker + i) % n];
+        if(!victim.n_callbacks.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        {
+            // 不同时持有两个线程的锁,避免互相窃取时死锁
+            std::unique_lock lock(victim.callbacks_mutex);
+            size_t take = std::min((victim.callbacks.size() + 1) / 2, s_inject_batch);
+            for(size_t k = 0; k < take; ++k) {
+                s_stolen.push_back(std::move(victim.callbacks.front()));
+                victim.callbacks.pop_front();
+            }
+            victim.n_callbacks -= take;
+        }
+        if(s_stolen.empty()) {
+            continue;
+        }
+        Worker& worker = *workers_[t_worker];
+        std::unique_lock lock(worker.callbacks_mutex);
+        for(auto& cb : s_stolen) {
+            worker.callbacks.push_back(std::move(cb));
+        }
+        worker.n_callbacks += s_stolen.size();
+        s_stolen.clear();
+        return true;
+    }
+    return false;
+}
+
+__attribute__((noinline)) Scheduler::Worker* Scheduler::currentWorker() {
+    int idx = getWorkerIndex();
+    return idx >= 0 ? workers_[idx].get() : nullptr;
+}
+
+void Scheduler::callbackMain() {
+    Fiber* self = Fiber::GetThis().get();
+    while(true) {
+        Worker* worker = currentWorker();
+        if(!worker || worker->runner.get() != self) {
+            // 已转为普通协程,或者调度线程退出
+            return;
+        }
+        std::function<void()> cb;
+        for(size_t i = 0; i < s_callback_batch && popCallback(*worker, cb); ++i) {
+            worker->in_callback = true;
+            InvokeCallback(cb);
+            cb = nullptr;
+            // 回调中挂起过的话,当前可能已在其他线程上,也不再是runner
+            worker = currentWorker();
+            if(!worker || worker->runner.get() != self) {
+                return;
+            }
+            worker->in_callback = false;
+        }
+        self->yeild();
+    }
+}
+
+void Scheduler::runCallbacks(Worker& worker) {
+    if(!worker.runner) {
+        worker.runner = FiberPool::Acquire([this]() { callbackMain(); });
+    }
+    Fiber::FiberRef runner = worker.runner;
+    ++n_active_thread_;
+    runner->call();
+    if(worker.in_callback) {
+        // 回调挂起了,runner转为普通协程,由它等待的事件负责恢复
+        worker.in_callback = false;
+        worker.runner.reset();
+    }
+    if(runner->getState() == Fiber::TERM || runner->getState() == Fiber::EXCEPT) {
+        worker.runner.reset();
+    }
+    // 唤醒推迟到切出后的协程入队之后才不再算作活跃
+    switchedOut(std::move(runner));
+    --n_active_thread_;
+}
+
+Fiber* Scheduler::popPinned() {
+    if(t_worker < 0) {
+        return nullptr;
+    }
+    Worker& worker = *workers_[t_worker];
+    if(!worker.n_pinned) {
+        return nullptr;
+    }
+    Fiber* f = nullptr;
+    if(!worker.local.empty()) {
+        f = worker.local.front();
+        worker.local.pop_front();
+    } else {
+        std::unique_lock ul(worker.mailbox_mutex);
+        if(worker.mailbox.empty()) {
+            return nullptr;
+        }
+        f = worker.mailbox.front();
+        worker.mailbox.pop_front();
+    }
+    --worker.n_pinned;
+    return f;
+}
+
+Fiber* Scheduler::popInjected() {
+    if(!n_injected_) {
+        return nullptr;
+    }
+    std::unique_lock ul(latch_);
+    if(inject_list_.empty()) {
+        return nullptr;
+    }
+    Fiber* f = inject_list_.front();
+    inject_list_.pop_front();
+    --n_injected_;
+    if(t_worker >= 0) {
+        auto& queue = workers_[t_worker]->queue;
+        for(size_t i = 0; i < s_inject_batch && !inject_list_.empty(); ++i) {
+            if(!queue.push(inject_list_.front())) {
+                break;
+            }
+            inject_list_.pop_front();
+            --n_injected_;
+        }
+    }
+    return f;
+}
+
+void Scheduler::popInjectedCallbacks(Worker& worker) {
+    std::unique_lock ul(latch_);
+    size_t take = std::min(inject_callbacks_.size(), s_callback_batch);
+    if(!take) {
+        return;
+    }
+    std::unique_lock lock(worker.callbacks_mutex);
+    for(size_t i = 0; i < take; ++i) {
+        worker.callbacks.push_back(std::move(inject_callbacks_.front()));
+        inject_callbacks_.pop_front();
+    }
+    // 先增加本线程的计数,搬运期间回调始终可见
+    worker.n_callbacks += take;
+    n_injected_callbacks_ -= take;
+}
+
+Fiber* Scheduler::steal() {
+    static thread_local uint64_t s_seed = (uint64_t)this ^ (tid + 1) * 0x9E3779B97F4A7C15ull;
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 7;
+    s_seed ^= s_seed << 17;
+    size_t n = workers_.size();
+    size_t start = s_seed % n;
+    for(size_t i = 0; i < n; ++i) {
+        size_t victim = (start + i) % n;
+        if((int)victim == t_worker) {
+            continue;
+        }
+        if(Fiber* f = workers_[victim]->queue.steal()) {
+            return f;
+        }
+    }
+    return nullptr;
+}
+
+Fiber::FiberRef Scheduler::nextFiber() {
+    Fiber* f = popPinned();
+    if(!f && t_worker >= 0) {
+        f = workers_[t_worker]->queue.pop();
+    }
+    if(!f) {
+        f = popInjected();
+    }
+    if(!f) {
+        f = steal();
+    }
+    if(!f) {
+        return nullptr;
+    }
+    return std::move(f->self_);
+}
+
+bool Scheduler::hasPendingFibers() {
+    if(n_injected_ || n_injected_callbacks_) {
+        return true;
+    }
+    for(auto& i : workers_) {
+        if(!i->queue.empty() || i->n_pinned || i->n_callbacks) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Scheduler::hasWork() {
+    if(n_injected_ || n_injected_callbacks_ || workers_[t_worker]->n_pinned) {
+        return true;
+    }
+    for(auto& i : workers_) {
+        if(!i->queue.empty() || i->n_callbacks) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Scheduler::run() {
     FISHER_LOG_INFO(g_logger) << name_ << " run";
     set_hook_enable(true);
     setThis();
     t_mainfiber.reset(new Fiber());
     Fiber::FiberRef idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+    Worker& worker = *workers_[t_worker];
+    // 是否从idle返回后还没有执行过任务
+    bool idled = false;
     while(true) {
-        bool is_active = false;
-        Fiber::FiberRef fbr;
-        {
-            // get a fiber from list
-            std::unique_lock ul(latch_);
-            for (auto it = fiber_list_.begin(); it != fiber_list_.end(); it++) {
-                if ((*it)->getState() != Fiber::EXEC) {
-                    fbr = std::move(*it);
-                    fiber_list_.erase(it++);
-                    is_active = true;
-                    n_active_thread_++;
-                    break;
-                }
+        bool ran_callbacks = false;
+        if(!worker.n_callbacks && n_injected_callbacks_) {
+            popInjectedCallbacks(worker);
+        }
+        if(worker.n_callbacks) {
+            if(idled) {
+                idled = false;
+                onBusy();
             }
+            runCallbacks(worker);
+            ran_callbacks = true;
         }
-        
-        if (is_active) {
-            if (fbr->getState() != Fiber::TERM && fbr->getState() != Fiber::EXCEPT) {
-                fbr->call();
-                // return
-                --n_active_thread_;
-                if (fbr->getState() == Fiber::READY) {
-                    schedule(std::move(fbr));
-                } else if (fbr->getState() != Fiber::TERM && fbr->getState() != Fiber::EXCEPT) {
-                    fbr->state_ = Fiber::HOLD;
-                }
-            // fbr has termed or ex
-            } else {
+        // 协程从队列取出到切出后重新入队期间不在任何队列中,这段时间都算作活跃,
+        // 否则其他线程可能判断可以停止并退出,之后指定到这些线程的协程无法执行
+        ++n_active_thread_;
+        Fiber::FiberRef fbr = nextFiber();
+        if(fbr) {
+            // 执行中被唤醒的协程由DeferWake推迟到切出后入队,队列中不会有EXEC的协程
+            assert(fbr->getState() != Fiber::EXEC);
+            if(fbr->getState() == Fiber::TERM || fbr->getState() == Fiber::EXCEPT) {
                 --n_active_thread_;
+                continue;
             }
+            if(idled) {
+                idled = false;
+                onBusy();
+            }
+            fbr->call();
+            switchedOut(std::move(fbr));
+            --n_active_thread_;
+            continue;
+        }
+        // 窃取的回调同样有一段时间不在任何队列中
+        bool stolen = !ran_callbacks && stealCallbacks();
+        --n_active_thread_;
+
+        if(ran_callbacks || stolen) {
+            continue;
+        }
 
-        } 
         if(idle_fiber->getState() == Fiber::TERM) {
             FISHER_LOG_INFO(g_logger) << "idle fiber term";
+            // 其他线程可能在本线程执行最后一个协程时已经挂起
+            tickleAll();
             break;
         }
 
         ++n_idle_thread_;
+        worker.idle = true;
+        // 与scheduleNoLock中的fence配对,先声明空闲再检查队列
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(hasWork()) {
+            worker.idle = false;
+            --n_idle_thread_;
+            continue;
+        }
         idle_fiber->call();
+        idled = true;
+        worker.idle = false;
         --n_idle_thread_;
         if(idle_fiber->getState() != Fiber::TERM && idle_fiber->getState() != Fiber::EXCEPT) {
             idle_fiber->state_ = Fiber::HOLD;
         }
     }
+    if(worker.runner) {
+        // runner挂起在回调之间,恢复一次让它发现自己不再是runner并结束
+        Fiber::FiberRef runner = std::move(worker.runner);
+        runner->call();
+    }
 }
 
 void Scheduler::tickle() {
-    FISHER_LOG_INFO(g_logger) << "tickle";
+    if(!hasIdleThreads()) {
+        return;
+    }
+    for(size_t i = 0; i < workers_.size(); ++i) {
+        if(workers_[i]->idle) {
+            tickle(i + 1);
+            return;
+        }
+    }
+}
+
+void Scheduler::tickle(int thread) {
+    if(thread < 1 || thread > (int)workers_.size()) {
+        tickle();
+        return;
+    }
+    Worker& worker = *workers_[thread - 1];
+    std::unique_lock lock(worker.idle_mutex);
+    worker.notified = true;
+    worker.idle_cond.notify_one();
+}
+
+void Scheduler::tickleIdle(size_t n) {
+    int self = getWorkerIndex();
+    for(size_t i = 0; n && i < workers_.size() && hasIdleThreads(); ++i) {
+        Worker& worker = *workers_[i];
+        if((int)i == self || !worker.idle) {
+            continue;
+        }
+        std::unique_lock lock(worker.idle_mutex);
+        if(worker.notified) {
+            continue;
+        }
+        worker.notified = true;
+        worker.idle_cond.notify_one();
+        --n;
+    }
+}
+
+void Scheduler::tickleAll() {
+    for(size_t i = 0; i < workers_.size(); ++i) {
+        tickle(i + 1);
+    }
 }
 
 bool Scheduler::stopping() {
-    std::unique_lock ul(latch_);
-    return try_stop_ && fiber_list_.empty() && !n_active_thread_;
+    return try_stop_ && !hasPendingFibers() && !n_active_thread_;
 }
 
 void Scheduler::idle() {
+    Worker& worker = *workers_[t_worker];
     while(!stopping()) {
-        FISHER_LOG_INFO(g_logger) << "...";
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        FiberPool::Shrink();
+        {
+            // notified在检查stopping之后被置位时不挂起,不会丢失唤醒
+            std::unique_lock lock(worker.idle_mutex);
+            if(!worker.notified) {
+                worker.idle_cond.wait_for(lock, std::chrono::seconds(1));
+            }
+            worker.notified = false;
+        }
         Fiber::GetThis()->yeild();
     }
 }
@@ -154,12 +699,15 @@ std::ostream& Scheduler::dump(std::ostream& os) {
        << " active_count=" <<n_active_thread_
        << " idle_count=" << n_idle_thread_
        << " stopping=" << try_stop_
+       << " injected=" << n_injected_
+       << " injected_callbacks=" << n_injected_callbacks_
        << " ]" << std::endl << "    ";
     for(size_t i = 0; i < threadpool_.size(); ++i) {
         if(i) {
             os << ", ";
         }
-        os << threadpool_[i].get_id();
+        os << threadpool_[i].get_id() << "(" << workers_[i]->queue.size()
+           << "/" << workers_[i]->n_pinned << ")";
     }
     return os;
 }
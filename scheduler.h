@@ -7,7 +7,12 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 #include "fiber.h"
+#include "fiberpool.h"
+#include "mutex.h"
+#include "workqueue.h"
 
 namespace fisher {
 
@@ -60,21 +65,51 @@ public:
     /**
      * @brief 调度协程
      * @param[in] fc 协程或函数
-     * @param[in] thread 协程执行的线程id,-1标识任意线程
+     * @param[in] thread 协程执行的线程id(GetThreadId()),-1标识任意线程
+     * @details 指定线程的协程放入该线程的mailbox,不会被其他线程窃取,
+     *          并且只唤醒该线程。不指定线程的回调不创建协程,由工作线程的runner协程执行。
+     *          回调抛出的异常记录日志后丢弃,不论它由runner执行还是包装为协程执行;
+     *          直接调度的协程因异常结束时为EXCEPT状态,异常由join重新抛出
      */
     template<class FiberOrCb>
     void schedule(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = false;
-        {
-            std::unique_lock ul(latch_);
-            need_tickle = scheduleNoLock(fc, thread);
+        if(scheduleNoLock(std::move(fc), thread)) {
+            if(thread == -1) {
+                tickle();
+            } else {
+                tickle(thread);
+            }
         }
-        
-        if(need_tickle) {
-            tickle();
+    }
+
+    /**
+     * @brief 批量调度协程或函数
+     * @param[in] begin,end 协程或函数的迭代器范围,元素被复制,需要转移时使用std::make_move_iterator
+     * @param[in] thread 协程执行的线程id(GetThreadId()),-1标识任意线程
+     * @details 整批任务只加一次锁,并且最多唤醒与任务数量相同的空闲线程
+     */
+    template<class Iterator>
+    void scheduleBatch(Iterator begin, Iterator end, int thread = -1) {
+        Batch& batch = GetBatch();
+        for(; begin != end; ++begin) {
+            addToBatch(batch, *begin, thread);
+        }
+        size_t n = scheduleBatchNoLock(batch, thread);
+        if(n) {
+            if(thread == -1) {
+                tickleIdle(n);
+            } else {
+                tickle(thread);
+            }
         }
     }
 
+    /**
+     * @brief 设置是否将工作线程绑定到CPU
+     * @details 第i个工作线程绑定到第i % N个可用CPU,可在start()前后调用
+     */
+    void setCpuAffinity(bool v);
+
     std::ostream& dump(std::ostream& os);
 
     static uint64_t GetThreadId() ;
@@ -87,6 +122,13 @@ protected:
      */
 
     virtual void tickle();
+
+    /**
+     * @brief 通知指定线程有任务了
+     * @param[in] thread 线程id(GetThreadId())
+     */
+    virtual void tickle(int thread);
+
     /**
      * @brief 协程调度函数
      */
@@ -99,9 +141,36 @@ protected:
 
     /**
      * @brief 协程无任务可调度时执行idle协程
+     * @details 在条件变量上挂起直到tickle或超时,超时用于收缩协程缓存
      */
     virtual void idle();
 
+    /**
+     * @brief 工作线程从idle返回后取到任务、即将执行时调用,每次离开idle只调用一次
+     */
+    virtual void onBusy() {}
+
+    /**
+     * @brief 通知所有工作线程重新检查是否可以停止
+     */
+    void tickleAll();
+
+    /**
+     * @brief 唤醒最多n个空闲线程,不唤醒当前线程
+     */
+    virtual void tickleIdle(size_t n);
+
+    /**
+     * @brief 把协程的引用转移给协程自身,返回裸指针
+     * @details 和调度队列一样,等待事件的协程只保存裸指针,由协程自身持有引用
+     */
+    static Fiber* RetainFiber(Fiber::FiberRef fbr);
+
+    /**
+     * @brief 取回RetainFiber转移给协程自身的引用
+     */
+    static Fiber::FiberRef ReleaseFiber(Fiber* f);
+
     /**
      * @brief 设置当前的协程调度器
      */
@@ -111,26 +180,198 @@ protected:
      * @brief 是否有空闲线程
      */
     bool hasIdleThreads() { return n_idle_thread_ > 0;}
+
+    /**
+     * @brief 指定线程是否空闲
+     * @param[in] thread 线程id(GetThreadId())
+     */
+    bool isIdleThread(int thread);
+
+    /**
+     * @brief 是否还有待执行的协程(近似值)
+     */
+    bool hasPendingFibers();
+
+    /**
+     * @brief 返回当前线程在本调度器中的下标,非工作线程返回-1
+     */
+    int getWorkerIndex();
 private:
     /**
-     * @brief 协程调度启动(无锁)
+     * @brief 工作线程的调度上下文
+     */
+    struct Worker {
+        Worker(size_t capacity) : queue(capacity) {}
+
+        /// 可被其他线程窃取的本地队列
+        WorkStealingQueue<Fiber> queue;
+        /// 其他线程投递的指定在本线程执行的协程
+        std::deque<Fiber*> mailbox;
+        /// mailbox的锁
+        std::mutex mailbox_mutex;
+        /// 本线程投递的指定在本线程执行的协程,只有本线程访问
+        std::deque<Fiber*> local;
+        /// mailbox与local中的协程数量
+        std::atomic<size_t> n_pinned {0};
+        /// 是否空闲
+        std::atomic<bool> idle {false};
+        /// 本线程提交的回调,由runner依次执行,其他线程可以窃取
+        std::deque<std::function<void()>> callbacks;
+        /// callbacks的锁
+        SpinLock callbacks_mutex;
+        /// callbacks中的回调数量
+        std::atomic<size_t> n_callbacks {0};
+        /// 执行回调的协程
+        Fiber::FiberRef runner;
+        /// runner是否正在执行回调,切回调度协程时仍为true说明回调挂起了
+        bool in_callback = false;
+        /// 空闲时挂起线程的锁
+        std::mutex idle_mutex;
+        /// 空闲时挂起线程的条件变量
+        std::condition_variable idle_cond;
+        /// 是否已被tickle,由idle_mutex保护
+        bool notified = false;
+    };
+
+    /**
+     * @brief 协程调度启动
+     * @details 指定线程的放入该线程的mailbox,工作线程放入自己的队列,
+     *          其他线程放入全局注入队列
+     * @return 是否需要tickle
+     */
+    bool scheduleNoLock(Fiber::FiberRef fbr, int thread);
+
+    /**
+     * @brief 调度回调函数
+     * @details 工作线程提交且不指定线程的回调放入本线程的回调队列,由runner协程依次执行,
+     *          不需要为每个回调创建协程;其他线程提交且不指定线程的回调放入全局回调注入队列,
+     *          由工作线程搬到自己的回调队列;指定线程的回调包装为协程后调度
+     * @return 是否需要tickle
+     */
+    bool scheduleNoLock(std::function<void()> cb, int thread);
+
+    /**
+     * @brief 批量调度时暂存的任务
+     */
+    struct Batch {
+        /// 协程,已把引用转移给协程自身
+        std::vector<Fiber*> fibers;
+        /// 回调函数
+        std::vector<std::function<void()>> callbacks;
+    };
+
+    /**
+     * @brief 返回当前线程批量调度用的暂存区
      */
-    bool scheduleNoLock(Fiber::FiberRef fbr, int thread) {
-        bool need_tickle = fiber_list_.empty();
-        fiber_list_.push_back(fbr);
-        return need_tickle;
+    static Batch& GetBatch();
+
+    static void addToBatch(Batch& batch, Fiber::FiberRef fbr, int thread) {
+        if(!DeferWake(fbr.get(), thread)) {
+            batch.fibers.push_back(RetainFiber(std::move(fbr)));
+        }
     }
 
-    bool scheduleNoLock(std::function<void()> cb, int thread) {
-        bool need_tickle = fiber_list_.empty();
-        fiber_list_.emplace_back(std::make_shared<Fiber>(cb));
-        return need_tickle;
+    static void addToBatch(Batch& batch, std::function<void()> cb, int thread) {
+        batch.callbacks.push_back(std::move(cb));
     }
 
+    /**
+     * @brief 唤醒还在执行中的协程(已登记等待、尚未切出)时,只把状态改为READY
+     * @details 执行它的线程切出后发现READY再放入队列,不需要其他线程等待它切出
+     * @param[in] thread 恢复执行的线程id,-1表示任意线程
+     * @return 已改为READY返回true,调用方不能再把协程放入队列
+     */
+    static bool DeferWake(Fiber* f, int thread);
+
+    /**
+     * @brief 协程切回调度协程后挂起、重新调度或回收
+     * @details 与DeferWake竞争:先把EXEC改为HOLD则由唤醒方放入队列,否则由这里放入队列
+     */
+    void switchedOut(Fiber::FiberRef fbr);
+
+    /**
+     * @brief 调度暂存区中的任务并清空暂存区
+     * @details 放入的位置与scheduleNoLock相同,每个队列只加一次锁
+     * @return 需要唤醒的线程数量
+     */
+    size_t scheduleBatchNoLock(Batch& batch, int thread);
+
+    /**
+     * @brief 获取下一个要执行的协程
+     * @details 依次尝试本线程指定的协程,本线程队列,全局注入队列,
+     *          随机窃取其他线程的队列
+     */
+    Fiber::FiberRef nextFiber();
+
+    /**
+     * @brief 从全局注入队列取协程,多取的一部分放入本线程队列
+     */
+    Fiber* popInjected();
+
+    /**
+     * @brief 从全局回调注入队列取一批回调放入本线程的回调队列
+     */
+    void popInjectedCallbacks(Worker& worker);
+
+    /**
+     * @brief 取指定在本线程执行的协程
+     */
+    Fiber* popPinned();
+
+    /**
+     * @brief 从其他线程的队列窃取协程
+     */
+    Fiber* steal();
+
+    /**
+     * @brief 本线程是否有可执行的协程
+     */
+    bool hasWork();
+
+    /**
+     * @brief 取出本线程回调队列中的第一个回调
+     */
+    bool popCallback(Worker& worker, std::function<void()>& cb);
+
+    /**
+     * @brief 从其他线程的回调队列窃取一部分回调
+     */
+    bool stealCallbacks();
+
+    /**
+     * @brief 切换到runner协程执行本线程的回调
+     * @details 回调在runner中挂起时,runner转为普通协程,之后再取一个新的runner
+     */
+    void runCallbacks(Worker& worker);
+
+    /**
+     * @brief runner协程的执行函数
+     */
+    void callbackMain();
+
+    /**
+     * @brief 返回当前线程的调度上下文,非工作线程返回nullptr
+     * @details 协程挂起后可能换了线程,不能内联,每次都重新读取线程局部变量
+     */
+    Worker* currentWorker();
+
+    /**
+     * @brief 按当前设置绑定第i个工作线程的CPU
+     */
+    void applyCpuAffinity(size_t i);
+
     /// 线程池
     std::vector<std::thread> threadpool_;
-    /// 待执行的协程队列
-    std::list<Fiber::FiberRef> fiber_list_;
+    /// 每个工作线程的调度上下文
+    std::vector<std::unique_ptr<Worker>> workers_;
+    /// 全局注入队列,非工作线程调度以及本地队列满时使用
+    std::deque<Fiber*> inject_list_;
+    /// 注入队列中的协程数量
+    std::atomic<size_t> n_injected_ = 0;
+    /// 全局回调注入队列,非工作线程提交的回调不在提交线程上创建协程
+    std::deque<std::function<void()>> inject_callbacks_;
+    /// 回调注入队列中的回调数量
+    std::atomic<size_t> n_injected_callbacks_ = 0;
     /// 协程调度器名称
     std::string name_;
 
@@ -142,10 +383,13 @@ protected:
     /// 空闲线程数量
     std::atomic<size_t> n_idle_thread_ = 0;
     /// 是否正在停止
-    bool try_stop_ = false;
+    std::atomic<bool> try_stop_ = false;
     /// 是否自动停止
     bool auto_stop_ = false;
+    /// 是否将工作线程绑定到CPU
+    bool cpu_affinity_ = false;
 
+    /// 全局注入队列的锁
     std::mutex latch_;
 };
 
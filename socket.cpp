@@ -1,33 +1,18 @@
 #include "socket.h"
-#include "iomanager.h"
+#include <sstream>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
 #include "fdmanager.h"
-#include "log.h"
-#include "macro.h"
 #include "hook.h"
-#include <limits.h>
-#include <sstream>
-#include <netdb.h>
-#include <ifaddrs.h>
-#include <stddef.h>
+#include "iomanager.h"
+#include "log.h"
+#include "resolver.h"
 
 namespace fisher {
 
 static Logger::LoggerRef g_logger = FISHER_LOG_NAME("system");
-static const size_t MAX_PATH_LEN = sizeof(((sockaddr_un*)0)->sun_path) - 1;
-
-template<class T>
-static T CreateMask(uint32_t bits) {
-    return (1 << (sizeof(T) * 8 - bits)) - 1;
-}
-
-template<class T>
-static uint32_t CountBytes(T value) {
-    uint32_t result = 0;
-    for(; value; ++result) {
-        value &= value - 1;
-    }
-    return result;
-}
 
 int Address::getFamily() const {
     return getAddr()->sa_family;
@@ -52,9 +37,29 @@ bool Address::operator==(const Address& rhs) const {
         && memcmp(getAddr(), rhs.getAddr(), getAddrLen()) == 0;
 }
 
+Address::AddressRef Address::Lookup(const std::string& host, uint16_t port) {
+    std::vector<in_addr> addrs;
+    if(ResolverMgr::getInstance().lookup(host, addrs) != Resolver::SUCCESS) {
+        return nullptr;
+    }
+    return std::make_shared<Address>(ntohl(addrs[0].s_addr), port);
+}
+
+bool Address::LookupAll(std::vector<AddressRef>& result, const std::string& host
+                        ,uint16_t port) {
+    std::vector<in_addr> addrs;
+    if(ResolverMgr::getInstance().lookup(host, addrs) != Resolver::SUCCESS) {
+        return false;
+    }
+    for(auto& i : addrs) {
+        result.push_back(std::make_shared<Address>(ntohl(i.s_addr), port));
+    }
+    return true;
+}
+
 Address::AddressRef Address::Create(const char* address, uint16_t port) {
     Address::AddressRef rt = std::make_shared<Address>(AF_INET);
-    rt->m_addr.sin_port = byteswapOnLittleEndian(port);
+    rt->m_addr.sin_port = htons(port);
     int result = inet_pton(AF_INET, address, &rt->m_addr.sin_addr);
     if(result <= 0) {
         FISHER_LOG_DEBUG(g_logger) << "IPv4Address::Create(" << address << ", "
@@ -72,8 +77,21 @@ Address::Address(const sockaddr_in& address) {
 Address::Address(uint32_t address, uint16_t port) {
     memset(&m_addr, 0, sizeof(m_addr));
     m_addr.sin_family = AF_INET;
-    m_addr.sin_port = byteswapOnLittleEndian(port);
-    m_addr.sin_addr.s_addr = byteswapOnLittleEndian(address);
+    m_addr.sin_port = htons(port);
+    m_addr.sin_addr.s_addr = htonl(address);
+}
+
+Address::Address(int family) {
+    memset(&m_addr, 0, sizeof(m_addr));
+    m_addr.sin_family = family;
+}
+
+uint32_t Address::getPort() const {
+    return ntohs(m_addr.sin_port);
+}
+
+void Address::setPort(uint16_t v) {
+    m_addr.sin_port = htons(v);
 }
 
 const sockaddr* Address::getAddr() const {
@@ -89,12 +107,12 @@ socklen_t Address::getAddrLen() const {
 }
 
 std::ostream& Address::insert(std::ostream& os) const {
-    uint32_t addr = byteswapOnLittleEndian(m_addr.sin_addr.s_addr);
+    uint32_t addr = ntohl(m_addr.sin_addr.s_addr);
     os << ((addr >> 24) & 0xff) << "."
        << ((addr >> 16) & 0xff) << "."
        << ((addr >> 8) & 0xff) << "."
        << (addr & 0xff);
-    os << ":" << byteswapOnLittleEndian(m_addr.sin_port);
+    os << ":" << ntohs(m_addr.sin_port);
     return os;
 }
 
@@ -140,7 +158,7 @@ Socket::~Socket() {
 }
 
 int64_t Socket::getSendTimeout() {
-    FdCtx::FdCtxRef ctx = FdMgr::getInstance().get(sock_);
+    FdCtx* ctx = FdMgr::getInstance().get(sock_);
     if(ctx) {
         return ctx->getTimeout(SO_SNDTIMEO);
     }
@@ -153,7 +171,7 @@ void Socket::setSendTimeout(int64_t v) {
 }
 
 int64_t Socket::getRecvTimeout() {
-    FdCtx::FdCtxRef ctx = FdMgr::getInstance().get(sock_);
+    FdCtx* ctx = FdMgr::getInstance().get(sock_);
     if(ctx) {
         return ctx->getTimeout(SO_RCVTIMEO);
     }
@@ -201,7 +219,7 @@ Socket::SocketRef Socket::accept() {
 }
 
 bool Socket::init(int sock) {
-    FdCtx::FdCtxRef ctx = FdMgr::getInstance().get(sock);
+    FdCtx* ctx = FdMgr::getInstance().get(sock);
     if(ctx && ctx->isSocket() && !ctx->isClose()) {
         sock_ = sock;
         isConnected_ = true;
@@ -217,7 +235,7 @@ bool Socket::bind(const Address::AddressRef addr) {
     //m_localAddress = addr;
     if(!isValid()) {
         newSock();
-        if(SYLAR_UNLIKELY(!isValid())) {
+        if(__glibc_unlikely(!isValid())) {
             return false;
         }
     }
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include "address.h"
+#include <sys/uio.h>
 
 namespace fisher {
 
@@ -13,6 +17,26 @@ public:
     using AddressRef = std::shared_ptr<Address>;
     static AddressRef Create(const char* address, uint16_t port = 0);
     static AddressRef Create(const sockaddr* addr, socklen_t addrlen);
+
+    /**
+     * @brief 通过ResolverMgr解析主机名,返回第一个IPv4地址
+     * @details 在调度器的协程中只挂起当前协程,否则阻塞当前线程
+     * @param[in] host 主机名或点分十进制地址
+     * @param[in] port 端口号
+     * @return 解析失败返回nullptr
+     */
+    static AddressRef Lookup(const std::string& host, uint16_t port = 0);
+
+    /**
+     * @brief 通过ResolverMgr解析主机名,返回所有IPv4地址
+     * @param[out] result 解析到的地址,按应答中的顺序
+     * @param[in] host 主机名或点分十进制地址
+     * @param[in] port 端口号
+     * @return 是否解析成功
+     */
+    static bool LookupAll(std::vector<AddressRef>& result, const std::string& host
+                          ,uint16_t port = 0);
+
     /**
      * @brief 通过sockaddr_in构造IPv4Address
      * @param[in] address sockaddr_in结构体
@@ -26,8 +50,10 @@ public:
      */
     Address(uint32_t address = INADDR_ANY, uint16_t port = 0);
 
-    // unknown address
-    Address(int family);
+    /**
+     * @brief 构造指定协议簇的空地址,用于getsockname等填充
+     */
+    explicit Address(int family);
     
     /**
      * @brief 返回协议簇
@@ -39,7 +65,14 @@ public:
     socklen_t getAddrLen() const;
     std::ostream& insert(std::ostream& os) const;
 
+    /**
+     * @brief 返回端口号
+     */
     uint32_t getPort() const;
+
+    /**
+     * @brief 设置端口号
+     */
     void setPort(uint16_t v);
 
     /**
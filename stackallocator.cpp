@@ -0,0 +1,149 @@
+#include "stackallocator.h"
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "log.h"
+
+namespace fisher {
+
+static Logger::LoggerRef g_logger = FISHER_LOG_NAME("system");
+
+static std::atomic<uint64_t> s_hits {0};
+static std::atomic<uint64_t> s_misses {0};
+static std::atomic<uint64_t> s_recycled {0};
+static std::atomic<uint64_t> s_released {0};
+static std::atomic<size_t> s_max_cached {64};
+
+static size_t GetPageSize() {
+    static const size_t s_page_size = sysconf(_SC_PAGESIZE);
+    return s_page_size;
+}
+
+static void* MapStack(size_t size) {
+    size_t page = GetPageSize();
+    void* base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE
+                      ,MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED) {
+        FISHER_LOG_ERROR(g_logger) << "mmap stack size=" << size
+            << " errno=" << errno;
+        return nullptr;
+    }
+    // 栈向低地址增长,保护页放在最低处
+    if(mprotect(base, page, PROT_NONE)) {
+        FISHER_LOG_ERROR(g_logger) << "mprotect guard page errno=" << errno;
+        munmap(base, size + page);
+        return nullptr;
+    }
+    return (char*)base + page;
+}
+
+static void UnmapStack(void* vp, size_t size) {
+    size_t page = GetPageSize();
+    munmap((char*)vp - page, size + page);
+    ++s_released;
+}
+
+/**
+ * @brief 线程本地的栈缓存池,按栈大小分组
+ */
+struct StackPool {
+    ~StackPool() {
+        for(auto& i : pools) {
+            for(void* vp : i.second) {
+                UnmapStack(vp, i.first);
+            }
+        }
+    }
+
+    std::vector<void*>& get(size_t size) {
+        for(auto& i : pools) {
+            if(i.first == size) {
+                return i.second;
+            }
+        }
+        pools.emplace_back(size, std::vector<void*>());
+        return pools.back().second;
+    }
+
+    /// 通常只有一两种栈大小,线性查找即可
+    std::vector<std::pair<size_t, std::vector<void*>>> pools;
+};
+
+static thread_local StackPool* t_pool = nullptr;
+static thread_local bool t_pool_destroyed = false;
+
+/**
+ * @brief 线程退出时销毁栈缓存池
+ */
+struct StackPoolHolder {
+    ~StackPoolHolder() {
+        delete t_pool;
+        t_pool = nullptr;
+        t_pool_destroyed = true;
+    }
+};
+
+static StackPool* GetPool() {
+    if(t_pool) {
+        return t_pool;
+    }
+    if(t_pool_destroyed) {
+        return nullptr;
+    }
+    static thread_local StackPoolHolder s_holder;
+    t_pool = new StackPool;
+    return t_pool;
+}
+
+void* StackAllocator::Alloc(size_t size) {
+    StackPool* pool = GetPool();
+    if(pool) {
+        std::vector<void*>& stacks = pool->get(size);
+        if(!stacks.empty()) {
+            void* vp = stacks.back();
+            stacks.pop_back();
+            ++s_hits;
+            return vp;
+        }
+    }
+    ++s_misses;
+    return MapStack(size);
+}
+
+void StackAllocator::Dealloc(void* vp, size_t size) {
+    if(!vp) {
+        return;
+    }
+    StackPool* pool = GetPool();
+    if(pool) {
+        std::vector<void*>& stacks = pool->get(size);
+        if(stacks.size() < s_max_cached) {
+            stacks.push_back(vp);
+            ++s_recycled;
+            return;
+        }
+    }
+    UnmapStack(vp, size);
+}
+
+size_t StackAllocator::RoundUp(size_t size) {
+    size_t page = GetPageSize();
+    return (size + page - 1) / page * page;
+}
+
+void StackAllocator::SetMaxCached(size_t v) {
+    s_max_cached = v;
+}
+
+StackAllocator::Stats StackAllocator::GetStats() {
+    Stats stats;
+    stats.hits = s_hits;
+    stats.misses = s_misses;
+    stats.recycled = s_recycled;
+    stats.released = s_released;
+    return stats;
+}
+
+}
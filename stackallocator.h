@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace fisher {
+
+/**
+ * @brief 协程栈分配器
+ * @details 栈内存通过mmap分配,低地址处带一个PROT_NONE的保护页,
+ *          栈溢出时直接触发SIGSEGV而不是踩坏堆内存。
+ *          释放的栈缓存在线程本地的池中,同一线程再次分配同样大小的栈时直接复用
+ */
+class StackAllocator {
+public:
+    /**
+     * @brief 分配器统计信息
+     */
+    struct Stats {
+        /// 命中线程本地缓存的次数
+        uint64_t hits = 0;
+        /// 未命中缓存,需要mmap的次数
+        uint64_t misses = 0;
+        /// 归还到线程本地缓存的次数
+        uint64_t recycled = 0;
+        /// 缓存已满或线程退出时munmap的次数
+        uint64_t released = 0;
+    };
+
+    /**
+     * @brief 分配协程栈
+     * @param[in] size 栈大小,需为RoundUp()后的值
+     * @return 栈的起始地址(保护页之上),失败返回nullptr
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief 释放协程栈
+     * @param[in] vp Alloc返回的地址
+     * @param[in] size 分配时的大小
+     */
+    static void Dealloc(void* vp, size_t size);
+
+    /**
+     * @brief 将栈大小向上对齐到页大小
+     */
+    static size_t RoundUp(size_t size);
+
+    /**
+     * @brief 设置每个线程每种栈大小最多缓存的栈数量
+     */
+    static void SetMaxCached(size_t v);
+
+    /**
+     * @brief 返回分配器统计信息
+     */
+    static Stats GetStats();
+};
+
+}
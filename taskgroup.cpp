@@ -0,0 +1,149 @@
+#include "taskgroup.h"
+#include <assert.h>
+#include "fiber.h"
+#include "scheduler.h"
+
+namespace fisher {
+
+/**
+ * @brief 唤醒以next相连的所有协程
+ */
+static void WakeAll(FiberWaiter* w) {
+    while(w) {
+        FiberWaiter* next = w->next;
+        w->wake();
+        w = next;
+    }
+}
+
+void WaitGroup::add(int64_t n) {
+    std::unique_lock lock(guard_);
+    count_ += n;
+    assert(count_ >= 0);
+}
+
+void WaitGroup::done() {
+    guard_.lock();
+    assert(count_ > 0);
+    FiberWaiter* w = nullptr;
+    if(!--count_) {
+        w = waiters_.popAll();
+    }
+    guard_.unlock();
+    WakeAll(w);
+}
+
+void WaitGroup::wait() {
+    guard_.lock();
+    if(!count_) {
+        guard_.unlock();
+        return;
+    }
+    FiberWaiter waiter;
+    Fiber* self = waiter.prepare();
+    waiters_.push(&waiter);
+    guard_.unlock();
+    self->yeild();
+}
+
+TaskGroup::TaskGroup(Scheduler* scheduler)
+    :scheduler_(scheduler ? scheduler : Scheduler::GetThis()) {
+    assert(scheduler_);
+}
+
+TaskGroup::~TaskGroup() {
+    guard_.lock();
+    while(pending_) {
+        park();
+        guard_.lock();
+    }
+    guard_.unlock();
+}
+
+size_t TaskGroup::spawn(std::function<void()> cb, int thread) {
+    size_t index;
+    {
+        std::unique_lock lock(guard_);
+        index = errors_.size();
+        errors_.emplace_back();
+        ++pending_;
+    }
+    scheduler_->schedule(std::function<void()>([this, index, cb = std::move(cb)]() {
+        std::exception_ptr e;
+        try {
+            cb();
+        } catch (...) {
+            e = std::current_exception();
+        }
+        onFinish(index, e);
+    }), thread);
+    return index;
+}
+
+void TaskGroup::onFinish(size_t index, std::exception_ptr e) {
+    guard_.lock();
+    errors_[index] = e;
+    finished_.push_back(index);
+    --pending_;
+    FiberWaiter* w = waiters_.popAll();
+    guard_.unlock();
+    // 等待方被唤醒后可能析构TaskGroup,之后不能再访问成员
+    WakeAll(w);
+}
+
+void TaskGroup::park() {
+    FiberWaiter waiter;
+    Fiber* self = waiter.prepare();
+    waiters_.push(&waiter);
+    guard_.unlock();
+    self->yeild();
+}
+
+void TaskGroup::waitAll() {
+    guard_.lock();
+    while(pending_) {
+        park();
+        guard_.lock();
+    }
+    finished_.clear();
+    std::exception_ptr e;
+    for(auto& i : errors_) {
+        if(i) {
+            e = std::move(i);
+            break;
+        }
+    }
+    guard_.unlock();
+    if(e) {
+        std::rethrow_exception(e);
+    }
+}
+
+int TaskGroup::waitAny(std::exception_ptr* error) {
+    guard_.lock();
+    while(finished_.empty()) {
+        if(!pending_) {
+            guard_.unlock();
+            return -1;
+        }
+        park();
+        guard_.lock();
+    }
+    size_t index = finished_.front();
+    finished_.pop_front();
+    std::exception_ptr e = std::move(errors_[index]);
+    guard_.unlock();
+    if(error) {
+        *error = e;
+    } else if(e) {
+        std::rethrow_exception(e);
+    }
+    return index;
+}
+
+size_t TaskGroup::pending() {
+    std::unique_lock lock(guard_);
+    return pending_;
+}
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include "mutex.h"
+
+namespace fisher {
+
+class Scheduler;
+
+/**
+ * @brief 等待一组操作完成的计数器
+ * @details add增加计数,done减少计数,wait挂起当前协程直到计数归零。
+ *          只能在调度器的协程中等待
+ */
+class WaitGroup {
+public:
+    WaitGroup() = default;
+    WaitGroup(const WaitGroup&) = delete;
+    WaitGroup& operator=(const WaitGroup&) = delete;
+
+    /**
+     * @brief 增加计数
+     */
+    void add(int64_t n = 1);
+
+    /**
+     * @brief 减少一个计数,归零时唤醒等待的协程
+     */
+    void done();
+
+    /**
+     * @brief 挂起当前协程直到计数归零
+     */
+    void wait();
+private:
+    SpinLock guard_;
+    /// 未完成的数量
+    int64_t count_ = 0;
+    /// 等待计数归零的协程
+    WaitQueue waiters_;
+};
+
+/**
+ * @brief 结构化的一组任务
+ * @details 每个任务作为回调交给调度器,不一定有自己的协程:通常由工作线程的runner依次执行,
+ *          任务挂起时才转为独立的协程。抛出的异常由TaskGroup保存,在waitAll或waitAny中重新抛出。
+ *          析构时等待所有任务结束,任务可以安全地引用创建TaskGroup的协程栈上的变量。
+ *          只能在调度器的协程中等待
+ */
+class TaskGroup {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] scheduler 执行任务的调度器,nullptr为当前线程的调度器
+     */
+    explicit TaskGroup(Scheduler* scheduler = nullptr);
+
+    /**
+     * @brief 析构函数,等待所有任务结束,丢弃未报告的异常
+     */
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    /**
+     * @brief 调度执行任务
+     * @param[in] cb 任务
+     * @param[in] thread 指定执行的线程,-1为不指定
+     * @return 任务下标,按添加顺序从0开始
+     */
+    size_t spawn(std::function<void()> cb, int thread = -1);
+
+    /**
+     * @brief 挂起当前协程直到所有任务结束
+     * @details 有任务抛出异常时,重新抛出其中下标最小且未报告的异常
+     */
+    void waitAll();
+
+    /**
+     * @brief 挂起当前协程直到有一个未报告的任务结束
+     * @details 每个任务只报告一次
+     * @param[out] error 任务抛出的异常,为nullptr时直接重新抛出该异常
+     * @return 结束的任务下标,所有任务都已报告时返回-1
+     */
+    int waitAny(std::exception_ptr* error = nullptr);
+
+    /**
+     * @brief 还未结束的任务数量
+     */
+    size_t pending();
+private:
+    /**
+     * @brief 任务结束时调用
+     */
+    void onFinish(size_t index, std::exception_ptr e);
+
+    /**
+     * @brief 挂起当前协程直到有任务结束
+     * @pre 持有guard_,返回时已释放
+     */
+    void park();
+private:
+    /// 执行任务的调度器
+    Scheduler* scheduler_;
+    /// 保护以下成员
+    SpinLock guard_;
+    /// 每个任务抛出的异常,报告后清空
+    std::vector<std::exception_ptr> errors_;
+    /// 已结束但还未由waitAny报告的任务
+    std::deque<size_t> finished_;
+    /// 还未结束的任务数量
+    size_t pending_ = 0;
+    /// 等待任务结束的协程
+    WaitQueue waiters_;
+};
+
+}
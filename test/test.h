@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <stdio.h>
+#include "hook.h"
+#include "iomanager.h"
+#include "log.h"
+
+namespace fisher {
+namespace test {
+
+/// 执行的检查数量
+inline std::atomic<int> g_checks = {0};
+/// 失败的检查数量
+inline std::atomic<int> g_failures = {0};
+
+/**
+ * @brief 检查失败时输出位置和表达式
+ */
+inline bool Check(bool ok, const char* expr, const char* file, int line) {
+    ++g_checks;
+    if(!ok) {
+        ++g_failures;
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+    }
+    return ok;
+}
+
+/**
+ * @brief 关闭INFO日志,避免淹没测试输出
+ */
+inline void QuietLogs() {
+    FISHER_LOG_ROOT()->setLevel(LogLevel::ERROR);
+    FISHER_LOG_NAME("system")->setLevel(LogLevel::ERROR);
+}
+
+/**
+ * @brief 在threads个工作线程的IOManager中执行cb,返回时cb和它派生的任务都已结束
+ */
+inline void RunInIOManager(size_t threads, std::function<void()> cb) {
+    IOManager iom(threads, "test");
+    iom.schedule(std::move(cb));
+    iom.stop();
+}
+
+/**
+ * @brief 挂起当前协程1毫秒,让已经就绪的协程先执行
+ * @details 本线程的就绪队列后进先出,重新排队不能让出给其他协程
+ */
+inline void Pause() {
+    sleep_for_us(1000);
+}
+
+/**
+ * @brief 输出结果,作为main的返回值
+ */
+inline int Report(const char* name) {
+    int failures = g_failures.load();
+    printf("%s: %d checks, %d failed\n", name, g_checks.load(), failures);
+    return failures ? 1 : 0;
+}
+
+}
+}
+
+/// 检查条件,失败时记录但不中止,返回条件的值
+#define FISHER_CHECK(cond) fisher::test::Check(!!(cond), #cond, __FILE__, __LINE__)
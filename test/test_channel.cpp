@@ -0,0 +1,280 @@
+/**
+ * @brief 通道和Select测试
+ * @details MPMC和SPSC模式在多线程下检查元素不丢不重、关闭语义;
+ *          Select检查就绪操作的选择、挂起后由其他通道完成以及多于栈上节点数的操作
+ */
+#include <atomic>
+#include <string>
+#include <vector>
+#include "channel.h"
+#include "test.h"
+
+using namespace fisher;
+
+/**
+ * @brief 多个生产者和消费者,每个元素恰好被接收一次
+ */
+static void TestMPMC(size_t capacity) {
+    const int producers = 4, consumers = 4, per_producer = 1000;
+    Channel<int> ch(capacity);
+    std::vector<std::atomic<int> > seen(producers * per_producer);
+    std::atomic<int> producers_left = {producers};
+    std::atomic<int> received = {0};
+    test::RunInIOManager(3, [&]() {
+        for(int p = 0; p < producers; ++p) {
+            Scheduler::GetThis()->schedule([&, p]() {
+                for(int i = 0; i < per_producer; ++i) {
+                    FISHER_CHECK(ch.send(p * per_producer + i));
+                }
+                if(--producers_left == 0) {
+                    ch.close();
+                }
+            });
+        }
+        for(int c = 0; c < consumers; ++c) {
+            Scheduler::GetThis()->schedule([&]() {
+                int v;
+                while(ch.recv(v)) {
+                    ++seen[v];
+                    ++received;
+                }
+            });
+        }
+    });
+    FISHER_CHECK(received == producers * per_producer);
+    int dup = 0;
+    for(auto& s : seen) {
+        dup += s != 1;
+    }
+    FISHER_CHECK(dup == 0);
+    int v;
+    FISHER_CHECK(!ch.tryRecv(v));
+}
+
+/**
+ * @brief 单生产者单消费者按顺序收到所有元素,关闭前发送的元素都能取出
+ */
+static void TestSPSC() {
+    const int n = 20000;
+    Channel<std::string> ch(8, ChannelBase::SPSC);
+    FISHER_CHECK(ch.getMode() == ChannelBase::SPSC);
+    int in_order = 0;
+    int received = 0;
+    test::RunInIOManager(2, [&]() {
+        Scheduler::GetThis()->schedule([&]() {
+            std::string v;
+            while(ch.recv(v)) {
+                in_order += v == std::to_string(received);
+                ++received;
+            }
+        });
+        for(int i = 0; i < n; ++i) {
+            FISHER_CHECK(ch.send(std::to_string(i)));
+        }
+        ch.close();
+    });
+    FISHER_CHECK(received == n);
+    FISHER_CHECK(in_order == n);
+
+    // 容量向上取整为2的幂,但可用数量仍是构造时的容量
+    Channel<int> small(3, ChannelBase::SPSC);
+    int v = 1;
+    FISHER_CHECK(small.trySend(v) && small.trySend(v) && small.trySend(v));
+    FISHER_CHECK(!small.trySend(v));
+    FISHER_CHECK(small.size() == 3);
+}
+
+/**
+ * @brief 关闭后发送失败,挂起的发送方和接收方都返回false,剩余元素仍可取出
+ */
+static void TestClose() {
+    Channel<int> buffered(2);
+    int v = 7;
+    FISHER_CHECK(buffered.trySend(v));
+    buffered.close();
+    FISHER_CHECK(buffered.isClosed());
+    v = 8;
+    FISHER_CHECK(!buffered.trySend(v));
+    FISHER_CHECK(buffered.tryRecv(v) && v == 7);
+    FISHER_CHECK(!buffered.tryRecv(v));
+
+    Channel<int> unbuffered(0);
+    Channel<int> empty(1);
+    std::atomic<int> failed = {0};
+    test::RunInIOManager(1, [&]() {
+        Scheduler::GetThis()->schedule([&]() {
+            failed += !unbuffered.send(1);
+        });
+        Scheduler::GetThis()->schedule([&]() {
+            int x;
+            failed += !empty.recv(x);
+        });
+        test::Pause();
+        unbuffered.close();
+        empty.close();
+    });
+    FISHER_CHECK(failed == 2);
+}
+
+/**
+ * @brief 容量为0时发送方和接收方直接交接
+ */
+static void TestUnbuffered() {
+    Channel<int> ch(0);
+    int v = 1;
+    FISHER_CHECK(!ch.trySend(v));
+    int sum = 0;
+    test::RunInIOManager(1, [&]() {
+        Scheduler::GetThis()->schedule([&]() {
+            for(int i = 1; i <= 100; ++i) {
+                ch.send(i);
+            }
+            ch.close();
+        });
+        int x;
+        while(ch.recv(x)) {
+            sum += x;
+        }
+    });
+    FISHER_CHECK(sum == 5050);
+}
+
+/**
+ * @brief 已就绪的操作立即完成,都未就绪时tryWait返回-1,就绪的操作轮流被选中
+ */
+static void TestSelectReady() {
+    Channel<int> a(4), b(4), out(1);
+    int ra = 0, rb = 0, w = 9;
+    Select none;
+    FISHER_CHECK(none.tryWait() == -1);
+
+    Select sel;
+    sel.recv(a, ra).recv(b, rb);
+    FISHER_CHECK(sel.tryWait() == -1);
+
+    Select send;
+    bool ok = false;
+    send.send(out, w, &ok);
+    FISHER_CHECK(send.tryWait() == 0 && ok);
+    FISHER_CHECK(send.tryWait() == -1);
+
+    int hits[2] = {0, 0};
+    for(int i = 0; i < 4; ++i) {
+        int x = i;
+        a.trySend(x);
+        x = i;
+        b.trySend(x);
+    }
+    for(int i = 0; i < 8; ++i) {
+        int k = sel.tryWait();
+        FISHER_CHECK(k == 0 || k == 1);
+        if(k >= 0) {
+            ++hits[k];
+        }
+    }
+    // 两个通道都一直就绪,不能总是选中同一个
+    FISHER_CHECK(hits[0] == 4 && hits[1] == 4);
+}
+
+/**
+ * @brief 挂起的Select由其中一个通道完成,其余通道上的节点被摘除
+ * @param[in] cases 操作数量,超过栈上节点数时使用复用的缓冲区
+ */
+static void TestSelectBlocking(int cases) {
+    std::vector<Channel<int>*> chans;
+    for(int i = 0; i < cases; ++i) {
+        chans.push_back(new Channel<int>(0));
+    }
+    std::vector<int> values(cases, -1);
+    std::vector<int> got;
+    bool closed_ok = true;
+    test::RunInIOManager(2, [&]() {
+        Scheduler::GetThis()->schedule([&]() {
+            Select sel;
+            for(int i = 0; i < cases; ++i) {
+                sel.recv(*chans[i], values[i], i == 0 ? &closed_ok : nullptr);
+            }
+            // 同一个Select多次挂起等待
+            for(int round = 0; round < cases; ++round) {
+                int k = sel.wait();
+                got.push_back(k);
+                FISHER_CHECK(values[k] == k * 10);
+            }
+            FISHER_CHECK(sel.wait() == 0);
+        });
+        for(int i = cases - 1; i >= 0; --i) {
+            test::Pause();
+            FISHER_CHECK(chans[i]->send(i * 10));
+        }
+        test::Pause();
+        chans[0]->close();
+    });
+    std::vector<int> expect;
+    for(int i = cases - 1; i >= 0; --i) {
+        expect.push_back(i);
+    }
+    FISHER_CHECK(got == expect);
+    FISHER_CHECK(!closed_ok);
+    for(auto c : chans) {
+        // 析构时等待队列必须为空
+        delete c;
+    }
+}
+
+/**
+ * @brief 多个Select在同一组通道上竞争,每个元素只被一个Select取走
+ */
+static void TestSelectContended() {
+    const int n = 2000;
+    Channel<int> a(0), b(16);
+    std::atomic<int> sum = {0}, count = {0};
+    std::atomic<bool> a_done = {false};
+    test::RunInIOManager(3, [&]() {
+        for(int s = 0; s < 4; ++s) {
+            Scheduler::GetThis()->schedule([&]() {
+                int ra, rb;
+                bool okb = true;
+                Select sel;
+                sel.recv(a, ra).recv(b, rb, &okb);
+                while(true) {
+                    int k = sel.wait();
+                    if(k == 1 && !okb) {
+                        break;
+                    }
+                    sum += k == 0 ? ra : rb;
+                    ++count;
+                }
+            });
+        }
+        Scheduler::GetThis()->schedule([&]() {
+            for(int i = 0; i < n; i += 2) {
+                a.send(i);
+            }
+            a_done = true;
+        });
+        for(int i = 1; i < n; i += 2) {
+            b.send(i);
+        }
+        // a没有缓冲,发送方结束时元素都已交接;关闭b后Select取完剩余元素再退出
+        while(!a_done) {
+            test::Pause();
+        }
+        b.close();
+    });
+    FISHER_CHECK(count == n);
+    FISHER_CHECK(sum == n * (n - 1) / 2);
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    TestMPMC(0);
+    TestMPMC(16);
+    TestSPSC();
+    TestClose();
+    TestUnbuffered();
+    TestSelectReady();
+    TestSelectBlocking(2);
+    TestSelectBlocking(7);
+    TestSelectContended();
+    return test::Report("test_channel");
+}
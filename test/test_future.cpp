@@ -0,0 +1,269 @@
+/**
+ * @brief Future/Promise、WaitGroup、TaskGroup和Fiber::join测试
+ * @details 检查结果和异常的传递、等待方挂起后被唤醒以及析构时的语义
+ */
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "fiber.h"
+#include "fiberpool.h"
+#include "future.h"
+#include "taskgroup.h"
+#include "test.h"
+
+using namespace fisher;
+
+/**
+ * @brief 判断异常是否为指定消息的runtime_error
+ */
+static bool IsError(std::exception_ptr e, const std::string& what) {
+    try {
+        std::rethrow_exception(e);
+    } catch (const std::runtime_error& ex) {
+        return what == ex.what();
+    } catch (...) {
+    }
+    return false;
+}
+
+/**
+ * @brief 值、异常和broken_promise都能传给等待的协程
+ */
+static void TestPromise() {
+    test::RunInIOManager(2, [&]() {
+        Promise<std::string> p;
+        Future<std::string> f = p.getFuture();
+        FISHER_CHECK(f.valid() && !f.isReady());
+        Scheduler::GetThis()->schedule([&p]() {
+            test::Pause();
+            p.setValue("hello");
+        });
+        // 结果就绪前挂起
+        FISHER_CHECK(f.get() == "hello");
+        FISHER_CHECK(!f.valid());
+
+        Promise<int> pe;
+        Future<int> fe = pe.getFuture();
+        pe.setException(std::make_exception_ptr(std::runtime_error("boom")));
+        FISHER_CHECK(fe.isReady());
+        bool caught = false;
+        try {
+            fe.get();
+        } catch (const std::runtime_error& e) {
+            caught = std::string(e.what()) == "boom";
+        }
+        FISHER_CHECK(caught);
+
+        Future<void> fb;
+        {
+            Promise<void> pb;
+            fb = pb.getFuture();
+        }
+        bool broken = false;
+        try {
+            fb.get();
+        } catch (const std::future_error& e) {
+            broken = e.code() == std::future_errc::broken_promise;
+        }
+        FISHER_CHECK(broken);
+    });
+}
+
+/**
+ * @brief Async在其他协程中执行,返回值或抛出的异常通过Future取得
+ */
+static void TestAsync() {
+    test::RunInIOManager(2, [&]() {
+        Scheduler* s = Scheduler::GetThis();
+        std::vector<Future<int> > futures;
+        for(int i = 0; i < 50; ++i) {
+            futures.push_back(Async(s, [i]() {
+                if(i % 10 == 0) {
+                    test::Pause();
+                }
+                return i * i;
+            }));
+        }
+        int sum = 0;
+        for(auto& f : futures) {
+            sum += f.get();
+        }
+        FISHER_CHECK(sum == 40425);
+
+        std::atomic<bool> ran = {false};
+        Future<void> v = Async(s, [&ran]() { ran = true;});
+        v.get();
+        FISHER_CHECK(ran);
+
+        Future<int> e = Async(s, []() -> int { throw std::runtime_error("async");});
+        bool caught = false;
+        try {
+            e.get();
+        } catch (const std::runtime_error& ex) {
+            caught = std::string(ex.what()) == "async";
+        }
+        FISHER_CHECK(caught);
+    });
+}
+
+/**
+ * @brief 计数归零时唤醒所有等待者,计数为0时wait直接返回
+ */
+static void TestWaitGroup() {
+    std::atomic<int> finished = {0};
+    std::atomic<int> woken = {0};
+    test::RunInIOManager(3, [&]() {
+        WaitGroup empty;
+        empty.wait();
+
+        WaitGroup wg;
+        WaitGroup waiters;
+        const int n = 20;
+        wg.add(n);
+        waiters.add(3);
+        for(int w = 0; w < 3; ++w) {
+            Scheduler::GetThis()->schedule([&]() {
+                wg.wait();
+                // 唤醒时所有任务都已完成
+                FISHER_CHECK(finished == n);
+                ++woken;
+                waiters.done();
+            });
+        }
+        for(int i = 0; i < n; ++i) {
+            Scheduler::GetThis()->schedule([&]() {
+                test::Pause();
+                ++finished;
+                wg.done();
+            });
+        }
+        wg.wait();
+        FISHER_CHECK(finished == n);
+        waiters.wait();
+    });
+    FISHER_CHECK(woken == 3);
+}
+
+/**
+ * @brief waitAll重新抛出下标最小的异常,waitAny每个任务只报告一次
+ */
+static void TestTaskGroup() {
+    test::RunInIOManager(2, [&]() {
+        {
+            TaskGroup group;
+            std::atomic<int> ran = {0};
+            for(int i = 0; i < 6; ++i) {
+                size_t index = group.spawn([i, &ran]() {
+                    test::Pause();
+                    ++ran;
+                    if(i == 2 || i == 4) {
+                        throw std::runtime_error("task" + std::to_string(i));
+                    }
+                });
+                FISHER_CHECK(index == (size_t)i);
+            }
+            std::exception_ptr first;
+            try {
+                group.waitAll();
+            } catch (...) {
+                first = std::current_exception();
+            }
+            FISHER_CHECK(ran == 6);
+            FISHER_CHECK(group.pending() == 0);
+            FISHER_CHECK(IsError(first, "task2"));
+            // 已报告的异常不再抛出
+            std::exception_ptr second;
+            try {
+                group.waitAll();
+            } catch (...) {
+                second = std::current_exception();
+            }
+            FISHER_CHECK(IsError(second, "task4"));
+        }
+
+        {
+            TaskGroup group;
+            group.spawn([]() {
+                test::Pause();
+                test::Pause();
+            });
+            group.spawn([]() {
+                throw std::runtime_error("fast");
+            });
+            std::exception_ptr error;
+            // 先结束的任务先报告
+            FISHER_CHECK(group.waitAny(&error) == 1);
+            FISHER_CHECK(IsError(error, "fast"));
+            FISHER_CHECK(group.waitAny(&error) == 0);
+            FISHER_CHECK(!error);
+            FISHER_CHECK(group.waitAny() == -1);
+        }
+
+        // 析构时等待任务结束,任务可以引用栈上的变量
+        int late = 0;
+        {
+            TaskGroup group;
+            group.spawn([&late]() {
+                test::Pause();
+                late = 1;
+            });
+        }
+        FISHER_CHECK(late == 1);
+    });
+}
+
+/**
+ * @brief join挂起直到协程结束,协程抛出的异常在join中重新抛出
+ */
+static void TestJoin() {
+    test::RunInIOManager(2, [&]() {
+        int value = 0;
+        Fiber::FiberRef ok = FiberPool::Acquire([&value]() {
+            test::Pause();
+            value = 42;
+        });
+        Scheduler::GetThis()->schedule(ok);
+        ok->join();
+        FISHER_CHECK(value == 42);
+        FISHER_CHECK(ok->getState() == Fiber::TERM);
+        FISHER_CHECK(!ok->getException());
+        // 已结束的协程join直接返回
+        ok->join();
+
+        Fiber::FiberRef bad = FiberPool::Acquire([]() {
+            test::Pause();
+            throw std::runtime_error("fiber");
+        });
+        Scheduler::GetThis()->schedule(bad);
+        std::vector<Fiber::FiberRef> joiners;
+        std::atomic<int> rethrown = {0};
+        for(int i = 0; i < 3; ++i) {
+            joiners.push_back(FiberPool::Acquire([&bad, &rethrown]() {
+                try {
+                    bad->join();
+                } catch (const std::runtime_error& e) {
+                    rethrown += std::string(e.what()) == "fiber";
+                }
+            }));
+            Scheduler::GetThis()->schedule(joiners.back());
+        }
+        for(auto& j : joiners) {
+            j->join();
+        }
+        FISHER_CHECK(rethrown == 3);
+        FISHER_CHECK(bad->getState() == Fiber::EXCEPT);
+        FISHER_CHECK(IsError(bad->getException(), "fiber"));
+    });
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    TestPromise();
+    TestAsync();
+    TestWaitGroup();
+    TestTaskGroup();
+    TestJoin();
+    return test::Report("test_future");
+}
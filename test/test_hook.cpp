@@ -0,0 +1,181 @@
+/**
+ * @brief hook的socket IO和poll测试
+ * @details 检查同一fd的同一事件上多个协程同时等待:就绪时全部唤醒,
+ *          其中一个超时只取消它自己,其余等待者不受影响;以及睡眠函数的参数检查
+ */
+#include <atomic>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "test.h"
+
+using namespace fisher;
+
+/**
+ * @brief 创建一对互相连接的回环UDP socket,必须在hook启用的协程中调用
+ */
+static bool UdpPair(int fds[2]) {
+    for(int i = 0; i < 2; ++i) {
+        fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(fds[i] < 0 || bind(fds[i], (sockaddr*)&addr, sizeof(addr))) {
+            return false;
+        }
+    }
+    for(int i = 0; i < 2; ++i) {
+        sockaddr_in peer;
+        socklen_t len = sizeof(peer);
+        if(getsockname(fds[1 - i], (sockaddr*)&peer, &len)
+                || connect(fds[i], (sockaddr*)&peer, len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 等待其他协程被唤醒后满足条件,最多等待200毫秒
+ * @details 唤醒要经过epoll线程和调度,单核机器上可能晚于一次Pause
+ */
+template<class Cond>
+static bool WaitUntil(Cond cond) {
+    for(int i = 0; i < 200 && !cond(); ++i) {
+        test::Pause();
+    }
+    return cond();
+}
+
+/**
+ * @brief recv和poll等待同一个fd的读事件,数据到达时都被唤醒
+ * @details recv使用MSG_PEEK不取走数据,poll被唤醒后仍能看到数据就绪;
+ *          两个数据报分别被两个等待中的recv取走
+ */
+static void TestSharedRead() {
+    std::atomic<int> received = {0};
+    std::atomic<int> polled = {0};
+    test::RunInIOManager(2, [&]() {
+        int fds[2];
+        if(!FISHER_CHECK(UdpPair(fds))) {
+            return;
+        }
+        Scheduler::GetThis()->schedule([&]() {
+            char c;
+            received += recv(fds[1], &c, 1, MSG_PEEK) == 1;
+        });
+        Scheduler::GetThis()->schedule([&]() {
+            pollfd pfd = {fds[1], POLLIN, 0};
+            polled += poll(&pfd, 1, -1) == 1 && (pfd.revents & POLLIN);
+        });
+        test::Pause();
+        FISHER_CHECK(received == 0 && polled == 0);
+        FISHER_CHECK(send(fds[0], "a", 1, 0) == 1);
+        FISHER_CHECK(WaitUntil([&]() { return received == 1 && polled == 1;}));
+
+        for(int r = 0; r < 2; ++r) {
+            Scheduler::GetThis()->schedule([&]() {
+                char c;
+                received += recv(fds[1], &c, 1, 0) == 1;
+            });
+        }
+        // 第一个数据报还在,其中一个recv直接取走,另一个等待下一个
+        FISHER_CHECK(WaitUntil([&]() { return received == 2;}));
+        FISHER_CHECK(send(fds[0], "b", 1, 0) == 1);
+        FISHER_CHECK(WaitUntil([&]() { return received == 3;}));
+        close(fds[0]);
+        close(fds[1]);
+    });
+    FISHER_CHECK(received == 3 && polled == 1);
+}
+
+/**
+ * @brief 同一事件上的等待者分别超时,超时的一方不影响其他等待者
+ */
+static void TestSharedTimeout() {
+    std::atomic<int> received = {0};
+    std::atomic<int> polled = {0};
+    std::atomic<int> timed_out = {0};
+    test::RunInIOManager(2, [&]() {
+        int fds[2];
+        if(!FISHER_CHECK(UdpPair(fds))) {
+            return;
+        }
+        // 超时在recv开始等待时读取,之后修改不影响这次等待
+        timeval tv = {0, 5000};
+        setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        Scheduler::GetThis()->schedule([&]() {
+            char c;
+            int rt = recv(fds[1], &c, 1, 0);
+            timed_out += rt == -1 && errno == ETIMEDOUT;
+        });
+        test::Pause();
+        tv.tv_sec = 10;
+        setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        Scheduler::GetThis()->schedule([&]() {
+            char c;
+            received += recv(fds[1], &c, 1, MSG_PEEK) == 1;
+        });
+        Scheduler::GetThis()->schedule([&]() {
+            pollfd pfd = {fds[1], POLLIN, 0};
+            timed_out += poll(&pfd, 1, 5) == 0;
+        });
+        Scheduler::GetThis()->schedule([&]() {
+            pollfd pfd = {fds[1], POLLIN, 0};
+            polled += poll(&pfd, 1, -1) == 1;
+        });
+        FISHER_CHECK(WaitUntil([&]() { return timed_out == 2;}));
+        FISHER_CHECK(received == 0 && polled == 0);
+        FISHER_CHECK(send(fds[0], "a", 1, 0) == 1);
+        FISHER_CHECK(WaitUntil([&]() { return received == 1 && polled == 1;}));
+        close(fds[0]);
+        close(fds[1]);
+    });
+    FISHER_CHECK(timed_out == 2);
+}
+
+/**
+ * @brief 同一个fd在poll的参数中出现多次,各自注册等待
+ */
+static void TestDuplicatePoll() {
+    test::RunInIOManager(1, [&]() {
+        int fds[2];
+        if(!FISHER_CHECK(UdpPair(fds))) {
+            return;
+        }
+        std::atomic<int> ready = {-1};
+        Scheduler::GetThis()->schedule([&]() {
+            pollfd pfd[3] = {{fds[1], POLLIN, 0}, {fds[1], POLLIN, 0}, {-1, POLLIN, 0}};
+            ready = poll(pfd, 3, 1000);
+        });
+        test::Pause();
+        FISHER_CHECK(send(fds[0], "a", 1, 0) == 1);
+        FISHER_CHECK(WaitUntil([&]() { return ready == 2;}));
+        close(fds[0]);
+        close(fds[1]);
+    });
+}
+
+/**
+ * @brief 协程中usleep参数不小于1000000时返回EINVAL,不挂起
+ */
+static void TestUsleepRange() {
+    test::RunInIOManager(1, [&]() {
+        errno = 0;
+        FISHER_CHECK(usleep(1000000) == -1 && errno == EINVAL);
+        FISHER_CHECK(usleep(999) == 0);
+    });
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    TestSharedRead();
+    TestSharedTimeout();
+    TestDuplicatePoll();
+    TestUsleepRange();
+    return test::Report("test_hook");
+}
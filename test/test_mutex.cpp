@@ -0,0 +1,223 @@
+/**
+ * @brief 协程同步原语测试
+ * @details 单线程中用确定的让出顺序检查挂起和交接,多线程中检查互斥
+ */
+#include <atomic>
+#include <deque>
+#include <vector>
+#include "fiber.h"
+#include "mutex.h"
+#include "test.h"
+
+using namespace fisher;
+
+/**
+ * @brief 多个线程上的协程竞争同一把锁,临界区内不能有其他持有者
+ */
+static void TestMutexExclusion() {
+    FiberMutex mutex;
+    int counter = 0;
+    std::atomic<int> inside = {0};
+    std::atomic<bool> overlap = {false};
+    test::RunInIOManager(4, [&]() {
+        for(int f = 0; f < 16; ++f) {
+            Scheduler::GetThis()->schedule([&]() {
+                for(int i = 0; i < 500; ++i) {
+                    std::unique_lock lock(mutex);
+                    if(inside.fetch_add(1) != 0) {
+                        overlap = true;
+                    }
+                    ++counter;
+                    if(i % 50 == 0) {
+                        test::Pause();
+                    }
+                    inside.fetch_sub(1);
+                }
+            });
+        }
+    });
+    FISHER_CHECK(!overlap);
+    FISHER_CHECK(counter == 16 * 500);
+    SyncStats stats = mutex.getStats();
+    // 持有锁时让出,其他协程一定会挂起
+    FISHER_CHECK(stats.parked > 0);
+}
+
+/**
+ * @brief 解锁时有等待者,锁直接交给等待者,第三方拿不到
+ */
+static void TestMutexHandoff() {
+    FiberMutex mutex;
+    std::vector<int> order;
+    test::RunInIOManager(1, [&]() {
+        mutex.lock();
+        Scheduler::GetThis()->schedule([&]() {
+            // 同一线程上持有者不会在自旋期间解锁,一定挂起
+            mutex.lock();
+            order.push_back(2);
+            mutex.unlock();
+        });
+        test::Pause();
+        FISHER_CHECK(mutex.getStats().parked == 1);
+        order.push_back(1);
+        mutex.unlock();
+        FISHER_CHECK(!mutex.try_lock());
+        test::Pause();
+        FISHER_CHECK(mutex.try_lock());
+        mutex.unlock();
+    });
+    FISHER_CHECK(order == std::vector<int>({1, 2}));
+}
+
+/**
+ * @brief 两个线程上的协程交替争用短临界区,加锁要么直接成功,要么经过自旋或挂起
+ * @details 单核机器上持有者不会在自旋期间运行,自旋几乎总是失败,这里只检查计数不超过争用次数
+ */
+static void TestMutexSpin() {
+    const int rounds = 200;
+    FiberMutex mutex;
+    int counter = 0;
+    test::RunInIOManager(2, [&]() {
+        for(int f = 0; f < 2; ++f) {
+            Scheduler::GetThis()->schedule([&]() {
+                for(int i = 0; i < rounds; ++i) {
+                    mutex.lock();
+                    ++counter;
+                    mutex.unlock();
+                }
+            });
+        }
+    });
+    FISHER_CHECK(counter == 2 * rounds);
+    SyncStats stats = mutex.getStats();
+    FISHER_CHECK(stats.spun + stats.parked <= 2 * rounds);
+    FISHER_CHECK(mutex.try_lock());
+    mutex.unlock();
+}
+
+/**
+ * @brief 生产者消费者,notify_all唤醒所有等待者
+ */
+static void TestCondVar() {
+    FiberMutex mutex;
+    FiberCondVar cond;
+    std::deque<int> queue;
+    bool closed = false;
+    std::atomic<int> sum = {0};
+    std::atomic<int> consumers_done = {0};
+    test::RunInIOManager(2, [&]() {
+        for(int c = 0; c < 4; ++c) {
+            Scheduler::GetThis()->schedule([&]() {
+                std::unique_lock lock(mutex);
+                while(true) {
+                    cond.wait(lock, [&]() { return closed || !queue.empty();});
+                    if(queue.empty()) {
+                        break;
+                    }
+                    sum += queue.front();
+                    queue.pop_front();
+                }
+                ++consumers_done;
+            });
+        }
+        for(int i = 1; i <= 100; ++i) {
+            {
+                std::unique_lock lock(mutex);
+                queue.push_back(i);
+            }
+            cond.notify_one();
+            if(i % 10 == 0) {
+                test::Pause();
+            }
+        }
+        {
+            std::unique_lock lock(mutex);
+            closed = true;
+        }
+        cond.notify_all();
+    });
+    FISHER_CHECK(sum == 5050);
+    FISHER_CHECK(consumers_done == 4);
+    FISHER_CHECK(cond.getStats().parked > 0);
+}
+
+/**
+ * @brief 同时持有信号量的协程不超过初始计数
+ */
+static void TestSemaphore() {
+    FiberSemaphore sem(3);
+    std::atomic<int> holders = {0};
+    std::atomic<int> max_holders = {0};
+    std::atomic<int> done = {0};
+    test::RunInIOManager(2, [&]() {
+        for(int f = 0; f < 20; ++f) {
+            Scheduler::GetThis()->schedule([&]() {
+                sem.wait();
+                int n = ++holders;
+                int m = max_holders;
+                while(n > m && !max_holders.compare_exchange_weak(m, n)) {
+                }
+                test::Pause();
+                --holders;
+                sem.post();
+                ++done;
+            });
+        }
+    });
+    FISHER_CHECK(done == 20);
+    FISHER_CHECK(max_holders <= 3);
+    FISHER_CHECK(max_holders > 1);
+    FISHER_CHECK(sem.getStats().parked > 0);
+    // 所有计数都已归还
+    FISHER_CHECK(sem.try_wait() && sem.try_wait() && sem.try_wait());
+    FISHER_CHECK(!sem.try_wait());
+}
+
+/**
+ * @brief 读者共享,写者独占,有写者等待时新的读者排在后面
+ */
+static void TestRWMutex() {
+    FiberRWMutex rw;
+    std::vector<int> order;
+    test::RunInIOManager(1, [&]() {
+        rw.lock_shared();
+        // 另一个读者可以同时持有
+        FISHER_CHECK(rw.try_lock_shared());
+        rw.unlock_shared();
+        FISHER_CHECK(!rw.try_lock());
+
+        Scheduler::GetThis()->schedule([&]() {
+            rw.lock();
+            order.push_back(2);
+            rw.unlock();
+        });
+        test::Pause();
+        // 写者在等待,新的读者不能插队
+        FISHER_CHECK(!rw.try_lock_shared());
+        Scheduler::GetThis()->schedule([&]() {
+            rw.lock_shared();
+            order.push_back(3);
+            rw.unlock_shared();
+        });
+        test::Pause();
+        order.push_back(1);
+        rw.unlock_shared();
+        test::Pause();
+        test::Pause();
+        FISHER_CHECK(rw.try_lock());
+        rw.unlock();
+    });
+    FISHER_CHECK(order == std::vector<int>({1, 2, 3}));
+    FISHER_CHECK(rw.getStats().parked == 2);
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    TestMutexExclusion();
+    TestMutexHandoff();
+    TestMutexSpin();
+    TestCondVar();
+    TestSemaphore();
+    TestRWMutex();
+    return test::Report("test_mutex");
+}
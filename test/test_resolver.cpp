@@ -0,0 +1,412 @@
+/**
+ * @brief DNS解析器测试
+ * @details 在127.0.0.1上启动一个UDP的桩DNS服务,通过setServers让解析器只向它查询。
+ *          桩服务按名字返回构造的应答,覆盖并发合并、TTL过期、SOA否定缓存、CNAME链、
+ *          伪造和不匹配的应答,以及hosts和resolv.conf的解析
+ */
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "socket.h"
+#include "resolver.h"
+#include "test.h"
+
+using namespace fisher;
+using namespace std::chrono;
+
+/**
+ * @brief 桩DNS服务,在独立线程中用未hook的系统调用应答
+ */
+class StubServer {
+public:
+    StubServer() {
+        fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        memset(&addr_, 0, sizeof(addr_));
+        addr_.sin_family = AF_INET;
+        addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::bind(fd_, (sockaddr*)&addr_, sizeof(addr_));
+        socklen_t len = sizeof(addr_);
+        getsockname(fd_, (sockaddr*)&addr_, &len);
+        thread_ = std::thread([this]() { run();});
+    }
+
+    ~StubServer() {
+        // 不足报文头长度的报文让服务线程退出
+        ::sendto(fd_, "q", 1, 0, (sockaddr*)&addr_, sizeof(addr_));
+        thread_.join();
+        ::close(fd_);
+    }
+
+    const sockaddr_in& addr() const { return addr_;}
+
+    /// 收到的查询数量
+    int served() const { return served_.load();}
+private:
+    static void Put16(std::string& s, int v) {
+        s.push_back(v >> 8);
+        s.push_back(v & 0xff);
+    }
+
+    static void Put32(std::string& s, uint32_t v) {
+        Put16(s, v >> 16);
+        Put16(s, v & 0xffff);
+    }
+
+    /**
+     * @brief 追加一条资源记录
+     * @param[in] owner 压缩指针或完整的名字
+     */
+    static void Record(std::string& out, const std::string& owner, int type
+                       ,uint32_t ttl, const std::string& rdata) {
+        out += owner;
+        Put16(out, type);
+        Put16(out, 1);
+        Put32(out, ttl);
+        Put16(out, rdata.size());
+        out += rdata;
+    }
+
+    static std::string Pointer(size_t offset) {
+        std::string s;
+        Put16(s, 0xc000 | offset);
+        return s;
+    }
+
+    /**
+     * @brief SOA记录的数据,minimum为否定缓存时间
+     */
+    static std::string Soa(uint32_t minimum) {
+        std::string soa("\x00\x00", 2);
+        for(int i = 0; i < 4; ++i) {
+            Put32(soa, 1000);
+        }
+        Put32(soa, minimum);
+        return soa;
+    }
+
+    void reply(const std::string& out, const sockaddr_in& peer) {
+        ::sendto(fd_, out.data(), out.size(), 0, (const sockaddr*)&peer, sizeof(peer));
+    }
+
+    void run() {
+        uint8_t buf[512];
+        const std::string a1("\x0a\x00\x00\x01", 4), a2("\x0a\x00\x00\x02", 4);
+        const std::string evil("\x04" "evil" "\x04" "test" "\x00", 11);
+        while(true) {
+            sockaddr_in peer;
+            socklen_t len = sizeof(peer);
+            ssize_t n = ::recvfrom(fd_, buf, sizeof(buf), 0, (sockaddr*)&peer, &len);
+            if(n <= 12) {
+                return;
+            }
+            ++served_;
+            std::string name;
+            size_t p = 12;
+            while(buf[p]) {
+                if(!name.empty()) {
+                    name += ".";
+                }
+                name.append((char*)buf + p + 1, buf[p]);
+                p += buf[p] + 1;
+            }
+            // 应答从问题部分开始复制,QR=1 RD=1 RA=1
+            size_t qend = p + 5;
+            std::string out((char*)buf, qend);
+            out[2] = 0x81;
+            out[3] = 0x80;
+            const std::string self = Pointer(12);
+            if(name == "slow.test") {
+                usleep(50 * 1000);
+                out[7] = 2;
+                Record(out, self, 1, 60, a1);
+                Record(out, self, 1, 60, a2);
+            } else if(name == "short.test") {
+                out[7] = 1;
+                Record(out, self, 1, 1, a2);
+            } else if(name == "cname.test") {
+                // cname.test -> mid.test -> slow.test,只有slow.test的A记录有效
+                out[7] = 3;
+                size_t mid = out.size() + 12;
+                Record(out, self, 5, 60, std::string("\x03" "mid" "\x04" "test" "\x00", 10));
+                size_t target = out.size() + 12;
+                Record(out, Pointer(mid), 5, 60, std::string("\x04" "slow" "\x04" "test" "\x00", 11));
+                Record(out, Pointer(target), 1, 60, a1);
+            } else if(name == "neg.test" || name == "missing.test" || name == "missing.test.corp") {
+                // NXDOMAIN,authority中带SOA
+                out[3] = 0x83;
+                out[9] = 1;
+                Record(out, self, 6, 600, Soa(name == "neg.test" ? 1 : 30));
+            } else if(name == "nosoa.test") {
+                out[3] = 0x83;
+            } else if(name == "spoof.test") {
+                // 不属于查询名字的A记录
+                out[7] = 1;
+                Record(out, evil, 1, 60, a1);
+            } else if(name == "order.test") {
+                // CNAME在A记录之后,A记录的名字是CNAME的目标
+                out[7] = 2;
+                Record(out, evil, 1, 60, a2);
+                Record(out, self, 5, 60, evil);
+            } else if(name == "forged.test") {
+                // 先发送ID不对和问题不对的应答,再发送正确的应答
+                std::string wrong_id = out;
+                wrong_id[0] ^= 0x55;
+                wrong_id[7] = 1;
+                Record(wrong_id, self, 1, 60, a2);
+                reply(wrong_id, peer);
+                std::string wrong_q = out;
+                wrong_q[13] = 'x';
+                wrong_q[7] = 1;
+                Record(wrong_q, self, 1, 60, a2);
+                reply(wrong_q, peer);
+                reply("garbage", peer);
+                out[7] = 1;
+                Record(out, self, 1, 60, a1);
+            } else if(name == "loop.test") {
+                // 指向自身的压缩指针
+                out[7] = 1;
+                Record(out, Pointer(out.size()), 1, 60, a1);
+            } else if(name == "host.corp") {
+                out[7] = 1;
+                Record(out, self, 1, 60, a2);
+            } else if(name == "drop.test") {
+                continue;
+            } else {
+                // SERVFAIL
+                out[3] = 0x82;
+            }
+            reply(out, peer);
+        }
+    }
+private:
+    int fd_;
+    sockaddr_in addr_;
+    std::atomic<int> served_ = {0};
+    std::thread thread_;
+};
+
+static StubServer* s_stub = nullptr;
+static std::string s_resolv_conf;
+static std::string s_hosts;
+
+static std::string Ip(const std::vector<in_addr>& v, size_t i) {
+    return i < v.size() ? inet_ntoa(v[i]) : "-";
+}
+
+static long long ElapsedMS(steady_clock::time_point start) {
+    return duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+/**
+ * @brief 写入测试用的resolv.conf和hosts
+ */
+static void WriteConfig() {
+    char dir[] = "/tmp/fisher_resolverXXXXXX";
+    if(!mkdtemp(dir)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    s_resolv_conf = std::string(dir) + "/resolv.conf";
+    s_hosts = std::string(dir) + "/hosts";
+    FILE* f = fopen(s_resolv_conf.c_str(), "w");
+    fprintf(f, "# comment\n; comment\nnameserver 127.0.0.1\n"
+            "search corp.\noptions timeout:1 attempts:1 ndots:1\n");
+    fclose(f);
+    f = fopen(s_hosts.c_str(), "w");
+    fprintf(f, "1.2.3.4 MyHost alias # trailing comment\n::1 ip6host\n"
+            "# 5.6.7.8 commented\n  9.9.9.9\tTabbed\n");
+    fclose(f);
+}
+
+static void RemoveConfig() {
+    unlink(s_resolv_conf.c_str());
+    unlink(s_hosts.c_str());
+    rmdir(s_resolv_conf.substr(0, s_resolv_conf.rfind('/')).c_str());
+}
+
+/**
+ * @brief 指向桩服务的解析器,第一个nameserver拒绝连接,检查换下一个
+ */
+static void SetupResolver(Resolver& r, bool keep_timeout = false) {
+    sockaddr_in refused = s_stub->addr();
+    refused.sin_port = htons(1);
+    r.setServers({refused, s_stub->addr()});
+    if(!keep_timeout) {
+        r.setTimeout(200);
+    }
+}
+
+/**
+ * @brief hosts文件和resolv.conf中的search、ndots、timeout、attempts
+ */
+static void TestConfig() {
+    Resolver r(s_resolv_conf, s_hosts);
+    SetupResolver(r, true);
+    test::RunInIOManager(1, [&]() {
+        std::vector<in_addr> v;
+        int before = s_stub->served();
+        // hosts中的名字不区分大小写,别名同样有效,IPv6和注释行被忽略
+        FISHER_CHECK(r.lookup("myhost", v) == Resolver::SUCCESS && Ip(v, 0) == "1.2.3.4");
+        FISHER_CHECK(r.lookup("ALIAS", v) == Resolver::SUCCESS && Ip(v, 0) == "1.2.3.4");
+        FISHER_CHECK(r.lookup("tabbed", v) == Resolver::SUCCESS && Ip(v, 0) == "9.9.9.9");
+        FISHER_CHECK(r.lookup("8.8.4.4", v) == Resolver::SUCCESS && Ip(v, 0) == "8.8.4.4");
+        FISHER_CHECK(s_stub->served() == before);
+        FISHER_CHECK(r.getStats().hosts == 4);
+
+        // 没有点的名字先加search后缀
+        FISHER_CHECK(r.lookup("host", v) == Resolver::SUCCESS && Ip(v, 0) == "10.0.0.2");
+        // 点数达到ndots先查原名,失败再加后缀
+        before = s_stub->served();
+        FISHER_CHECK(r.lookup("missing.test", v) == Resolver::NOT_FOUND && v.empty());
+        FISHER_CHECK(s_stub->served() == before + 2);
+
+        // options timeout:1 attempts:1,拒绝连接的nameserver不计入等待
+        auto start = steady_clock::now();
+        FISHER_CHECK(r.lookup("drop.test.", v) == Resolver::TIMEOUT);
+        long long ms = ElapsedMS(start);
+        FISHER_CHECK(ms >= 950 && ms < 1500);
+        FISHER_CHECK(r.getStats().timeouts == 1);
+
+        FISHER_CHECK(r.lookup("bad..name", v) == Resolver::FAILURE);
+        FISHER_CHECK(r.lookup("", v) == Resolver::FAILURE);
+        FISHER_CHECK(r.lookup("servfail.test.", v) == Resolver::FAILURE);
+    });
+}
+
+/**
+ * @brief 并发查询同一个名字只发送一次查询
+ */
+static void TestCoalesce() {
+    Resolver r(s_resolv_conf, s_hosts);
+    SetupResolver(r);
+    const int n = 100;
+    std::atomic<int> good = {0};
+    int before = s_stub->served();
+    test::RunInIOManager(2, [&]() {
+        for(int i = 0; i < n; ++i) {
+            Scheduler::GetThis()->schedule([&]() {
+                std::vector<in_addr> v;
+                if(r.lookup("Slow.Test.", v) == Resolver::SUCCESS
+                        && Ip(v, 0) == "10.0.0.1" && Ip(v, 1) == "10.0.0.2") {
+                    ++good;
+                }
+            });
+        }
+    });
+    FISHER_CHECK(good == n);
+    FISHER_CHECK(s_stub->served() == before + 1);
+    Resolver::Stats stats = r.getStats();
+    // 拒绝连接的nameserver和桩服务各发送一次
+    FISHER_CHECK(stats.queries == 2);
+    FISHER_CHECK(stats.coalesced == n - 1);
+    FISHER_CHECK(stats.misses == n);
+}
+
+/**
+ * @brief 肯定结果按TTL过期,否定结果按SOA缓存,没有SOA不缓存
+ */
+static void TestCache() {
+    Resolver r(s_resolv_conf, s_hosts);
+    SetupResolver(r);
+    test::RunInIOManager(1, [&]() {
+        std::vector<in_addr> v;
+        int before = s_stub->served();
+        FISHER_CHECK(r.lookup("short.test.", v) == Resolver::SUCCESS && Ip(v, 0) == "10.0.0.2");
+        FISHER_CHECK(r.lookup("short.test.", v) == Resolver::SUCCESS);
+        FISHER_CHECK(s_stub->served() == before + 1);
+        FISHER_CHECK(r.getStats().hits == 1);
+
+        // SOA的MINIMUM为30秒,小于记录的TTL
+        FISHER_CHECK(r.lookup("missing.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(r.lookup("missing.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(s_stub->served() == before + 2);
+        // SOA的MINIMUM为1秒
+        FISHER_CHECK(r.lookup("neg.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(r.lookup("neg.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(s_stub->served() == before + 3);
+        // 没有SOA的否定结果每次都查询
+        FISHER_CHECK(r.lookup("nosoa.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(r.lookup("nosoa.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(s_stub->served() == before + 5);
+
+        sleep_for_us(1100 * 1000);
+        FISHER_CHECK(r.lookup("short.test.", v) == Resolver::SUCCESS);
+        FISHER_CHECK(r.lookup("neg.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(r.lookup("missing.test.", v) == Resolver::NOT_FOUND);
+        FISHER_CHECK(s_stub->served() == before + 7);
+
+        FISHER_CHECK(r.getStats().cached == 3);
+        r.setMaxCached(2);
+        FISHER_CHECK(r.getStats().cached <= 2);
+        r.clearCache();
+        FISHER_CHECK(r.getStats().cached == 0);
+    });
+}
+
+/**
+ * @brief CNAME链、伪造的记录、不匹配的应答和畸形报文
+ */
+static void TestAnswers() {
+    Resolver r(s_resolv_conf, s_hosts);
+    SetupResolver(r);
+    test::RunInIOManager(1, [&]() {
+        std::vector<in_addr> v;
+        // 沿CNAME链只接受最终目标的A记录
+        FISHER_CHECK(r.lookup("cname.test.", v) == Resolver::SUCCESS
+                && v.size() == 1 && Ip(v, 0) == "10.0.0.1");
+        FISHER_CHECK(r.lookup("order.test.", v) == Resolver::SUCCESS && Ip(v, 0) == "10.0.0.2");
+        // 名字不符的A记录被丢弃
+        FISHER_CHECK(r.lookup("spoof.test.", v) == Resolver::NOT_FOUND && v.empty());
+
+        // ID或问题不匹配的应答被忽略,继续等待正确的应答
+        uint64_t timeouts = r.getStats().timeouts;
+        FISHER_CHECK(r.lookup("forged.test.", v) == Resolver::SUCCESS
+                && v.size() == 1 && Ip(v, 0) == "10.0.0.1");
+        FISHER_CHECK(r.getStats().timeouts == timeouts);
+
+        // 压缩指针成环的应答无法解析,最终超时
+        auto start = steady_clock::now();
+        FISHER_CHECK(r.lookup("loop.test.", v) == Resolver::TIMEOUT);
+        FISHER_CHECK(ElapsedMS(start) < 1000);
+    });
+
+    // 不在协程中时阻塞当前线程
+    std::vector<in_addr> v;
+    FISHER_CHECK(r.lookup("cname.test.", v) == Resolver::SUCCESS && Ip(v, 0) == "10.0.0.1");
+}
+
+/**
+ * @brief Address::Lookup通过ResolverMgr解析
+ */
+static void TestAddressLookup() {
+    test::RunInIOManager(1, [&]() {
+        Address::AddressRef addr = Address::Lookup("127.0.0.1", 53);
+        FISHER_CHECK(addr && addr->toString() == "127.0.0.1:53");
+        std::vector<Address::AddressRef> all;
+        FISHER_CHECK(Address::LookupAll(all, "localhost", 80));
+        FISHER_CHECK(!all.empty() && all[0]->getPort() == 80);
+        FISHER_CHECK(!Address::Lookup("bad..name"));
+    });
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    WriteConfig();
+    s_stub = new StubServer();
+    TestConfig();
+    TestCoalesce();
+    TestCache();
+    TestAnswers();
+    TestAddressLookup();
+    delete s_stub;
+    RemoveConfig();
+    return test::Report("test_resolver");
+}
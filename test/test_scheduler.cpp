@@ -0,0 +1,164 @@
+/**
+ * @brief 调度器测试
+ * @details 检查协程在切出之前被唤醒(包括唤醒到指定线程)时不丢失、不重复执行,
+ *          停止过程中转移的协程仍能执行,非工作线程提交的回调不逐个创建协程,
+ *          以及回调的异常不论在哪里执行都同样处理
+ */
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include "fiber.h"
+#include "fiberpool.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "test.h"
+
+using namespace fisher;
+
+/**
+ * @brief 协程登记等待后、挂起之前被唤醒,切出后仍能恢复
+ */
+static void TestWakeBeforeYield() {
+    std::atomic<int> resumed = {0};
+    test::RunInIOManager(2, [&]() {
+        for(int i = 0; i < 100; ++i) {
+            FiberWaiter waiter;
+            Fiber* self = waiter.prepare();
+            waiter.wake();
+            // 唤醒时协程还在执行,由调度器在切出后放入队列
+            FISHER_CHECK(self->getState() == Fiber::READY);
+            self->yeild();
+            FISHER_CHECK(self->getState() == Fiber::EXEC);
+            ++resumed;
+        }
+    });
+    FISHER_CHECK(resumed == 100);
+}
+
+/**
+ * @brief 切出之前被唤醒到指定线程,切出后在该线程上恢复
+ * @details 调度器已在停止中,协程在线程之间转移时其他线程不能提前退出
+ */
+static void TestWakeBeforeYieldPinned() {
+    std::atomic<int> on_target = {0};
+    test::RunInIOManager(3, [&]() {
+        Scheduler* s = Scheduler::GetThis();
+        for(int i = 0; i < 30; ++i) {
+            int target = i % 3 + 1;
+            s->schedule(Fiber::GetThis(), target);
+            Fiber::GetThis()->yeild();
+            on_target += (int)Scheduler::GetThreadId() == target;
+        }
+    });
+    FISHER_CHECK(on_target == 30);
+}
+
+/**
+ * @brief 多个线程上的协程互相唤醒,唤醒常常发生在对方切出之前
+ */
+static void TestPingPong() {
+    const int rounds = 2000;
+    std::atomic<int> done = {0};
+    // 对方可能还在post中,信号量的生命周期要覆盖整个调度器
+    FiberSemaphore ping(0), pong(0);
+    test::RunInIOManager(2, [&]() {
+        Scheduler::GetThis()->schedule([&]() {
+            for(int i = 0; i < rounds; ++i) {
+                ping.wait();
+                pong.post();
+            }
+            ++done;
+        });
+        for(int i = 0; i < rounds; ++i) {
+            ping.post();
+            pong.wait();
+        }
+        ++done;
+    });
+    FISHER_CHECK(done == 2);
+}
+
+/**
+ * @brief 非工作线程提交的回调经回调注入队列由runner执行,挂起的回调仍能恢复
+ */
+static void TestInjectCallbacks() {
+    const int n = 20000;
+    std::atomic<int> ran = {0};
+    std::atomic<int> resumed = {0};
+    uint64_t created = FiberPool::GetStats().created;
+    {
+        Scheduler scheduler(2, "inject");
+        scheduler.start();
+        for(int i = 0; i < n; ++i) {
+            scheduler.schedule([&ran]() { ++ran;});
+        }
+        std::vector<std::function<void()>> batch;
+        for(int i = 0; i < 100; ++i) {
+            batch.push_back([&ran]() { ++ran;});
+        }
+        scheduler.scheduleBatch(batch.begin(), batch.end());
+        // 回调中挂起时runner转为普通协程
+        scheduler.schedule([&resumed]() {
+            FiberWaiter waiter;
+            Fiber* self = waiter.prepare();
+            waiter.wake();
+            self->yeild();
+            ++resumed;
+        });
+        scheduler.stop();
+    }
+    FISHER_CHECK(ran == n + 100);
+    FISHER_CHECK(resumed == 1);
+    // 只有runner和挂起后替换的runner需要协程
+    FISHER_CHECK(FiberPool::GetStats().created - created < 16);
+}
+
+/**
+ * @brief 回调抛出的异常记录后丢弃,不论由runner执行、包装为协程执行还是从非工作线程提交
+ */
+static void TestCallbackException() {
+    std::atomic<int> after = {0};
+    {
+        Scheduler scheduler(2, "except");
+        scheduler.start();
+        scheduler.schedule([]() { throw std::runtime_error("injected");});
+        scheduler.schedule([&after]() {
+            Scheduler* s = Scheduler::GetThis();
+            s->schedule([]() { throw std::runtime_error("runner");});
+            s->schedule([]() { throw 1;});
+            s->schedule([]() { throw std::runtime_error("pinned");}, 2);
+            for(int i = 0; i < 10; ++i) {
+                s->schedule([&after]() { ++after;});
+                s->schedule([&after]() { ++after;}, i % 2 + 1);
+            }
+        });
+        scheduler.stop();
+    }
+    FISHER_CHECK(after == 20);
+
+    // 直接调度的协程仍以EXCEPT结束,由join重新抛出
+    Fiber::FiberRef f;
+    test::RunInIOManager(1, [&]() {
+        f = FiberPool::Acquire([]() { throw std::runtime_error("fiber");});
+        Scheduler::GetThis()->schedule(f);
+        bool caught = false;
+        try {
+            f->join();
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        FISHER_CHECK(caught);
+    });
+    FISHER_CHECK(f->getState() == Fiber::EXCEPT);
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    TestWakeBeforeYield();
+    TestWakeBeforeYieldPinned();
+    TestPingPong();
+    TestInjectCallbacks();
+    TestCallbackException();
+    return test::Report("test_scheduler");
+}
@@ -0,0 +1,182 @@
+/**
+ * @brief 时间轮和TimerHandle测试
+ * @details 直接驱动TimerWheel,用构造的时间覆盖所有层和超出范围的定时器;
+ *          TimerHandle的取消分别在单线程和IOManager的并发触发下检查
+ */
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <unistd.h>
+#include "hook.h"
+#include "iomanager.h"
+#include "test.h"
+#include "timer.h"
+
+using namespace fisher;
+
+/**
+ * @brief 指定到期时间的定时器
+ */
+struct TestTimer : public TimerHandle {
+    explicit TestTimer(uint64_t at)
+        :TimerHandle(&OnTimer, nullptr) {
+        next_ = at;
+    }
+
+    uint64_t at() const { return next_;}
+
+    static void OnTimer(void* arg) {}
+};
+
+static bool Contains(const std::vector<TimerNode*>& v, TimerNode* t) {
+    return std::find(v.begin(), v.end(), t) != v.end();
+}
+
+/**
+ * @brief 每个定时器都恰好在到期的那一毫秒取出,nextExpire不晚于最近的到期时间
+ */
+static void TestCascade() {
+    const uint64_t start = 1000;
+    TimerWheel wheel(0, start);
+    std::vector<uint64_t> delays = {
+        0, 1, 255, 256, 257, 300, 511, 4096,
+        // 第1层的边界
+        (1ull << 14) - 1, 1ull << 14, (1ull << 14) + 1,
+        // 第2、3、4层
+        (1ull << 20) + 7, (1ull << 26) + 3, (1ull << 31) + 11,
+        // 超出2^32毫秒,先放在最高层,下移时重新分配
+        (1ull << 32) + 5,
+    };
+    std::vector<TestTimer*> timers;
+    for(auto d : delays) {
+        timers.push_back(new TestTimer(start + d));
+        wheel.add(timers.back());
+    }
+    FISHER_CHECK(wheel.size() == delays.size());
+
+    std::vector<TimerNode*> expired;
+    for(auto t : timers) {
+        FISHER_CHECK(wheel.nextExpire() <= t->at());
+        if(t->at() > start) {
+            expired.clear();
+            wheel.advance(t->at() - 1, expired);
+            FISHER_CHECK(!Contains(expired, t));
+            for(auto e : expired) {
+                // 其他定时器也不能提前
+                FISHER_CHECK(static_cast<TestTimer*>(e)->at() <= t->at() - 1);
+            }
+        }
+        expired.clear();
+        wheel.advance(t->at(), expired);
+        FISHER_CHECK(Contains(expired, t));
+    }
+    FISHER_CHECK(wheel.size() == 0);
+    FISHER_CHECK(wheel.nextExpire() == ~0ull);
+    for(auto t : timers) {
+        delete t;
+    }
+}
+
+/**
+ * @brief 同一个槽里的多个定时器和移除后的定时器
+ */
+static void TestRemove() {
+    const uint64_t start = 5000;
+    TimerWheel wheel(0, start);
+    TestTimer a(start + 600), b(start + 600), c(start + 600);
+    wheel.add(&a);
+    wheel.add(&b);
+    wheel.add(&c);
+    wheel.remove(&b);
+    FISHER_CHECK(wheel.size() == 2);
+
+    std::vector<TimerNode*> expired;
+    wheel.advance(start + 599, expired);
+    FISHER_CHECK(expired.empty());
+    wheel.advance(start + 600, expired);
+    FISHER_CHECK(expired.size() == 2 && Contains(expired, &a) && Contains(expired, &c));
+    FISHER_CHECK(wheel.size() == 0);
+}
+
+/**
+ * @brief 不触发通知的TimerManager,由测试调用listExpiredCb
+ */
+class ManualTimers : public TimerManager {
+protected:
+    void onTimerInsertedAtFront(size_t wheel) override {}
+};
+
+static void CountFired(void* arg) {
+    ++*static_cast<std::atomic<int>*>(arg);
+}
+
+/**
+ * @brief 取消后不再触发,未取消的恰好触发一次,析构时自动取消
+ */
+static void TestHandleCancel() {
+    ManualTimers timers;
+    std::atomic<int> cancelled_fired = {0}, kept_fired = {0}, dropped_fired = {0};
+    TimerHandle cancelled(&CountFired, &cancelled_fired);
+    TimerHandle kept(&CountFired, &kept_fired);
+    FISHER_CHECK(!cancelled.cancel());
+    timers.addTimer(cancelled, 10);
+    timers.addTimer(kept, 10);
+    {
+        TimerHandle dropped(&CountFired, &dropped_fired);
+        timers.addTimer(dropped, 10);
+    }
+    FISHER_CHECK(cancelled.cancel());
+    FISHER_CHECK(!cancelled.cancel());
+
+    usleep(30 * 1000);
+    std::vector<std::function<void()> > cbs;
+    timers.listExpiredCb(cbs);
+    // TimerHandle的回调在listExpiredCb中直接执行,不放入cbs
+    FISHER_CHECK(cbs.empty());
+    FISHER_CHECK(cancelled_fired == 0);
+    FISHER_CHECK(dropped_fired == 0);
+    FISHER_CHECK(kept_fired == 1);
+    FISHER_CHECK(!kept.cancel());
+    FISHER_CHECK(!timers.hasTimer());
+
+    // 触发或取消之后可以再次添加
+    timers.addTimer(cancelled, 1);
+    usleep(5 * 1000);
+    timers.listExpiredCb(cbs);
+    FISHER_CHECK(cancelled_fired == 1);
+}
+
+/**
+ * @brief 与工作线程上的触发竞争时,每个定时器要么cancel返回true,要么回调恰好执行一次
+ */
+static void TestHandleCancelRace() {
+    const int n = 2000;
+    std::atomic<int> fired = {0}, cancelled = {0};
+    {
+        IOManager iom(2, "test");
+        for(int i = 0; i < n; ++i) {
+            iom.schedule([&fired, &cancelled, i]() {
+                TimerHandle handle(&CountFired, &fired);
+                IOManager::GetThis()->addTimer(handle, i % 3);
+                if(i % 2) {
+                    sleep_for_us(1000);
+                }
+                if(handle.cancel()) {
+                    ++cancelled;
+                }
+            });
+        }
+        iom.stop();
+    }
+    FISHER_CHECK(fired + cancelled == n);
+    FISHER_CHECK(fired > 0);
+}
+
+int main(int argc, char** argv) {
+    test::QuietLogs();
+    TestCascade();
+    TestRemove();
+    TestHandleCancel();
+    TestHandleCancelRace();
+    return test::Report("test_timer");
+}
@@ -1,60 +1,38 @@
 #include "timer.h"
-#include "util.h"
-#include <mutex>
+#include "clock.h"
 #include <algorithm>
 
 namespace fisher {
 
-bool Timer::Comparator::operator()(const Timer::TimerRef& lhs, const Timer::TimerRef& rhs) const {
-    if(!lhs && !rhs) {
-        return false;
-    }
-    if(!lhs) {
-        return true;
-    }
-    if(!rhs) {
-        return false;
-    }
-    return lhs->next_ < rhs->next_;
-}
-
-
 Timer::Timer(uint64_t ms, std::function<void()> cb,
              bool recurring, TimerManager* manager)
-    :recurring_(recurring)
+    :TimerNode(false)
+    ,recurring_(recurring)
     ,ms_(ms)
-    ,cb_(cb)
+    ,cb_(std::move(cb))
     ,mgr_(manager) {
-    next_ = GetCurrentMS() + ms_;
-}
-
-Timer::Timer(uint64_t next)
-    :next_(next) {
+    next_ = Clock::NowMS(Clock::MONOTONIC) + ms_;
 }
 
 bool Timer::cancel() {
-    std::unique_lock lock(mgr_->mutex_);
-    if(cb_) {
-        cb_ = nullptr;
-        auto it = mgr_->timers_.find(shared_from_this());
-        mgr_->timers_.erase(it);
-        return true;
+    std::unique_lock lock(wheel_->mutex_);
+    if(slot_ < 0) {
+        return false;
     }
-    return false;
+    cb_ = nullptr;
+    wheel_->remove(this);
+    return true;
 }
 
 bool Timer::refresh() {
-    std::unique_lock lock(mgr_->mutex_);
-    if(!cb_) {
-        return false;
-    }
-    auto it = mgr_->timers_.find(shared_from_this());
-    if(it == mgr_->timers_.end()) {
+    TimerRef self = shared_from_this();
+    std::unique_lock lock(wheel_->mutex_);
+    if(slot_ < 0) {
         return false;
     }
-    mgr_->timers_.erase(it);
-    next_ = GetCurrentMS() + ms_;
-    mgr_->timers_.insert(shared_from_this());
+    wheel_->remove(this);
+    next_ = Clock::NowMS(Clock::MONOTONIC) + ms_;
+    mgr_->insertTimer(this, *wheel_);
     return true;
 }
 
@@ -62,27 +40,239 @@ bool Timer::reset(uint64_t ms, bool from_now) {
     if (ms == ms_ && !from_now) {
         return false;
     }
-    std::unique_lock lock(mgr_->mutex_);
-    if(!cb_) {
+    TimerRef self = shared_from_this();
+    std::unique_lock lock(wheel_->mutex_);
+    if(slot_ < 0) {
         return false;
     }
-    auto it = mgr_->timers_.find(shared_from_this());
-    if(it == mgr_->timers_.end()) {
+    wheel_->remove(this);
+    uint64_t start = from_now ? Clock::NowMS(Clock::MONOTONIC) : next_ - ms_;
+    ms_ = ms;
+    next_ = start + ms_;
+    mgr_->insertTimer(this, *wheel_);
+    return true;
+}
+
+bool TimerHandle::cancel() {
+    if(!wheel_) {
         return false;
     }
-    mgr_->timers_.erase(it);
-    ms_ = ms;
-    if (from_now) {
-        next_ = GetCurrentMS() + ms_;
+    std::unique_lock lock(wheel_->mutex_);
+    if(slot_ < 0) {
+        return false;
     }
-    mgr_->addTimer(shared_from_this());
+    wheel_->remove(this);
     return true;
 }
 
+TimerWheel::TimerWheel(size_t index, uint64_t now)
+    :index_(index)
+    ,current_(now) {
+}
+
+TimerWheel::~TimerWheel() {
+    for(int i = 0; i < SLOTS; ++i) {
+        TimerNode* timer = slots_[i];
+        slots_[i] = nullptr;
+        while(timer) {
+            TimerNode* succ = timer->succ_;
+            timer->slot_ = -1;
+            timer->prev_ = timer->succ_ = nullptr;
+            if(!timer->intrusive_) {
+                static_cast<Timer*>(timer)->self_.reset();
+            }
+            timer = succ;
+        }
+    }
+}
+
+void TimerWheel::add(TimerNode* timer) {
+    if(!timer->intrusive_) {
+        Timer* t = static_cast<Timer*>(timer);
+        t->self_ = t->shared_from_this();
+    }
+    place(timer);
+    ++size_;
+}
+
+void TimerWheel::remove(TimerNode* timer) {
+    unlink(timer);
+    --size_;
+    if(!timer->intrusive_) {
+        static_cast<Timer*>(timer)->self_.reset();
+    }
+}
+
+void TimerWheel::place(TimerNode* timer) {
+    uint64_t expires = std::max(timer->next_, current_);
+    uint64_t delta = expires - current_;
+    int slot;
+    if(delta < ROOT_SIZE) {
+        slot = expires & (ROOT_SIZE - 1);
+    } else {
+        const uint64_t range = 1ull << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);
+        if(delta >= range) {
+            // 超出范围的放在最高层,下移时按真实时间重新分配
+            expires = current_ + range - 1;
+            delta = range - 1;
+        }
+        int level = 1;
+        while(delta >= (1ull << (ROOT_BITS + level * LEVEL_BITS))) {
+            ++level;
+        }
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        slot = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((expires >> shift) & (LEVEL_SIZE - 1));
+    }
+
+    timer->slot_ = slot;
+    timer->prev_ = nullptr;
+    timer->succ_ = slots_[slot];
+    if(timer->succ_) {
+        timer->succ_->prev_ = timer;
+    }
+    slots_[slot] = timer;
+    bitmap_[slot >> 6] |= 1ull << (slot & 63);
+}
+
+void TimerWheel::unlink(TimerNode* timer) {
+    int slot = timer->slot_;
+    if(timer->prev_) {
+        timer->prev_->succ_ = timer->succ_;
+    } else {
+        slots_[slot] = timer->succ_;
+    }
+    if(timer->succ_) {
+        timer->succ_->prev_ = timer->prev_;
+    }
+    if(!slots_[slot]) {
+        bitmap_[slot >> 6] &= ~(1ull << (slot & 63));
+    }
+    timer->slot_ = -1;
+    timer->prev_ = timer->succ_ = nullptr;
+}
+
+void TimerWheel::cascade(int level, int idx) {
+    int slot = ROOT_SIZE + (level - 1) * LEVEL_SIZE + idx;
+    TimerNode* timer = slots_[slot];
+    slots_[slot] = nullptr;
+    bitmap_[slot >> 6] &= ~(1ull << (slot & 63));
+    while(timer) {
+        TimerNode* succ = timer->succ_;
+        place(timer);
+        timer = succ;
+    }
+}
+
+int TimerWheel::findSlot(int level, int from) const {
+    int base = level ? ROOT_SIZE + (level - 1) * LEVEL_SIZE : 0;
+    int size = level ? LEVEL_SIZE : ROOT_SIZE;
+    for(int i = from; i < from + size;) {
+        int off = i & (size - 1);
+        int bit = base + off;
+        uint64_t word = bitmap_[bit >> 6] >> (bit & 63);
+        if(word) {
+            return off + __builtin_ctzll(word);
+        }
+        i += 64 - (bit & 63);
+    }
+    return -1;
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<TimerNode*>& expired) {
+    while(current_ <= now) {
+        if(!size_) {
+            current_ = now + 1;
+            break;
+        }
+        int idx = current_ & (ROOT_SIZE - 1);
+        if(!idx) {
+            // 第0层转完一圈,逐层把上层当前槽的定时器分配下来
+            for(int level = 1; level < LEVELS; ++level) {
+                int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+                int i = (current_ >> shift) & (LEVEL_SIZE - 1);
+                cascade(level, i);
+                if(i) {
+                    break;
+                }
+            }
+        }
+
+        TimerNode* timer = slots_[idx];
+        if(!timer) {
+            // 跳过空槽,最多跳到这一圈结束
+            int next = findSlot(0, idx);
+            uint64_t step = next > idx ? next - idx : ROOT_SIZE - idx;
+            current_ = std::min(current_ + step, now + 1);
+            continue;
+        }
+
+        slots_[idx] = nullptr;
+        bitmap_[idx >> 6] &= ~(1ull << (idx & 63));
+        while(timer) {
+            TimerNode* succ = timer->succ_;
+            timer->slot_ = -1;
+            timer->prev_ = timer->succ_ = nullptr;
+            --size_;
+            expired.push_back(timer);
+            timer = succ;
+        }
+        ++current_;
+    }
+}
+
+uint64_t TimerWheel::nextExpire() const {
+    if(!size_) {
+        return ~0ull;
+    }
+    uint64_t next = ~0ull;
+    int idx = current_ & (ROOT_SIZE - 1);
+    int slot = findSlot(0, idx);
+    if(slot >= 0) {
+        next = current_ + ((slot - idx) & (ROOT_SIZE - 1));
+        if(slot >= idx) {
+            return next;
+        }
+    }
+    // 上层的定时器以下移的时间作为下界
+    for(int level = 1; level < LEVELS; ++level) {
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        uint64_t unit = 1ull << shift;
+        uint64_t start = (current_ + unit - 1) & ~(unit - 1);
+        int from = (start >> shift) & (LEVEL_SIZE - 1);
+        int s = findSlot(level, from);
+        if(s >= 0) {
+            next = std::min(next, start + ((s - from) & (LEVEL_SIZE - 1)) * unit);
+        }
+    }
+    return next;
+}
+
+TimerManager::TimerManager() {
+    setTimerWheels(1);
+}
+
+TimerManager::~TimerManager() {
+}
+
+void TimerManager::setTimerWheels(size_t n) {
+    wheels_.clear();
+    uint64_t now = Clock::CachedMS(Clock::MONOTONIC);
+    for(size_t i = 0; i < std::max(n, (size_t)1); ++i) {
+        wheels_.emplace_back(new TimerWheel(i, now));
+    }
+}
+
+TimerWheel& TimerManager::currentWheel() {
+    size_t idx = getTimerWheel();
+    return *wheels_[idx < wheels_.size() ? idx : 0];
+}
+
 Timer::TimerRef TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring) {
-    Timer::TimerRef timer(new Timer(ms, cb, recurring, this));
-    std::unique_lock lock(mutex_);
-    addTimer(timer);
+    Timer::TimerRef timer(new Timer(ms, std::move(cb), recurring, this));
+    TimerWheel& wheel = currentWheel();
+    timer->wheel_ = &wheel;
+    std::unique_lock lock(wheel.mutex_);
+    insertTimer(timer.get(), wheel);
     return timer;
 }
 
@@ -92,70 +282,85 @@ static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
     }
 }
 
+void TimerManager::addTimer(TimerHandle& handle, uint64_t ms) {
+    TimerWheel& wheel = currentWheel();
+    handle.wheel_ = &wheel;
+    handle.next_ = Clock::NowMS(Clock::MONOTONIC) + ms;
+    std::unique_lock lock(wheel.mutex_);
+    insertTimer(&handle, wheel);
+}
+
 Timer::TimerRef TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
                                     ,std::weak_ptr<void> weak_cond
                                     ,bool recurring) {
-    return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+    return addTimer(ms, std::bind(&OnTimer, std::move(weak_cond), std::move(cb)), recurring);
 }
 
 uint64_t TimerManager::getNextTimer() {
-    std::shared_lock lock(mutex_);
-    tickled_ = false;
-    if(timers_.empty()) {
+    TimerWheel& wheel = currentWheel();
+    std::unique_lock lock(wheel.mutex_);
+    wheel.tickled_ = false;
+    uint64_t next = wheel.nextExpire();
+    wheel.wake_at_ = next;
+    if(next == ~0ull) {
         return ~0ull;
     }
-
-    const Timer::TimerRef next_timer = *timers_.begin();
-    uint64_t now_ms = GetCurrentMS();
-    return std::max(next_timer->next_ - now_ms, 0ul);
+    uint64_t now_ms = Clock::CachedMS(Clock::MONOTONIC);
+    return next > now_ms ? next - now_ms : 0;
 }
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
-    std::vector<Timer::TimerRef> expired;
-    {
-        std::shared_lock lock(mutex_);
-        if(timers_.empty()) {
-            return;
-        }
-    }
-    std::unique_lock lock(mutex_);
-    if(timers_.empty()) {
+    TimerWheel& wheel = currentWheel();
+    if(!wheel.size()) {
         return;
     }
+    // 在锁外释放定时器,回调函数捕获的对象可能在析构时再操作定时器
+    std::vector<Timer::TimerRef> timers;
+    std::vector<TimerNode*> expired;
+    std::unique_lock lock(wheel.mutex_);
+    uint64_t now_ms = Clock::CachedMS(Clock::MONOTONIC);
+    wheel.advance(now_ms, expired);
+    cbs.reserve(cbs.size() + expired.size());
 
-    uint64_t now_ms = GetCurrentMS();
-    Timer::TimerRef now_timer(new Timer(now_ms));
-
-    // get all timer from begin to iter with next_ <= now
-    auto it = timers_.lower_bound(now_timer);
-    while(it != timers_.end() && (*it)->next_ == now_ms) {
-        ++it;
-    }
-    expired.insert(expired.begin(), timers_.begin(), it);
-    timers_.erase(timers_.begin(), it);
-    cbs.reserve(expired.size());
-
-    for(auto& timer : expired) {
-        cbs.push_back(timer->cb_);
+    for(auto node : expired) {
+        if(node->intrusive_) {
+            // 持有锁执行,cancel返回后回调一定已经结束
+            TimerHandle* handle = static_cast<TimerHandle*>(node);
+            handle->cb_(handle->arg_);
+            continue;
+        }
+        timers.push_back(std::move(static_cast<Timer*>(node)->self_));
+        Timer::TimerRef& timer = timers.back();
         if(timer->recurring_) {
+            cbs.push_back(timer->cb_);
             timer->next_ = now_ms + timer->ms_;
-            timers_.insert(timer);
+            wheel.add(timer.get());
+        } else {
+            cbs.push_back(std::move(timer->cb_));
+            timer->cb_ = nullptr;
         }
     }
 }
 
-void TimerManager::addTimer(Timer::TimerRef timer) {
-    auto it = timers_.insert(timer).first;
-    bool at_front = (it == timers_.begin()) && !tickled_;
-    if(at_front) {
-        tickled_ = true;
-        onTimerInsertedAtFront();
+void TimerManager::insertTimer(TimerNode* timer, TimerWheel& wheel) {
+    if(!wheel.size()) {
+        // 空的时间轮直接追上当前时间,避免之后逐圈推进
+        wheel.current_ = std::max(wheel.current_, Clock::CachedMS(Clock::MONOTONIC));
+    }
+    wheel.add(timer);
+    if(timer->next_ < wheel.wake_at_ && !wheel.tickled_) {
+        wheel.tickled_ = true;
+        onTimerInsertedAtFront(wheel.index_);
     }
 }
 
 bool TimerManager::hasTimer() {
-    std::shared_lock lock(mutex_);
-    return !timers_.empty();
+    for(auto& wheel : wheels_) {
+        if(wheel->size()) {
+            return true;
+        }
+    }
+    return false;
 }
 
-}
\ No newline at end of file
+}
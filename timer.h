@@ -2,24 +2,56 @@
 
 #include <memory>
 #include <vector>
-#include <set>
+#include <atomic>
+#include <mutex>
 #include <functional>
-#include <shared_mutex>
 
 namespace fisher {
 
 class TimerManager;
+class TimerWheel;
+
+/**
+ * @brief 时间轮中的节点
+ * @details 保存到期时间和槽位链表,由Timer和TimerHandle继承
+ */
+class TimerNode {
+friend class TimerManager;
+friend class TimerWheel;
+protected:
+    /**
+     * @brief 构造函数
+     * @param[in] intrusive 是否为TimerHandle
+     */
+    explicit TimerNode(bool intrusive)
+        :intrusive_(intrusive) {}
+
+    /// 是否为TimerHandle,否则为Timer
+    bool intrusive_;
+    /// 精确的执行时间
+    uint64_t next_ = 0;
+    /// 所属的时间轮
+    TimerWheel* wheel_ = nullptr;
+    /// 所在的槽位,-1表示不在时间轮中
+    int slot_ = -1;
+    /// 槽位链表的前后节点
+    TimerNode* prev_ = nullptr;
+    TimerNode* succ_ = nullptr;
+};
+
 /**
  * @brief 定时器
  */
-class Timer : public std::enable_shared_from_this<Timer> {
+class Timer : public TimerNode, public std::enable_shared_from_this<Timer> {
 friend class TimerManager;
+friend class TimerWheel;
 public:
     /// 定时器的智能指针类型
     using TimerRef = std::shared_ptr<Timer>;
 
     /**
      * @brief 取消定时器
+     * @return 定时器已触发或已取消时返回false
      */
     bool cancel();
 
@@ -45,38 +77,164 @@ private:
      */
     Timer(uint64_t ms, std::function<void()> cb,
           bool recurring, TimerManager* manager);
-    /**
-     * @brief 构造函数
-     * @param[in] next 执行的时间戳(毫秒)
-     */
-    Timer(uint64_t next);
 
     /// 是否循环定时器
     bool recurring_ = false;
     /// 执行周期
     uint64_t ms_ = 0;
-    /// 精确的执行时间
-    uint64_t next_ = 0;
     /// 回调函数
     std::function<void()> cb_;
     /// 定时器管理器
     TimerManager* mgr_ = nullptr;
+    /// 在时间轮中时持有自身的引用
+    TimerRef self_;
+};
+
+/**
+ * @brief 侵入式的一次性定时器
+ * @details 由使用者持有(通常在协程栈上),添加和取消都不分配内存。
+ *          回调在持有时间轮锁时直接在工作线程上执行,不能阻塞,也不能再操作同一个时间轮;
+ *          cancel返回之后回调一定已经结束,此时可以安全地销毁TimerHandle
+ */
+class TimerHandle : public TimerNode {
+friend class TimerManager;
+public:
+    /// 回调函数类型
+    using Callback = void(*)(void* arg);
 
     /**
-     * @brief 定时器比较仿函数
+     * @brief 构造函数
+     * @param[in] cb 回调函数
+     * @param[in] arg 回调函数的参数
+     */
+    TimerHandle(Callback cb, void* arg)
+        :TimerNode(true)
+        ,cb_(cb)
+        ,arg_(arg) {}
+
+    /**
+     * @brief 析构函数,取消还未触发的定时器
+     */
+    ~TimerHandle() { cancel();}
+
+    TimerHandle(const TimerHandle&) = delete;
+    TimerHandle& operator=(const TimerHandle&) = delete;
+
+    /**
+     * @brief 取消定时器
+     * @return 定时器已触发、已取消或未添加时返回false
      */
-    struct Comparator {
-        /**
-         * @brief 比较定时器的智能指针的大小(按执行时间排序)
-         * @param[in] lhs 定时器智能指针
-         * @param[in] rhs 定时器智能指针
-         */
-        bool operator()(const Timer::TimerRef& lhs, const Timer::TimerRef& rhs) const;
-    };
+    bool cancel();
+private:
+    /// 回调函数
+    Callback cb_;
+    /// 回调函数的参数
+    void* arg_;
+};
+
+/**
+ * @brief 分层时间轮
+ * @details 毫秒精度。第0层256个槽,每槽1毫秒;之后4层各64个槽,
+ *          每层槽的跨度是下一层一整圈,共覆盖2^32毫秒,更远的定时器放在最高层。
+ *          插入和取消都是O(1),第0层转完一圈时把上一层对应槽的定时器重新分配到下层。
+ *          所有操作都需要持有mutex_
+ */
+class TimerWheel {
+friend class Timer;
+friend class TimerHandle;
+friend class TimerManager;
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] index 在TimerManager中的下标
+     * @param[in] now 当前时间(毫秒)
+     */
+    TimerWheel(size_t index, uint64_t now);
+
+    /**
+     * @brief 析构函数,释放还在时间轮中的定时器
+     */
+    ~TimerWheel();
+
+    /**
+     * @brief 添加定时器
+     */
+    void add(TimerNode* timer);
+
+    /**
+     * @brief 移除定时器
+     */
+    void remove(TimerNode* timer);
+
+    /**
+     * @brief 推进到now,取出所有到期的定时器
+     * @param[in] now 当前时间(毫秒)
+     * @param[out] expired 到期的定时器
+     */
+    void advance(uint64_t now, std::vector<TimerNode*>& expired);
+
+    /**
+     * @brief 下一次需要处理的时间(毫秒),可能早于实际最近的到期时间
+     * @return 没有定时器返回~0ull
+     */
+    uint64_t nextExpire() const;
+
+    /**
+     * @brief 定时器数量
+     */
+    size_t size() const { return size_;}
+private:
+    /**
+     * @brief 按到期时间把定时器挂到对应的槽上
+     */
+    void place(TimerNode* timer);
+
+    /**
+     * @brief 从所在的槽上摘下定时器
+     */
+    void unlink(TimerNode* timer);
+
+    /**
+     * @brief 把第level层第idx个槽的定时器重新分配到下层
+     */
+    void cascade(int level, int idx);
+
+    /**
+     * @brief 在一层中从from开始循环查找第一个非空槽
+     * @return 槽在层内的下标,没有返回-1
+     */
+    int findSlot(int level, int from) const;
+
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 5;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int SLOTS = ROOT_SIZE + LEVEL_SIZE * (LEVELS - 1);
+
+    /// 在TimerManager中的下标
+    size_t index_;
+    std::mutex mutex_;
+    /// 下一个待处理的毫秒
+    uint64_t current_;
+    /// 定时器数量
+    std::atomic<size_t> size_ = {0};
+    /// 每个槽的定时器链表
+    TimerNode* slots_[SLOTS] = {};
+    /// 非空槽的位图
+    uint64_t bitmap_[SLOTS / 64] = {};
+    /// 等待线程预计醒来的时间
+    uint64_t wake_at_ = ~0ull;
+    /// 是否触发onTimerInsertedAtFront
+    bool tickled_ = false;
 };
 
 /**
  * @brief 定时器管理器
+ * @details 定时器保存在分层时间轮中。默认只有一个时间轮,
+ *          也可以设置多个,由子类决定每个线程使用哪一个。
+ *          截止时间按Clock::NowMS(Clock::MONOTONIC)计算;时间轮按Clock::CachedMS推进,
+ *          需要子类在事件循环中调用Clock::Update
  */
 class TimerManager {
 friend class Timer;
@@ -84,12 +242,12 @@ public:
     /**
      * @brief 构造函数
      */
-    TimerManager() {};
+    TimerManager();
 
     /**
      * @brief 析构函数
      */
-    virtual ~TimerManager() {};
+    virtual ~TimerManager();
 
     /**
      * @brief 添加定时器
@@ -112,12 +270,20 @@ public:
                         ,bool recurring = false);
 
     /**
-     * @brief 到最近一个定时器执行的时间间隔(毫秒)
+     * @brief 添加侵入式定时器
+     * @param[in] handle 定时器,不能已在时间轮中
+     * @param[in] ms 超时时间(毫秒)
+     */
+    void addTimer(TimerHandle& handle, uint64_t ms);
+
+    /**
+     * @brief 当前线程的时间轮到最近一个定时器执行的时间间隔(毫秒)
      */
     uint64_t getNextTimer();
 
     /**
-     * @brief 获取需要执行的定时器的回调函数列表
+     * @brief 获取当前线程的时间轮中需要执行的定时器的回调函数列表
+     * @details 到期的TimerHandle在这里直接执行回调
      * @param[out] cbs 回调函数数组
      */
     void listExpiredCb(std::vector<std::function<void()> >& cbs);
@@ -129,22 +295,34 @@ public:
 protected:
 
     /**
-     * @brief 当有新的定时器插入到定时器的首部,执行该函数
+     * @brief 当有新的定时器插入到时间轮的首部,执行该函数
+     * @param[in] wheel 时间轮下标
      */
-    virtual void onTimerInsertedAtFront() = 0;
+    virtual void onTimerInsertedAtFront(size_t wheel) = 0;
 
     /**
-     * @brief 将定时器添加到管理器中
+     * @brief 设置时间轮数量,只能在添加定时器之前调用
      */
-    void addTimer(Timer::TimerRef val);
+    void setTimerWheels(size_t n);
 
+    /**
+     * @brief 返回当前线程使用的时间轮下标
+     */
+    virtual size_t getTimerWheel() { return 0;}
 
 private:
-    std::shared_mutex mutex_;
-    /// 定时器集合
-    std::set<Timer::TimerRef, Timer::Comparator> timers_;
-    /// 是否触发onTimerInsertedAtFront
-    bool tickled_ = false;
+    /**
+     * @brief 将定时器添加到时间轮中,需持有wheel的锁
+     */
+    void insertTimer(TimerNode* timer, TimerWheel& wheel);
+
+    /**
+     * @brief 返回当前线程使用的时间轮
+     */
+    TimerWheel& currentWheel();
+
+    /// 时间轮
+    std::vector<std::unique_ptr<TimerWheel>> wheels_;
 };
 
 }
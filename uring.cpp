@@ -0,0 +1,150 @@
+#include "uring.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "log.h"
+
+namespace fisher {
+
+static Logger::LoggerRef g_logger = FISHER_LOG_NAME("system");
+
+static int io_uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = io_uring_setup(entries, &params);
+    if(fd_ < 0) {
+        FISHER_LOG_ERROR(g_logger) << "io_uring_setup(" << entries << ") errno="
+            << errno << " errstr=" << strerror(errno);
+        fd_ = -1;
+        return;
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap) {
+        sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE
+                   ,MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if(sq_ptr_ == MAP_FAILED) {
+        sq_ptr_ = nullptr;
+        FISHER_LOG_ERROR(g_logger) << "io_uring mmap errno=" << errno
+            << " errstr=" << strerror(errno);
+        release();
+        return;
+    }
+    if(single_mmap) {
+        cq_ptr_ = sq_ptr_;
+    } else {
+        cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE
+                       ,MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if(cq_ptr_ == MAP_FAILED) {
+            cq_ptr_ = nullptr;
+            FISHER_LOG_ERROR(g_logger) << "io_uring mmap errno=" << errno
+                << " errstr=" << strerror(errno);
+            release();
+            return;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = (io_uring_sqe*)mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE
+                                ,MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if(sqes_ == MAP_FAILED) {
+        sqes_ = nullptr;
+        FISHER_LOG_ERROR(g_logger) << "io_uring mmap errno=" << errno
+            << " errstr=" << strerror(errno);
+        release();
+        return;
+    }
+
+    sq_head_ = (unsigned*)((char*)sq_ptr_ + params.sq_off.head);
+    sq_tail_ = (unsigned*)((char*)sq_ptr_ + params.sq_off.tail);
+    sq_mask_ = (unsigned*)((char*)sq_ptr_ + params.sq_off.ring_mask);
+    sq_array_ = (unsigned*)((char*)sq_ptr_ + params.sq_off.array);
+    cq_head_ = (unsigned*)((char*)cq_ptr_ + params.cq_off.head);
+    cq_tail_ = (unsigned*)((char*)cq_ptr_ + params.cq_off.tail);
+    cq_mask_ = (unsigned*)((char*)cq_ptr_ + params.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe*)((char*)cq_ptr_ + params.cq_off.cqes);
+    sqe_tail_ = *sq_tail_;
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+void IoUring::release() {
+    if(sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if(cq_ptr_ && cq_ptr_ != sq_ptr_) {
+        munmap(cq_ptr_, cq_size_);
+    }
+    cq_ptr_ = nullptr;
+    if(sq_ptr_) {
+        munmap(sq_ptr_, sq_size_);
+        sq_ptr_ = nullptr;
+    }
+    if(fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+unsigned IoUring::sqSpace() const {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    return sq_entries_ - (sqe_tail_ - head);
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    if(!sqSpace()) {
+        return nullptr;
+    }
+    unsigned idx = sqe_tail_ & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++sqe_tail_;
+    ++pending_;
+    return sqe;
+}
+
+int IoUring::submit() {
+    if(!pending_) {
+        return 0;
+    }
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    int rt = io_uring_enter(fd_, pending_, 0, 0);
+    if(rt < 0) {
+        return -errno;
+    }
+    pending_ -= rt;
+    return rt;
+}
+
+bool IoUring::popCqe(io_uring_cqe& cqe) {
+    unsigned head = *cq_head_;
+    if(head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    cqe = cqes_[head & *cq_mask_];
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+}
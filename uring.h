@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+namespace fisher {
+
+/**
+ * @brief io_uring的简单封装
+ * @details 直接使用io_uring_setup/io_uring_enter系统调用,不依赖liburing。
+ *          非线程安全,每个工作线程持有一个实例
+ */
+class IoUring {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] entries 提交队列长度
+     */
+    explicit IoUring(unsigned entries = 256);
+
+    /**
+     * @brief 析构函数
+     */
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * @brief 是否初始化成功
+     */
+    bool isValid() const { return fd_ >= 0;}
+
+    /**
+     * @brief 返回ring的文件句柄,可加入epoll等待完成事件
+     */
+    int getFd() const { return fd_;}
+
+    /**
+     * @brief 返回提交队列中空闲的位置数量
+     */
+    unsigned sqSpace() const;
+
+    /**
+     * @brief 获取一个清零的sqe
+     * @return 提交队列已满返回nullptr
+     */
+    io_uring_sqe* getSqe();
+
+    /**
+     * @brief 提交所有已获取的sqe
+     * @return 提交的数量,失败返回-errno
+     */
+    int submit();
+
+    /**
+     * @brief 取出一个已完成的cqe
+     * @param[out] cqe 完成事件
+     * @return 没有完成事件返回false
+     */
+    bool popCqe(io_uring_cqe& cqe);
+private:
+    /**
+     * @brief 解除映射并关闭ring
+     */
+    void release();
+private:
+    /// ring文件句柄
+    int fd_ = -1;
+    /// 提交队列长度
+    unsigned sq_entries_ = 0;
+    /// 提交/完成队列的映射地址
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    /// sqe数组
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    /// 本地的提交队列尾,submit时才发布给内核
+    unsigned sqe_tail_ = 0;
+    /// 已获取还未提交的sqe数量
+    unsigned pending_ = 0;
+};
+
+}
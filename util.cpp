@@ -1,4 +1,6 @@
 #include "util.h"
+#include "clock.h"
+#include <errno.h>
 #include "fiber.h"
 #include "scheduler.h"
 
@@ -11,10 +13,15 @@ uint64_t GetFiberId() { return Fiber::GetFiberId(); }
 std::string GetThreadName() { return Scheduler::GetThreadName(); }
 
 uint64_t GetCurrentMS() {
-  auto now = std::chrono::system_clock::now();
-  auto now_ms = std::chrono::time_point_cast<std::chrono::milliseconds>(now);
-  auto value = now_ms.time_since_epoch().count();
-  return value;
+  return Clock::CachedMS(Clock::WALL);
+}
+
+__attribute__((noinline)) int GetErrno() {
+    return errno;
+}
+
+__attribute__((noinline)) void SetErrno(int e) {
+    errno = e;
 }
 
 void format_parser(std::vector<std::tuple<std::string, std::string, int>>& vec, std::string pattern) {
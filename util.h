@@ -12,8 +12,24 @@ uint64_t GetFiberId();
 
 std::string GetThreadName();
 
+/**
+ * @brief 当前线程缓存的墙上时钟(毫秒),用于日志和协议中的日期,读取没有系统调用
+ * @details 工作线程上最多落后一轮事件循环,定时器和超时请使用Clock::NowMS(Clock::MONOTONIC)
+ */
 uint64_t GetCurrentMS();
 
+/**
+ * @brief 读取当前线程的errno
+ * @details __errno_location被声明为const,编译器会在函数内缓存它的地址。
+ *          协程切换后可能已经换了线程,切换之后的errno都要通过GetErrno/SetErrno访问
+ */
+int GetErrno();
+
+/**
+ * @brief 设置当前线程的errno
+ */
+void SetErrno(int e);
+
 void format_parser(std::vector<std::tuple<std::string, std::string, int>>& vec, std::string pattern);
 
 }
\ No newline at end of file
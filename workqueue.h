@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace fisher {
+
+/**
+ * @brief 有界的Chase-Lev工作窃取队列
+ * @details 只有所属线程可以push/pop(从底部),其他线程通过steal从顶部窃取。
+ *          参考 Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models"
+ */
+template<class T>
+class WorkStealingQueue {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量,向上取整为2的幂
+     */
+    explicit WorkStealingQueue(size_t capacity = 4096) {
+        size_t cap = 1;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        mask_ = cap - 1;
+        buffer_.reset(new std::atomic<T*>[cap]);
+    }
+
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+    /**
+     * @brief 从底部压入元素(仅所属线程)
+     * @return 队列已满返回false
+     */
+    bool push(T* v) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if(b - t > (int64_t)mask_) {
+            return false;
+        }
+        buffer_[b & mask_].store(v, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief 从底部弹出元素(仅所属线程)
+     * @return 队列为空返回nullptr
+     */
+    T* pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if(t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* v = buffer_[b & mask_].load(std::memory_order_relaxed);
+        if(t == b) {
+            // 最后一个元素,与steal竞争
+            if(!top_.compare_exchange_strong(t, t + 1
+                        ,std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                v = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return v;
+    }
+
+    /**
+     * @brief 从顶部窃取元素(任意线程)
+     * @return 队列为空或竞争失败返回nullptr
+     */
+    T* steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b) {
+            return nullptr;
+        }
+        T* v = buffer_[t & mask_].load(std::memory_order_relaxed);
+        if(!top_.compare_exchange_strong(t, t + 1
+                    ,std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return v;
+    }
+
+    /**
+     * @brief 返回元素数量(近似值)
+     */
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    /**
+     * @brief 是否为空(近似值)
+     */
+    bool empty() const { return size() == 0;}
+private:
+    alignas(64) std::atomic<int64_t> top_ {0};
+    alignas(64) std::atomic<int64_t> bottom_ {0};
+    alignas(64) std::unique_ptr<std::atomic<T*>[]> buffer_;
+    size_t mask_ = 0;
+};
+
+}